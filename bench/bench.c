@@ -0,0 +1,941 @@
+/*
+ * Copyleft
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cfg.h"
+#include "cache.h"
+
+/*
+ * End-to-end parse benchmark
+ *
+ * A synthetic config tree is generated first: a main file including a
+ * directory of files, the first of which includes the next directory and so
+ * on up to the requested depth.  It is then parsed repeatedly and for every
+ * run wall time, throughput, allocations and file system calls of the
+ * library are reported.
+ *
+ * Allocations and calls are counted by the --wrap linker wrappers below, so
+ * only calls made by the library and this program are seen, not the ones
+ * libc makes internally.  The library makes its io_uring calls through
+ * syscall(), every open, statx and read request it submits that way is
+ * counted as one of the sqes.
+ */
+
+/* counters of wrapped calls */
+enum {
+    CALL_OPEN,
+    CALL_OPENAT,
+    CALL_CLOSE,
+    CALL_READ,
+    CALL_STAT,
+    CALL_FSTAT,
+    CALL_FSTATAT,
+    CALL_MMAP,
+    CALL_MUNMAP,
+    CALL_MADVISE,
+    CALL_OPENDIR,
+    CALL_FDOPENDIR,
+    CALL_READDIR,
+    CALL_CLOSEDIR,
+    CALL_URING_SETUP,
+    CALL_URING_ENTER,
+    CALL_COUNT
+};
+
+static const char *call_names[CALL_COUNT] = {
+    "open", "openat", "close", "read", "stat", "fstat", "fstatat", "mmap",
+    "munmap", "madvise", "opendir", "fdopendir", "readdir", "closedir",
+    "io_uring_setup", "io_uring_enter"
+};
+
+static uint64_t calls[CALL_COUNT];
+static uint64_t sqes;
+static uint64_t allocs;
+static uint64_t alloc_bytes;
+
+#define COUNT(c)        __atomic_fetch_add(&calls[c], 1, __ATOMIC_RELAXED)
+
+static void
+count_alloc(size_t size)
+{
+    __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+/* wrapped functions, see CMakeLists.txt */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_open(const char *path, int flags, ...);
+int __real_openat(int dirfd, const char *path, int flags, ...);
+int __real_close(int fd);
+ssize_t __real_read(int fd, void *buf, size_t n);
+int __real_stat(const char *path, struct stat *sb);
+int __real_fstat(int fd, struct stat *sb);
+int __real_fstatat(int dirfd, const char *path, struct stat *sb, int flags);
+void *__real_mmap(void *addr, size_t len, int prot, int flags, int fd,
+                  off_t off);
+int __real_munmap(void *addr, size_t len);
+int __real_madvise(void *addr, size_t len, int advice);
+DIR *__real_opendir(const char *path);
+DIR *__real_fdopendir(int fd);
+struct dirent *__real_readdir(DIR *dir);
+int __real_closedir(DIR *dir);
+long __real_syscall(long number, ...);
+
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t n, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+int __wrap_open(const char *path, int flags, ...);
+int __wrap_openat(int dirfd, const char *path, int flags, ...);
+int __wrap_close(int fd);
+ssize_t __wrap_read(int fd, void *buf, size_t n);
+int __wrap_stat(const char *path, struct stat *sb);
+int __wrap_fstat(int fd, struct stat *sb);
+int __wrap_fstatat(int dirfd, const char *path, struct stat *sb, int flags);
+void *__wrap_mmap(void *addr, size_t len, int prot, int flags, int fd,
+                  off_t off);
+int __wrap_munmap(void *addr, size_t len);
+int __wrap_madvise(void *addr, size_t len, int advice);
+DIR *__wrap_opendir(const char *path);
+DIR *__wrap_fdopendir(int fd);
+struct dirent *__wrap_readdir(DIR *dir);
+int __wrap_closedir(DIR *dir);
+long __wrap_syscall(long number, ...);
+
+void *__wrap_malloc(size_t size)
+{
+    count_alloc(size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    count_alloc(n * size);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    count_alloc(size);
+    return __real_realloc(ptr, size);
+}
+
+int __wrap_open(const char *path, int flags, ...)
+{
+    va_list args;
+    int mode = 0;
+
+    if (0 != (flags & O_CREAT)) {
+        va_start(args, flags);
+        mode = va_arg(args, int);
+        va_end(args);
+    }
+
+    COUNT(CALL_OPEN);
+    return __real_open(path, flags, mode);
+}
+
+int __wrap_openat(int dirfd, const char *path, int flags, ...)
+{
+    va_list args;
+    int mode = 0;
+
+    if (0 != (flags & O_CREAT)) {
+        va_start(args, flags);
+        mode = va_arg(args, int);
+        va_end(args);
+    }
+
+    COUNT(CALL_OPENAT);
+    return __real_openat(dirfd, path, flags, mode);
+}
+
+int __wrap_close(int fd)
+{
+    COUNT(CALL_CLOSE);
+    return __real_close(fd);
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t n)
+{
+    COUNT(CALL_READ);
+    return __real_read(fd, buf, n);
+}
+
+int __wrap_stat(const char *path, struct stat *sb)
+{
+    COUNT(CALL_STAT);
+    return __real_stat(path, sb);
+}
+
+int __wrap_fstat(int fd, struct stat *sb)
+{
+    COUNT(CALL_FSTAT);
+    return __real_fstat(fd, sb);
+}
+
+int __wrap_fstatat(int dirfd, const char *path, struct stat *sb, int flags)
+{
+    COUNT(CALL_FSTATAT);
+    return __real_fstatat(dirfd, path, sb, flags);
+}
+
+void *__wrap_mmap(void *addr, size_t len, int prot, int flags, int fd,
+                  off_t off)
+{
+    COUNT(CALL_MMAP);
+    return __real_mmap(addr, len, prot, flags, fd, off);
+}
+
+int __wrap_munmap(void *addr, size_t len)
+{
+    COUNT(CALL_MUNMAP);
+    return __real_munmap(addr, len);
+}
+
+int __wrap_madvise(void *addr, size_t len, int advice)
+{
+    COUNT(CALL_MADVISE);
+    return __real_madvise(addr, len, advice);
+}
+
+DIR *__wrap_opendir(const char *path)
+{
+    COUNT(CALL_OPENDIR);
+    return __real_opendir(path);
+}
+
+DIR *__wrap_fdopendir(int fd)
+{
+    COUNT(CALL_FDOPENDIR);
+    return __real_fdopendir(fd);
+}
+
+struct dirent *__wrap_readdir(DIR *dir)
+{
+    COUNT(CALL_READDIR);
+    return __real_readdir(dir);
+}
+
+int __wrap_closedir(DIR *dir)
+{
+    COUNT(CALL_CLOSEDIR);
+    return __real_closedir(dir);
+}
+
+long __wrap_syscall(long number, ...)
+{
+    va_list args;
+    long a[6], ret;
+    int i;
+
+    /* as many arguments as a system call takes, whatever the caller passed */
+    va_start(args, number);
+    for (i = 0; i < 6; i++)
+        a[i] = va_arg(args, long);
+    va_end(args);
+
+    ret = __real_syscall(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+
+    if (__NR_io_uring_setup == number) {
+        COUNT(CALL_URING_SETUP);
+    }
+    else if (__NR_io_uring_enter == number) {
+        COUNT(CALL_URING_ENTER);
+
+        /* requests the kernel took */
+        if (0 < ret)
+            __atomic_fetch_add(&sqes, (uint64_t)ret, __ATOMIC_RELAXED);
+    }
+
+    return ret;
+}
+
+/* parse APIs that can be measured */
+#define API_FILE        0   /* parse_cfg_file(), values are malloc()ed */
+#define API_EX          1   /* parse_cfg_file_ex(), values in an arena */
+#define API_CACHED      2   /* parse_cfg_file_cached() */
+#define API_STATS       3   /* parse_cfg_file_stats() */
+#define API_LAZY        4   /* parse_cfg_file_lazy() and --get values */
+#define API_ALL         5   /* parse_cfg_file_all(), keeping every value */
+#define API_LAST        API_ALL
+
+static const char *api_names[] = {"file", "ex", "cached", "stats", "lazy",
+                                  "all"};
+
+static const char *io_names[] = {"sync", "uring"};
+
+struct bench_opts {
+    const char *dir;        /* tree to generate, NULL for a temporary one */
+    int         files;      /* files in the tree, including the main one */
+    int         lines;      /* lines per file */
+    int         depth;      /* included directory levels */
+    int         fanout;     /* multistring entries per key and file */
+    int         utf8;       /* percent of string values with UTF-8 text */
+    int         params;     /* parameter table size */
+    int         get;        /* parameters read after a lazy parse */
+    int         runs;
+    int         api;
+    int         io;         /* CFG_IO_SYNC or CFG_IO_URING */
+    int         json;
+    int         keep;
+    int         gen_only;
+    unsigned    seed;
+};
+
+/* the generated tree */
+struct bench_tree {
+    char       *root;
+    char       *main_file;
+    uint64_t    files;
+    uint64_t    lines;
+    uint64_t    bytes;
+};
+
+/* measurements of one run */
+struct bench_run {
+    uint64_t    ns;
+    uint64_t    allocs;
+    uint64_t    alloc_bytes;
+    uint64_t    calls[CALL_COUNT];
+    uint64_t    syscalls;
+    uint64_t    sqes;       /* requests submitted through io_uring */
+    struct cfg_stats stats;     /* filled in for API_STATS */
+};
+
+/* a parameter variable of any type */
+union bench_var {
+    int         i;
+    uint64_t    u;
+    char       *s;
+    char      **m;
+};
+
+static unsigned bench_rand_state;
+
+static unsigned
+bench_rand(void)
+{
+    bench_rand_state = bench_rand_state * 1103515245u + 12345u;
+
+    return bench_rand_state >> 8;
+}
+
+static int
+param_type(int i)
+{
+    static const int types[] = {TYPE_INT, TYPE_UINT64, TYPE_STRING,
+                                TYPE_STRING_LIST, TYPE_MULTISTRING};
+
+    return types[i % (int)(sizeof(types) / sizeof(types[0]))];
+}
+
+/**
+ * Write a string value, plain ASCII words or mixed with UTF-8 text
+ */
+static void
+gen_text(FILE *f, int utf8, int list)
+{
+    static const char *ascii[] = {"alpha", "bravo", "charlie", "delta",
+                                  "echo", "foxtrot", "golf", "hotel"};
+    static const char *wide[] = {"caf\xc3\xa9", "\xe6\x97\xa5\xe6\x9c\xac",
+                                 "\xd0\xbc\xd0\xb8\xd1\x80",
+                                 "\xf0\x9f\x98\x80", "na\xc3\xafve"};
+    int words = 3 + (int)(bench_rand() % 6), w, mixed;
+
+    mixed = (int)(bench_rand() % 100) < utf8;
+
+    for (w = 0; w < words; w++) {
+        if (0 != w)
+            fputs(0 != list ? " , " : " ", f);
+
+        if (0 != mixed && 0 == w % 2)
+            fputs(wide[bench_rand() % 5], f);
+        else
+            fputs(ascii[bench_rand() % 8], f);
+    }
+}
+
+/**
+ * Write one generated config file
+ *
+ * @return
+ *   0 on success, -1 on error
+ */
+static int
+gen_file(const char *path, const struct bench_opts *o, const char *include,
+         struct bench_tree *tree)
+{
+    FILE *f;
+    int line = 0, p, k;
+    long size;
+
+    if (NULL == (f = fopen(path, "w"))) {
+        fprintf(stderr, "cannot create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (line < o->lines) {
+        if (0 == line % 16) {
+            fputs("### generated parameters, comments and blank lines\n", f);
+            line++;
+            continue;
+        }
+
+        if (7 == line % 16) {
+            fputs("\n", f);
+            line++;
+            continue;
+        }
+
+        p = (int)(bench_rand() % (unsigned)o->params);
+
+        switch (param_type(p)) {
+        case TYPE_INT:
+            fprintf(f, "param_%d=%u\n", p, bench_rand() % 1000000);
+            line++;
+            break;
+        case TYPE_UINT64:
+            fprintf(f, "param_%d = %u%s\n", p, bench_rand() % 100000,
+                    0 == bench_rand() % 4 ? "K" : "");
+            line++;
+            break;
+        case TYPE_STRING:
+        case TYPE_STRING_LIST:
+            fprintf(f, "param_%d=", p);
+            gen_text(f, o->utf8, TYPE_STRING_LIST == param_type(p));
+            fputs("\n", f);
+            line++;
+            break;
+        case TYPE_MULTISTRING:
+            for (k = 0; k < o->fanout && line < o->lines; k++, line++) {
+                fprintf(f, "param_%d=", p);
+                gen_text(f, o->utf8, 0);
+                fputs("\n", f);
+            }
+            break;
+        }
+    }
+
+    if (NULL != include) {
+        fprintf(f, "Include=%s\n", include);
+        line++;
+    }
+
+    size = ftell(f);
+
+    if (0 != fclose(f) || 0 > size) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return -1;
+    }
+
+    tree->files++;
+    tree->lines += (uint64_t)line;
+    tree->bytes += (uint64_t)size;
+
+    return 0;
+}
+
+/**
+ * Generate a config tree
+ *
+ * Files other than the main one are spread evenly over the include levels,
+ * the first file of every directory includes the next level.
+ *
+ * @return
+ *   0 on success, -1 on error
+ */
+static int
+gen_tree(const struct bench_opts *o, struct bench_tree *tree)
+{
+    char *path = NULL, *dir = NULL, *include = NULL;
+    int level, per, extra, n, i, ret = -1;
+
+    memset(tree, 0, sizeof(*tree));
+
+    if (NULL == o->dir) {
+        if (NULL == (tree->root = strdup("/tmp/cconf_bench.XXXXXX")) ||
+            NULL == mkdtemp(tree->root)) {
+            fprintf(stderr, "cannot create temporary directory\n");
+            return -1;
+        }
+    } else {
+        if (0 != mkdir(o->dir, 0755) && EEXIST != errno) {
+            fprintf(stderr, "cannot create %s: %s\n", o->dir, strerror(errno));
+            return -1;
+        }
+        tree->root = strdup(o->dir);
+    }
+
+    bench_rand_state = o->seed;
+
+    tree->main_file = str_dsprintf(NULL, "%s/main.conf", tree->root);
+    dir = str_dsprintf(NULL, "%s/d1", tree->root);
+    include = str_dsprintf(NULL, "%s/*.conf", dir);
+
+    if (0 != gen_file(tree->main_file, o, 0 < o->depth ? include : NULL, tree))
+        goto out;
+
+    per = 0 < o->depth ? (o->files - 1) / o->depth : 0;
+    extra = 0 < o->depth ? (o->files - 1) % o->depth : 0;
+
+    for (level = 1; level <= o->depth; level++) {
+        if (0 != mkdir(dir, 0755) && EEXIST != errno) {
+            fprintf(stderr, "cannot create %s: %s\n", dir, strerror(errno));
+            goto out;
+        }
+
+        include = str_dsprintf(include, "%s/d%d/*.conf", dir, level + 1);
+        n = per + (level <= extra ? 1 : 0);
+
+        /* every level needs a file to include the next one */
+        if (0 == n)
+            n = 1;
+
+        for (i = 0; i < n; i++) {
+            path = str_dsprintf(path, "%s/f%05d.conf", dir, i);
+
+            if (0 != gen_file(path, o, 0 == i && level < o->depth ?
+                              include : NULL, tree))
+                goto out;
+        }
+
+        dir = str_dsprintf(dir, "%s/d%d", dir, level + 1);
+    }
+
+    ret = 0;
+out:
+    free(path);
+    free(dir);
+    free(include);
+
+    return ret;
+}
+
+/**
+ * Move modification times of a tree an hour back, files changed just now
+ * are never taken from a cache image
+ */
+static void
+age_entry(const char *path, time_t when)
+{
+    struct timespec times[2];
+    char *sub = NULL;
+    struct dirent *d;
+    DIR *dir;
+
+    if (NULL != (dir = opendir(path))) {
+        while (NULL != (d = readdir(dir))) {
+            if (0 == strcmp(d->d_name, ".") || 0 == strcmp(d->d_name, ".."))
+                continue;
+
+            sub = str_dsprintf(sub, "%s/%s", path, d->d_name);
+            age_entry(sub, when);
+        }
+
+        closedir(dir);
+        free(sub);
+    }
+
+    times[0].tv_sec = times[1].tv_sec = when;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    utimensat(AT_FDCWD, path, times, 0);
+}
+
+static int
+remove_entry(const char *path)
+{
+    char *sub = NULL;
+    struct dirent *d;
+    struct stat sb;
+    DIR *dir;
+
+    if (0 != lstat(path, &sb))
+        return -1;
+
+    if (0 == S_ISDIR(sb.st_mode))
+        return unlink(path);
+
+    if (NULL == (dir = opendir(path)))
+        return -1;
+
+    while (NULL != (d = readdir(dir))) {
+        if (0 == strcmp(d->d_name, ".") || 0 == strcmp(d->d_name, ".."))
+            continue;
+
+        sub = str_dsprintf(sub, "%s/%s", path, d->d_name);
+        remove_entry(sub);
+    }
+
+    closedir(dir);
+    free(sub);
+
+    return rmdir(path);
+}
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Parse the tree once
+ *
+ * @return
+ *   0 on success, -1 on error
+ */
+static int
+bench_parse(const struct bench_opts *o, const struct bench_tree *tree,
+            struct cfg_line *cfg, union bench_var *vars,
+            const char *cache_file, struct bench_run *run)
+{
+    struct cfg_result *result = NULL;
+    uint64_t start;
+    int i, ret;
+    char name[32];
+
+    for (i = 0; i < o->params; i++) {
+        memset(&vars[i], 0, sizeof(vars[i]));
+
+        if (TYPE_MULTISTRING == param_type(i))
+            str_strarr_init(&vars[i].m);
+    }
+
+    memset(calls, 0, sizeof(calls));
+    sqes = allocs = alloc_bytes = 0;
+    start = now_ns();
+
+    switch (o->api) {
+    case API_FILE:
+        ret = parse_cfg_file(tree->main_file, cfg, CFG_FILE_REQUIRED,
+                             CFG_STRICT);
+        break;
+    case API_CACHED:
+        ret = parse_cfg_file_cached(tree->main_file, cache_file, cfg,
+                                    CFG_FILE_REQUIRED, CFG_STRICT, &result);
+        break;
+    case API_STATS:
+        ret = parse_cfg_file_stats(tree->main_file, cfg, CFG_FILE_REQUIRED,
+                                   CFG_STRICT, &result, &run->stats);
+        break;
+    case API_ALL:
+        ret = parse_cfg_file_all(tree->main_file, cfg, CFG_FILE_REQUIRED,
+                                 CFG_STRICT, &result);
+        break;
+    case API_LAZY:
+        ret = parse_cfg_file_lazy(tree->main_file, cfg, CFG_FILE_REQUIRED,
+                                  CFG_STRICT, &result);
+
+        for (i = 0; SUCCEED == ret && i < o->get && i < o->params; i++) {
+            snprintf(name, sizeof(name), "param_%d", i);
+            ret = cfg_lazy_get(result, name);
+        }
+        break;
+    default:
+        ret = parse_cfg_file_ex(tree->main_file, cfg, CFG_FILE_REQUIRED,
+                                CFG_STRICT, &result);
+        break;
+    }
+
+    run->ns = now_ns() - start;
+    run->allocs = allocs;
+    run->alloc_bytes = alloc_bytes;
+    run->syscalls = 0;
+    run->sqes = sqes;
+
+    for (i = 0; i < CALL_COUNT; i++) {
+        run->calls[i] = calls[i];
+        run->syscalls += calls[i];
+    }
+
+    for (i = 0; i < o->params; i++) {
+        if (API_FILE == o->api && (TYPE_STRING == param_type(i) ||
+                                   TYPE_STRING_LIST == param_type(i)))
+            free(vars[i].s);
+
+        if (TYPE_MULTISTRING == param_type(i))
+            str_strarr_free(vars[i].m);
+    }
+
+    /* per file statistics are released with the result */
+    run->stats.file_stats = NULL;
+    run->stats.nfile_stats = 0;
+    cfg_free(result);
+
+    return SUCCEED == ret ? 0 : -1;
+}
+
+static void
+report_run(const struct bench_opts *o, const struct bench_tree *tree,
+           const char *label, const struct bench_run *run)
+{
+    const struct cfg_stats *st = &run->stats;
+    double secs = (double)run->ns / 1e9;
+    int i;
+
+    if (0 == o->json && API_STATS == o->api) {
+        printf("%-6s %llu files (%llu replayed), %llu lines (%llu comment, "
+               "%llu blank), depth %d, %llu/%llu dir entries matched, utf8 "
+               "%.3f ms, numeric %.3f ms\n", label,
+               (unsigned long long)st->files,
+               (unsigned long long)st->replayed, (unsigned long long)st->lines,
+               (unsigned long long)st->comment_lines,
+               (unsigned long long)st->blank_lines, st->max_depth,
+               (unsigned long long)st->dir_matches,
+               (unsigned long long)st->dir_entries, (double)st->utf8_ns / 1e6,
+               (double)st->numeric_ns / 1e6);
+    }
+
+    if (0 == o->json) {
+        printf("%-6s %12.3f ms %14.0f lines/s %10.2f MB/s %10llu allocs "
+               "%12llu bytes %8llu syscalls %8llu sqes\n", label,
+               secs * 1e3, (double)tree->lines / secs,
+               (double)tree->bytes / secs / 1e6,
+               (unsigned long long)run->allocs,
+               (unsigned long long)run->alloc_bytes,
+               (unsigned long long)run->syscalls,
+               (unsigned long long)run->sqes);
+        return;
+    }
+
+    printf("{\"run\":\"%s\",\"api\":\"%s\",\"io\":\"%s\",\"files\":%llu,"
+           "\"lines\":%llu,\"bytes\":%llu,\"depth\":%d,\"fanout\":%d,"
+           "\"utf8\":%d,\"params\":%d,\"ns\":%llu,\"lines_per_s\":%.0f,"
+           "\"mb_per_s\":%.3f,\"allocs\":%llu,\"alloc_bytes\":%llu,"
+           "\"syscalls\":%llu,\"sqes\":%llu,\"calls\":{", label,
+           api_names[o->api],
+           io_names[o->io],
+           (unsigned long long)tree->files, (unsigned long long)tree->lines,
+           (unsigned long long)tree->bytes, o->depth, o->fanout, o->utf8,
+           o->params, (unsigned long long)run->ns,
+           (double)tree->lines / secs, (double)tree->bytes / secs / 1e6,
+           (unsigned long long)run->allocs,
+           (unsigned long long)run->alloc_bytes,
+           (unsigned long long)run->syscalls, (unsigned long long)run->sqes);
+
+    for (i = 0; i < CALL_COUNT; i++) {
+        printf("%s\"%s\":%llu", 0 == i ? "" : ",", call_names[i],
+               (unsigned long long)run->calls[i]);
+    }
+
+    printf("}");
+
+    if (API_STATS == o->api) {
+        printf(",\"stats\":{\"files\":%llu,\"replayed\":%llu,\"lines\":%llu,"
+               "\"comment_lines\":%llu,\"blank_lines\":%llu,"
+               "\"max_depth\":%d,\"dir_entries\":%llu,\"dir_matches\":%llu,"
+               "\"utf8_ns\":%llu,\"numeric_ns\":%llu,\"total_ns\":%llu}",
+               (unsigned long long)st->files,
+               (unsigned long long)st->replayed, (unsigned long long)st->lines,
+               (unsigned long long)st->comment_lines,
+               (unsigned long long)st->blank_lines, st->max_depth,
+               (unsigned long long)st->dir_entries,
+               (unsigned long long)st->dir_matches,
+               (unsigned long long)st->utf8_ns,
+               (unsigned long long)st->numeric_ns,
+               (unsigned long long)st->total_ns);
+    }
+
+    printf("}\n");
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --files N     files in the tree, including the main one (16)\n"
+            "  --lines N     lines per file (1000)\n"
+            "  --depth N     levels of included directories, at most %d (1)\n"
+            "  --fanout N    multistring entries per key and file (4)\n"
+            "  --utf8 P      percent of string values with UTF-8 text (10)\n"
+            "  --params N    parameter table size (64)\n"
+            "  --get N       parameters read after a lazy parse (4)\n"
+            "  --runs N      timed runs (10)\n"
+            "  --api NAME    file, ex, cached, stats, lazy or all\n"
+            "                (ex)\n"
+            "  --io NAME     sync or uring, how included files are read\n"
+            "                (uring)\n"
+            "  --seed N      generator seed (1)\n"
+            "  --dir PATH    generate the tree into PATH and keep it\n"
+            "  --gen-only    only generate the tree\n"
+            "  --keep        keep the temporary tree\n"
+            "  --json        one JSON object per run\n",
+            prog, MAX_INCLUDE_LEVEL - 1);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_opts[] = {
+        {"files", required_argument, NULL, 'f'},
+        {"lines", required_argument, NULL, 'l'},
+        {"depth", required_argument, NULL, 'd'},
+        {"fanout", required_argument, NULL, 'm'},
+        {"utf8", required_argument, NULL, 'u'},
+        {"params", required_argument, NULL, 'p'},
+        {"get", required_argument, NULL, 'G'},
+        {"runs", required_argument, NULL, 'r'},
+        {"api", required_argument, NULL, 'a'},
+        {"io", required_argument, NULL, 'i'},
+        {"seed", required_argument, NULL, 's'},
+        {"dir", required_argument, NULL, 'D'},
+        {"gen-only", no_argument, NULL, 'g'},
+        {"keep", no_argument, NULL, 'k'},
+        {"json", no_argument, NULL, 'j'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    struct bench_opts o = {NULL, 16, 1000, 1, 4, 10, 64, 4, 10, API_EX,
+                           CFG_IO_URING, 0, 0, 0, 1};
+    struct bench_tree tree;
+    struct bench_run run, best;
+    struct cfg_line *cfg;
+    union bench_var *vars;
+    char name[32], *cache_file = NULL;
+    int c, i, ret = EXIT_FAILURE;
+
+    while (-1 != (c = getopt_long(argc, argv, "", long_opts, NULL))) {
+        switch (c) {
+        case 'f': o.files = atoi(optarg); break;
+        case 'l': o.lines = atoi(optarg); break;
+        case 'd': o.depth = atoi(optarg); break;
+        case 'm': o.fanout = atoi(optarg); break;
+        case 'u': o.utf8 = atoi(optarg); break;
+        case 'p': o.params = atoi(optarg); break;
+        case 'G': o.get = atoi(optarg); break;
+        case 'r': o.runs = atoi(optarg); break;
+        case 's': o.seed = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'D': o.dir = optarg; o.keep = 1; break;
+        case 'g': o.gen_only = 1; break;
+        case 'k': o.keep = 1; break;
+        case 'j': o.json = 1; break;
+        case 'i':
+            if (0 == strcmp(optarg, io_names[CFG_IO_SYNC])) {
+                o.io = CFG_IO_SYNC;
+                break;
+            }
+            if (0 == strcmp(optarg, io_names[CFG_IO_URING])) {
+                o.io = CFG_IO_URING;
+                break;
+            }
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        case 'a':
+            for (o.api = 0; o.api <= API_LAST; o.api++) {
+                if (0 == strcmp(optarg, api_names[o.api]))
+                    break;
+            }
+            if (API_LAST >= o.api)
+                break;
+            /* fall through */
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (1 > o.files || 1 > o.lines || 0 > o.depth ||
+        MAX_INCLUDE_LEVEL - 1 < o.depth || 1 > o.fanout || 0 > o.utf8 ||
+        100 < o.utf8 || 1 > o.params || 0 > o.get || 1 > o.runs) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (0 != gen_tree(&o, &tree))
+        goto out;
+
+    age_entry(tree.root, time(NULL) - 3600);
+
+    if (0 == o.json) {
+        printf("tree %s: %llu files, %llu lines, %llu bytes\n", tree.root,
+               (unsigned long long)tree.files, (unsigned long long)tree.lines,
+               (unsigned long long)tree.bytes);
+    }
+
+    if (0 != o.gen_only) {
+        ret = EXIT_SUCCESS;
+        goto out;
+    }
+
+    cfg_set_io(o.io);
+
+    cfg = calloc((size_t)o.params + 1, sizeof(*cfg));
+    vars = calloc((size_t)o.params, sizeof(*vars));
+
+    for (i = 0; i < o.params; i++) {
+        snprintf(name, sizeof(name), "param_%d", i);
+        cfg[i].parameter = strdup(name);
+        cfg[i].variable = &vars[i];
+        cfg[i].type = param_type(i);
+        cfg[i].mandatory = PARM_OPT;
+    }
+
+    if (API_CACHED == o.api)
+        cache_file = str_dsprintf(NULL, "%s/cache.img", tree.root);
+
+    memset(&best, 0, sizeof(best));
+
+    /* one untimed run to warm up the page cache and the cache image */
+    if (0 != bench_parse(&o, &tree, cfg, vars, cache_file, &run)) {
+        fprintf(stderr, "cannot parse %s\n", tree.main_file);
+        goto free;
+    }
+
+    for (i = 1; i <= o.runs; i++) {
+        if (0 != bench_parse(&o, &tree, cfg, vars, cache_file, &run)) {
+            fprintf(stderr, "cannot parse %s\n", tree.main_file);
+            goto free;
+        }
+
+        snprintf(name, sizeof(name), "%d", i);
+        report_run(&o, &tree, name, &run);
+
+        if (0 == best.ns || run.ns < best.ns)
+            best = run;
+    }
+
+    report_run(&o, &tree, "best", &best);
+    ret = EXIT_SUCCESS;
+free:
+    for (i = 0; i < o.params; i++)
+        free((char *)(uintptr_t)cfg[i].parameter);
+
+    free(cfg);
+    free(vars);
+
+    if (NULL != cache_file)
+        unlink(cache_file);
+
+    free(cache_file);
+out:
+    if (0 == o.keep && NULL != tree.root)
+        remove_entry(tree.root);
+
+    free(tree.root);
+    free(tree.main_file);
+
+    return ret;
+}
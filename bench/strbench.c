@@ -0,0 +1,528 @@
+/*
+ * Copyleft
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define HAVE_TSC    1
+#endif
+
+#include "str.h"
+
+/*
+ * Microbenchmark of the str.c helpers on the per-line hot path
+ *
+ * Every case runs one function over one input in batches that take at
+ * least --min-ms, the fastest of --reps batches is reported as ns/op and
+ * cycles/byte.  Functions that modify their input work on a fresh copy for
+ * every call, the "memcpy" rows show what that copy costs by itself.
+ *
+ * Cycles are read from the time stamp counter, with --perf the cycles,
+ * instructions and branch misses of the batch are read from hardware
+ * counters through perf_event_open(2) instead.
+ */
+
+/* what a case runs */
+enum {
+    OP_MEMCPY,
+    OP_LTRIM,
+    OP_RTRIM,
+    OP_IS_UTF8,
+    OP_STR2UINT64,
+    OP_IS_UINT_N_RANGE,
+    OP_TRIM_STR_LIST,
+    OP_DSPRINTF,
+    OP_BUF_PRINTF
+};
+
+static const char *op_names[] = {
+    "memcpy", "str_ltrim", "str_rtrim", "str_is_utf8", "str2uint64",
+    "is_uint_n_range", "str_trim_str_list", "str_dsprintf", "str_buf_printf"
+};
+
+struct sb_case {
+    int         op;
+    const char *input;      /* name of the input */
+    char       *data;
+    size_t      len;
+    char       *work;       /* copy for functions that modify the input */
+    char       *dest;       /* str_dsprintf() buffer carried between calls */
+    struct str_buf sb;      /* str_buf_printf() builder reused between calls */
+};
+
+struct sb_opts {
+    const char *filter;
+    int         min_ms;
+    int         reps;
+    int         perf;
+    int         json;
+};
+
+/* hardware counters of a batch */
+struct sb_counters {
+    uint64_t    cycles;
+    uint64_t    instructions;
+    uint64_t    branch_misses;
+};
+
+static volatile uint64_t sink;
+
+#define SB_SHORT    32
+#define SB_LONG     2048
+
+/**
+ * Fill a buffer with ASCII text
+ */
+static char *
+gen_ascii(size_t len, const char *pad)
+{
+    static const char text[] = "the quick brown fox jumps over the lazy dog ";
+    size_t plen = strlen(pad), i;
+    char *s;
+
+    s = malloc(len + 2 * plen + 1);
+
+    memcpy(s, pad, plen);
+
+    for (i = 0; i < len; i++)
+        s[plen + i] = text[i % (sizeof(text) - 1)];
+
+    memcpy(s + plen + len, pad, plen + 1);
+
+    return s;
+}
+
+/**
+ * Fill a buffer with mostly multi-byte UTF-8 text, cut at a character
+ * boundary
+ */
+static char *
+gen_utf8(size_t len, const char *pad)
+{
+    static const char *chars[] = {"\xc3\xa9", "\xe6\x97\xa5", "a",
+                                  "\xf0\x9f\x98\x80", "\xd0\xbc",
+                                  "\xe2\x82\xac"};
+    size_t plen = strlen(pad), n = 0, k, i = 0;
+    char *s;
+
+    s = malloc(len + 2 * plen + 1);
+
+    memcpy(s, pad, plen);
+
+    while (1) {
+        k = strlen(chars[i % 6]);
+
+        if (n + k > len)
+            break;
+
+        memcpy(s + plen + n, chars[i++ % 6], k);
+        n += k;
+    }
+
+    /* fill the rest up to len with ASCII */
+    for (; n < len; n++)
+        s[plen + n] = 'x';
+
+    memcpy(s + plen + len, pad, plen + 1);
+
+    return s;
+}
+
+static char *
+gen_list(size_t len)
+{
+    static const char *items[] = {"alpha", " , ", "bravo", ",", "charlie",
+                                  "\t, ", "delta", " ,"};
+    size_t n = 0, k, i = 0;
+    char *s;
+
+    s = malloc(len + 1);
+
+    while (n < len) {
+        k = strlen(items[i % 8]);
+
+        if (n + k > len)
+            k = len - n;
+
+        memcpy(s + n, items[i++ % 8], k);
+        n += k;
+    }
+
+    s[len] = '\0';
+
+    return s;
+}
+
+static int
+add_case(struct sb_case *cases, int n, int op, const char *input, char *data)
+{
+    cases[n].op = op;
+    cases[n].input = input;
+    cases[n].data = data;
+    cases[n].len = strlen(data);
+    cases[n].work = malloc(cases[n].len + 1);
+    cases[n].dest = NULL;
+    str_buf_init(&cases[n].sb);
+
+    return n + 1;
+}
+
+static int
+build_cases(struct sb_case *cases)
+{
+    static const char pad[] = " \t  \t ";
+    static const struct {
+        const char *name;
+        const char *value;
+    } numbers[] = {
+        {"digits_5", "12345"},
+        {"digits_20", "18446744073709551615"},
+        {"suffix_K", "123456K"},
+        {"suffix_w", "52w"}
+    };
+    size_t i;
+    int n = 0, op;
+
+    for (op = OP_MEMCPY; op <= OP_RTRIM; op++) {
+        n = add_case(cases, n, op, "ascii_32", gen_ascii(SB_SHORT, pad));
+        n = add_case(cases, n, op, "ascii_2k", gen_ascii(SB_LONG, pad));
+        n = add_case(cases, n, op, "utf8_32", gen_utf8(SB_SHORT, pad));
+        n = add_case(cases, n, op, "utf8_2k", gen_utf8(SB_LONG, pad));
+    }
+
+    n = add_case(cases, n, OP_IS_UTF8, "ascii_32", gen_ascii(SB_SHORT, ""));
+    n = add_case(cases, n, OP_IS_UTF8, "ascii_2k", gen_ascii(SB_LONG, ""));
+    n = add_case(cases, n, OP_IS_UTF8, "utf8_32", gen_utf8(SB_SHORT, ""));
+    n = add_case(cases, n, OP_IS_UTF8, "utf8_2k", gen_utf8(SB_LONG, ""));
+
+    for (i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        n = add_case(cases, n, OP_STR2UINT64, numbers[i].name,
+                     strdup(numbers[i].value));
+
+        if (NULL == strpbrk(numbers[i].value, "Kw")) {
+            n = add_case(cases, n, OP_IS_UINT_N_RANGE, numbers[i].name,
+                         strdup(numbers[i].value));
+        }
+    }
+
+    n = add_case(cases, n, OP_MEMCPY, "list_32", gen_list(SB_SHORT));
+    n = add_case(cases, n, OP_MEMCPY, "list_2k", gen_list(SB_LONG));
+    n = add_case(cases, n, OP_TRIM_STR_LIST, "list_32", gen_list(SB_SHORT));
+    n = add_case(cases, n, OP_TRIM_STR_LIST, "list_2k", gen_list(SB_LONG));
+
+    n = add_case(cases, n, OP_DSPRINTF, "path_32",
+                 strdup("/etc/cconf/conf.d/parameter.conf"));
+    n = add_case(cases, n, OP_DSPRINTF, "ascii_2k", gen_ascii(SB_LONG, ""));
+    n = add_case(cases, n, OP_BUF_PRINTF, "path_32",
+                 strdup("/etc/cconf/conf.d/parameter.conf"));
+    n = add_case(cases, n, OP_BUF_PRINTF, "ascii_2k", gen_ascii(SB_LONG, ""));
+
+    return n;
+}
+
+/**
+ * Run one call of a case
+ */
+static uint64_t
+run_op(struct sb_case *c)
+{
+    uint64_t value = 0;
+
+    switch (c->op) {
+    case OP_MEMCPY:
+        memcpy(c->work, c->data, c->len + 1);
+        return (unsigned char)c->work[c->len / 2];
+    case OP_LTRIM:
+        memcpy(c->work, c->data, c->len + 1);
+        str_ltrim(c->work, " \t");
+        return (unsigned char)c->work[0];
+    case OP_RTRIM:
+        memcpy(c->work, c->data, c->len + 1);
+        return (uint64_t)str_rtrim(c->work, " \t");
+    case OP_IS_UTF8:
+        return (uint64_t)str_is_utf8(c->data);
+    case OP_STR2UINT64:
+        (void)str2uint64(c->data, "KMGTsmhdw", &value);
+        return value;
+    case OP_IS_UINT_N_RANGE:
+        (void)is_uint_n_range(c->data, c->len, &value, sizeof(value), 0,
+                              UINT64_MAX);
+        return value;
+    case OP_TRIM_STR_LIST:
+        memcpy(c->work, c->data, c->len + 1);
+        str_trim_str_list(c->work, ',');
+        return (unsigned char)c->work[0];
+    case OP_DSPRINTF:
+        c->dest = str_dsprintf(c->dest, "%s/%s", "/etc/cconf", c->data);
+        return (unsigned char)c->dest[0];
+    case OP_BUF_PRINTF:
+        str_buf_reset(&c->sb);
+        (void)str_buf_printf(&c->sb, "%s/%s", "/etc/cconf", c->data);
+        return (unsigned char)c->sb.data[0];
+    default:
+        return 0;
+    }
+}
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t
+read_tsc(void)
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Open a group of hardware counters for the calling thread
+ *
+ * @return
+ *   group leader fd or -1 if counters are not available
+ */
+static int
+perf_open(int *fds)
+{
+    static const uint64_t configs[] = {PERF_COUNT_HW_CPU_CYCLES,
+                                       PERF_COUNT_HW_INSTRUCTIONS,
+                                       PERF_COUNT_HW_BRANCH_MISSES};
+    struct perf_event_attr attr;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.disabled = 0 == i ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+
+        fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1,
+                              0 == i ? -1 : fds[0], 0);
+
+        if (-1 == fds[i]) {
+            fprintf(stderr, "perf_event_open: %s, using the time stamp "
+                    "counter\n", strerror(errno));
+
+            while (0 < i--)
+                close(fds[i]);
+
+            return -1;
+        }
+    }
+
+    return fds[0];
+}
+
+/**
+ * Time a batch of calls
+ *
+ * @return
+ *   nanoseconds taken
+ */
+static uint64_t
+run_batch(struct sb_case *c, uint64_t iters, int perf_fd,
+          struct sb_counters *cnt)
+{
+    uint64_t start, tsc, i, acc = 0, group[4];
+
+    if (-1 != perf_fd) {
+        ioctl(perf_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    start = now_ns();
+    tsc = read_tsc();
+
+    for (i = 0; i < iters; i++)
+        acc += run_op(c);
+
+    tsc = read_tsc() - tsc;
+    start = now_ns() - start;
+
+    memset(cnt, 0, sizeof(*cnt));
+    cnt->cycles = tsc;
+
+    if (-1 != perf_fd) {
+        ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        /* number of counters followed by their values */
+        if ((ssize_t)sizeof(group) == read(perf_fd, group, sizeof(group))) {
+            cnt->cycles = group[1];
+            cnt->instructions = group[2];
+            cnt->branch_misses = group[3];
+        }
+    }
+
+    sink += acc;
+
+    return start;
+}
+
+static void
+bench_case(const struct sb_opts *o, struct sb_case *c, int perf_fd)
+{
+    struct sb_counters cnt, best_cnt;
+    uint64_t iters = 1, ns, best = 0;
+    double per_op, bytes;
+    int r;
+
+    /* find a batch size that takes at least min_ms */
+    while (1) {
+        ns = run_batch(c, iters, -1, &cnt);
+
+        if (ns >= (uint64_t)o->min_ms * 1000000u || iters >= (1ull << 40))
+            break;
+
+        iters *= 0 == ns ? 16 : ns * 2 < (uint64_t)o->min_ms * 1000000u ?
+            4 : 2;
+    }
+
+    memset(&best_cnt, 0, sizeof(best_cnt));
+
+    for (r = 0; r < o->reps; r++) {
+        ns = run_batch(c, iters, perf_fd, &cnt);
+
+        if (0 == best || ns < best) {
+            best = ns;
+            best_cnt = cnt;
+        }
+    }
+
+    per_op = (double)best / (double)iters;
+    bytes = (double)(0 == c->len ? 1 : c->len) * (double)iters;
+
+    if (0 == o->json) {
+        printf("%-18s %-10s %6zu B %10.2f ns/op %8.3f cycles/B",
+               op_names[c->op], c->input, c->len, per_op,
+               (double)best_cnt.cycles / bytes);
+
+        if (-1 != perf_fd) {
+            printf(" %6.2f IPC %8.4f br-miss/op",
+                   0 == best_cnt.cycles ? 0.0 :
+                   (double)best_cnt.instructions / (double)best_cnt.cycles,
+                   (double)best_cnt.branch_misses / (double)iters);
+        }
+
+        printf("\n");
+        return;
+    }
+
+    printf("{\"func\":\"%s\",\"input\":\"%s\",\"bytes\":%zu,\"iters\":%llu,"
+           "\"ns_per_op\":%.3f,\"cycles_per_byte\":%.4f,\"cycle_source\":"
+           "\"%s\"", op_names[c->op], c->input, c->len,
+           (unsigned long long)iters, per_op, (double)best_cnt.cycles / bytes,
+           -1 != perf_fd ? "perf" : "tsc");
+
+    if (-1 != perf_fd) {
+        printf(",\"instructions_per_op\":%.2f,\"branch_misses_per_op\":%.4f",
+               (double)best_cnt.instructions / (double)iters,
+               (double)best_cnt.branch_misses / (double)iters);
+    }
+
+    printf("}\n");
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --filter TEXT  only run cases whose function or input "
+            "contains TEXT\n"
+            "  --min-ms N     minimum batch duration (20)\n"
+            "  --reps N       batches per case, the fastest is reported (5)\n"
+            "  --perf         read hardware counters with perf_event_open\n"
+            "  --json         one JSON object per case\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_opts[] = {
+        {"filter", required_argument, NULL, 'f'},
+        {"min-ms", required_argument, NULL, 'm'},
+        {"reps", required_argument, NULL, 'r'},
+        {"perf", no_argument, NULL, 'p'},
+        {"json", no_argument, NULL, 'j'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    struct sb_opts o = {NULL, 20, 5, 0, 0};
+    struct sb_case cases[64];
+    int fds[3], perf_fd = -1, n, i, c;
+
+    while (-1 != (c = getopt_long(argc, argv, "", long_opts, NULL))) {
+        switch (c) {
+        case 'f': o.filter = optarg; break;
+        case 'm': o.min_ms = atoi(optarg); break;
+        case 'r': o.reps = atoi(optarg); break;
+        case 'p': o.perf = 1; break;
+        case 'j': o.json = 1; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (1 > o.min_ms || 1 > o.reps) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+#ifndef HAVE_TSC
+    if (0 == o.perf)
+        fprintf(stderr, "no time stamp counter, use --perf for cycles\n");
+#endif
+
+    if (0 != o.perf)
+        perf_fd = perf_open(fds);
+
+    n = build_cases(cases);
+
+    for (i = 0; i < n; i++) {
+        if (NULL != o.filter && NULL == strstr(op_names[cases[i].op], o.filter)
+            && NULL == strstr(cases[i].input, o.filter))
+            continue;
+
+        bench_case(&o, &cases[i], perf_fd);
+    }
+
+    for (i = 0; i < n; i++) {
+        free(cases[i].data);
+        free(cases[i].work);
+        free(cases[i].dest);
+        str_buf_free(&cases[i].sb);
+    }
+
+    if (-1 != perf_fd) {
+        for (i = 2; i >= 0; i--)
+            close(fds[i]);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -68,5 +68,8 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char *argv[])
     fprintf(stderr, "test_int      : %ld\n", CONFIG_INT);
     fprintf(stderr, "test_uint64   : %lu\n", CONFIG_UINT64);
     print_multi_str("test_mul_str  ", CONFIG_MUL_STR);
+
+    /* multistrings must not be passed to free() */
+    str_strarr_free(CONFIG_MUL_STR);
     return 0;
 }
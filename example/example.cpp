@@ -0,0 +1,58 @@
+/*
+ * Copyleft
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "cfg.hpp"
+
+/* test config file */
+#define CONFIG_FILE "../conf/example.conf"
+
+/* Test variables */
+struct config {
+    int                 test_int = 0;
+    uint64_t            test_uint64 = 0;
+    std::string_view    test_str;
+    cconf::string_list  test_str_list;
+    cconf::multistring  test_mul_str;
+};
+
+static constexpr auto schema = cconf::make_schema(
+    cconf::param("test_int", &config::test_int, PARM_MAND, 0, 100),
+    cconf::param("test_str", &config::test_str),
+    cconf::param("test_str_list", &config::test_str_list),
+    cconf::param("test_mul_str", &config::test_mul_str),
+    cconf::param("test_uint64", &config::test_uint64, PARM_OPT, 0,
+                 12121212121));
+
+static_assert(-1 != schema.find("test_uint64"), "parameter is declared");
+static_assert(-1 == schema.find("test_float"), "parameter is not declared");
+
+static void
+print_str(const char *key, std::string_view value)
+{
+    fprintf(stderr, "%s: %.*s\n", key, (int)value.size(), value.data());
+}
+
+int main()
+{
+    config          cfg;
+    cconf::result   res;
+
+    if (FAIL == schema.parse(CONFIG_FILE, cfg, res, CFG_FILE_REQUIRED,
+                             CFG_STRICT)) {
+        fprintf(stderr, "load config failed\n");
+        exit(1);
+    }
+
+    print_str(      "test_str      ", cfg.test_str);
+    for (std::string_view item : cfg.test_str_list)
+        print_str(  "test_str_list ", item);
+    fprintf(stderr, "test_int      : %d\n", cfg.test_int);
+    fprintf(stderr, "test_uint64   : %lu\n", cfg.test_uint64);
+    for (std::string_view value : cfg.test_mul_str)
+        print_str(  "test_mul_str  ", value);
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyleft
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN         (sizeof(void *) > sizeof(uint64_t) ?       \
+                             sizeof(void *) : sizeof(uint64_t))
+#define ARENA_ROUND(n)      (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct arena_block {
+    struct arena_block *prev;
+    size_t              size;
+    size_t              used;
+    /* keep data aligned for any type */
+    uint64_t            data[];
+};
+
+struct arena *
+arena_create(void)
+{
+    struct arena *a;
+
+    if (NULL == (a = malloc(sizeof(*a))))
+        return NULL;
+
+    memset(a, 0, sizeof(*a));
+    a->next_size = ARENA_MIN_BLOCK;
+
+    return a;
+}
+
+static struct arena_block *
+arena_block_new(size_t size)
+{
+    struct arena_block *b;
+
+    if (NULL == (b = malloc(sizeof(*b) + size)))
+        return NULL;
+
+    b->prev = NULL;
+    b->size = size;
+    b->used = 0;
+
+    return b;
+}
+
+void *
+arena_alloc(struct arena *a, size_t size)
+{
+    struct arena_block *b = a->head;
+    void *p;
+
+    size = ARENA_ROUND(size);
+
+    if (NULL == b || b->size - b->used < size) {
+        if (size > a->next_size / 2) {
+            /* large chunk gets a block of its own which is put behind the
+               current one, so the free space left there can still be used */
+            if (NULL == (b = arena_block_new(size)))
+                return NULL;
+
+            b->used = size;
+
+            if (NULL == a->head) {
+                a->head = b;
+            } else {
+                b->prev = a->head->prev;
+                a->head->prev = b;
+            }
+
+            a->allocs++;
+            a->bytes += size;
+
+            return b->data;
+        }
+
+        if (NULL == (b = arena_block_new(a->next_size)))
+            return NULL;
+
+        b->prev = a->head;
+        a->head = b;
+
+        if (ARENA_MAX_BLOCK > a->next_size)
+            a->next_size *= 2;
+    }
+
+    p = (char *)b->data + b->used;
+    b->used += size;
+
+    a->allocs++;
+    a->bytes += size;
+
+    return p;
+}
+
+char *
+arena_strndup(struct arena *a, const char *str, size_t n)
+{
+    char *tmp;
+
+    if (NULL == (tmp = arena_alloc(a, n + 1)))
+        return NULL;
+
+    memcpy(tmp, str, n);
+    tmp[n] = '\0';
+
+    return tmp;
+}
+
+void
+arena_destroy(struct arena *a)
+{
+    struct arena_block *b, *prev;
+
+    if (NULL == a)
+        return;
+
+    for (b = a->head; NULL != b; b = prev) {
+        prev = b->prev;
+        free(b);
+    }
+
+    free(a);
+}
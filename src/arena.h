@@ -0,0 +1,64 @@
+/*
+ * Copyleft
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* first block size, following blocks double up to ARENA_MAX_BLOCK */
+#define ARENA_MIN_BLOCK     4096
+#define ARENA_MAX_BLOCK     (1024 * 1024)
+
+struct arena_block;
+
+/**
+ * Bump allocator, memory is only released all at once by arena_destroy()
+ */
+struct arena {
+    struct arena_block *head;
+    size_t              next_size;
+    size_t              allocs;     /* number of arena_alloc() calls */
+    size_t              bytes;      /* bytes handed out by arena_alloc() */
+};
+
+/**
+ * Create an empty arena, use arena_destroy() to free it.
+ *
+ * @return
+ *   a new arena or NULL if out of memory
+ */
+struct arena *
+arena_create(void);
+
+/**
+ * Allocate memory aligned for pointers and 64bit integers
+ *
+ * @param a
+ *   [IN] arena to allocate from
+ * @param size
+ *   [IN] number of bytes
+ *
+ * @return
+ *   pointer to allocated memory or NULL if out of memory
+ */
+void *
+arena_alloc(struct arena *a, size_t size);
+
+/**
+ * Copy at most n bytes of a string into the arena and null terminate it
+ *
+ * @return
+ *   pointer to the copy or NULL if out of memory
+ */
+char *
+arena_strndup(struct arena *a, const char *str, size_t n);
+
+/**
+ * Release all memory allocated from the arena and the arena itself
+ */
+void
+arena_destroy(struct arena *a);
+
+#endif /* ARENA_H */
@@ -0,0 +1,546 @@
+/*
+ * Copyleft
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "result.h"
+#include "str.h"
+#include "cfg.h"
+#include "cache.h"
+
+/*
+ * Image layout, all in host byte order:
+ *
+ *   struct cache_header
+ *   struct cache_source[nsources]
+ *   struct cache_value[nvalues]
+ *   string pool, null terminated strings referred to by pool offsets
+ */
+
+#define CACHE_MAGIC         "CCONFIMG"
+#define CACHE_BYTE_ORDER    0x01020304u
+
+struct cache_header {
+    char        magic[8];
+    uint32_t    byte_order;
+    uint32_t    version;
+    uint64_t    schema;     /* hash of file name, options and table */
+    uint64_t    checksum;   /* hash of everything after the header */
+    uint64_t    size;       /* of the whole image */
+    uint32_t    nsources;
+    uint32_t    nvalues;
+    uint64_t    strings;    /* offset of the string pool */
+};
+
+/* source kinds */
+#define CACHE_FILE      0
+#define CACHE_DIR       1
+#define CACHE_ABSENT    2
+
+/* a file or directory visited by the parse */
+struct cache_source {
+    uint64_t    dev;
+    uint64_t    ino;
+    uint64_t    size;
+    int64_t     mtime_sec;
+    int64_t     mtime_nsec;
+    uint32_t    kind;
+    uint32_t    path;       /* pool offset */
+};
+
+/* a value stored by the parse, one per multistring entry */
+struct cache_value {
+    uint32_t    index;      /* cfg[] offset */
+    uint32_t    type;
+    uint64_t    value;      /* number or pool offset */
+};
+
+/* growable byte buffer an image is assembled in */
+struct cache_buf {
+    char       *data;
+    size_t      len;
+    size_t      alloc;
+};
+
+/* cache_load() result when there is no usable image */
+#define CACHE_MISS      1
+
+/* sources modified this close to the parse may have changed during it */
+#define CACHE_RACY_SEC  2
+
+/**
+ * FNV-1a 64 bit hash, continued from h
+ */
+static uint64_t
+cache_hash(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    while (0 < len--) {
+        h ^= *p++;
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
+
+#define CACHE_HASH_INIT     14695981039346656037ull
+
+/**
+ * Hash everything a cached image depends on besides the visited files
+ */
+static uint64_t
+cache_schema(const char *cfg_file, const struct cfg_line *cfg, int optional,
+             int strict)
+{
+    uint64_t h = CACHE_HASH_INIT;
+    uint32_t v[4];
+    int i;
+
+    v[0] = CFG_CACHE_VERSION;
+    v[1] = (uint32_t)optional;
+    v[2] = (uint32_t)strict;
+    v[3] = (uint32_t)sizeof(int);
+
+    h = cache_hash(h, v, sizeof(v));
+    h = cache_hash(h, cfg_file, strlen(cfg_file) + 1);
+
+    for (i = 0; NULL != cfg[i].parameter; i++) {
+        h = cache_hash(h, cfg[i].parameter, strlen(cfg[i].parameter) + 1);
+        v[0] = (uint32_t)cfg[i].type;
+        v[1] = (uint32_t)cfg[i].mandatory;
+        h = cache_hash(h, v, 2 * sizeof(*v));
+        h = cache_hash(h, &cfg[i].min, sizeof(cfg[i].min));
+        h = cache_hash(h, &cfg[i].max, sizeof(cfg[i].max));
+    }
+
+    return h;
+}
+
+/**
+ * Describe a file or directory as it is now
+ */
+static void
+cache_source_stat(struct cache_source *src, const char *path, uint32_t kind)
+{
+    struct stat sb;
+
+    memset(src, 0, sizeof(*src));
+
+    if (0 != stat(path, &sb)) {
+        src->kind = CACHE_ABSENT;
+        return;
+    }
+
+    src->kind = kind;
+    src->dev = (uint64_t)sb.st_dev;
+    src->ino = (uint64_t)sb.st_ino;
+    src->size = (uint64_t)sb.st_size;
+    src->mtime_sec = (int64_t)sb.st_mtim.tv_sec;
+    src->mtime_nsec = (int64_t)sb.st_mtim.tv_nsec;
+}
+
+/**
+ * Load and validate a cache image, then store its values
+ *
+ * @return
+ *   SUCCEED - values are stored, result maps the image
+ *   CACHE_MISS - no usable image, nothing was stored
+ *   FAIL - out of memory after some values were stored, result is set
+ */
+static int
+cache_load(const char *cache_file, uint64_t schema, struct cfg_line *cfg,
+           struct cfg_result **result)
+{
+    const struct cache_header *hdr;
+    const struct cache_source *src;
+    const struct cache_value *val;
+    struct cache_source now;
+    struct stat sb;
+    size_t n, i, pool;
+    char *image = MAP_FAILED;
+    int fd;
+
+    if (-1 == (fd = open(cache_file, O_RDONLY | O_CLOEXEC)))
+        return CACHE_MISS;
+
+    if (0 != fstat(fd, &sb) || (size_t)sb.st_size < sizeof(*hdr) ||
+        MAP_FAILED == (image = mmap(NULL, (size_t)sb.st_size,
+                                    PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                                    0))) {
+        close(fd);
+        return CACHE_MISS;
+    }
+
+    close(fd);
+
+    hdr = (const struct cache_header *)(void *)image;
+
+    if (0 != memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) ||
+        CACHE_BYTE_ORDER != hdr->byte_order ||
+        CFG_CACHE_VERSION != hdr->version || schema != hdr->schema ||
+        (uint64_t)sb.st_size != hdr->size)
+        goto fail;
+
+    if (hdr->strings != sizeof(*hdr) + hdr->nsources * sizeof(*src) +
+        hdr->nvalues * sizeof(*val) || hdr->strings >= hdr->size ||
+        '\0' != image[hdr->size - 1])
+        goto fail;
+
+    if (hdr->checksum != cache_hash(CACHE_HASH_INIT, image + sizeof(*hdr),
+                                    hdr->size - sizeof(*hdr)))
+        goto fail;
+
+    pool = hdr->size - hdr->strings;
+    src = (const struct cache_source *)(const void *)(image + sizeof(*hdr));
+    val = (const struct cache_value *)(const void *)(src + hdr->nsources);
+
+    for (n = 0; NULL != cfg[n].parameter; n++)
+        ;
+
+    /* check everything before storing anything */
+    for (i = 0; i < hdr->nvalues; i++) {
+        if (val[i].index >= n || (uint32_t)cfg[val[i].index].type != val[i].type)
+            goto fail;
+
+        if (TYPE_INT != val[i].type && TYPE_UINT64 != val[i].type &&
+            val[i].value >= pool)
+            goto fail;
+    }
+
+    for (i = 0; i < hdr->nsources; i++) {
+        if (src[i].path >= pool)
+            goto fail;
+
+        cache_source_stat(&now, image + hdr->strings + src[i].path,
+                          src[i].kind);
+
+        if (now.kind != src[i].kind || now.dev != src[i].dev ||
+            now.ino != src[i].ino || now.size != src[i].size ||
+            now.mtime_sec != src[i].mtime_sec ||
+            now.mtime_nsec != src[i].mtime_nsec)
+            goto fail;
+    }
+
+    if (NULL == (*result = cfg_result_create()))
+        goto fail;
+
+    (*result)->image = image;
+    (*result)->image_size = (size_t)sb.st_size;
+
+    for (i = 0; i < hdr->nsources; i++) {
+        if (SUCCEED != str_strarr_add(CACHE_DIR == src[i].kind ?
+                                      &(*result)->dirs : &(*result)->files,
+                                      image + hdr->strings + src[i].path)) {
+            cfg_free(*result);
+            *result = NULL;
+            return CACHE_MISS;
+        }
+    }
+
+    for (i = 0; i < hdr->nvalues; i++) {
+        switch (val[i].type) {
+        case TYPE_INT:
+            *((int *)cfg[val[i].index].variable) = (int)val[i].value;
+            break;
+        case TYPE_UINT64:
+            *((uint64_t *)cfg[val[i].index].variable) = val[i].value;
+            break;
+        case TYPE_STRING:
+        case TYPE_STRING_LIST:
+            *((char **)cfg[val[i].index].variable) = image + hdr->strings +
+                val[i].value;
+            break;
+        case TYPE_MULTISTRING:
+            if (SUCCEED != str_strarr_append(cfg[val[i].index].variable,
+                                             image + hdr->strings +
+                                             val[i].value)) {
+                /* values stored so far point into the image of result */
+                LOG_ERR("cannot load config cache [%s]", cache_file);
+                return FAIL;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return SUCCEED;
+fail:
+    munmap(image, (size_t)sb.st_size);
+
+    return CACHE_MISS;
+}
+
+/**
+ * Append bytes to an image buffer
+ *
+ * @return
+ *   offset of the bytes or (size_t)-1 if out of memory
+ */
+static size_t
+cache_buf_add(struct cache_buf *buf, const void *data, size_t len)
+{
+    size_t off = buf->len;
+    char *tmp;
+
+    if (buf->alloc - buf->len < len) {
+        if (0 == buf->alloc)
+            buf->alloc = 4096;
+
+        while (buf->alloc - buf->len < len)
+            buf->alloc *= 2;
+
+        if (NULL == (tmp = realloc(buf->data, buf->alloc)))
+            return (size_t)-1;
+
+        buf->data = tmp;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+
+    return off;
+}
+
+/**
+ * Add a source record for every file and directory of a parse result
+ *
+ * @return
+ *   SUCCEED - sources are added
+ *   FAIL - out of memory or a source changed too recently to be trusted
+ */
+static int
+cache_add_sources(struct cache_buf *recs, struct cache_buf *pool,
+                  char **paths, uint32_t kind, time_t start, uint32_t *count)
+{
+    struct cache_source src;
+    size_t off;
+
+    for (; NULL != *paths; paths++) {
+        cache_source_stat(&src, *paths, kind);
+
+        /* a change within timestamp granularity of the parse may be lost */
+        if (CACHE_ABSENT != src.kind &&
+            src.mtime_sec > (int64_t)start - CACHE_RACY_SEC)
+            return FAIL;
+
+        if ((size_t)-1 == (off = cache_buf_add(pool, *paths,
+                                               strlen(*paths) + 1)))
+            return FAIL;
+
+        src.path = (uint32_t)off;
+
+        if ((size_t)-1 == cache_buf_add(recs, &src, sizeof(src)))
+            return FAIL;
+
+        (*count)++;
+    }
+
+    return SUCCEED;
+}
+
+/**
+ * Add a value record pointing at a copy of a string
+ */
+static int
+cache_add_string(struct cache_buf *recs, struct cache_buf *pool,
+                 struct cache_value *val, const char *str)
+{
+    size_t off;
+
+    if ((size_t)-1 == (off = cache_buf_add(pool, str, strlen(str) + 1)))
+        return FAIL;
+
+    val->value = off;
+
+    return (size_t)-1 == cache_buf_add(recs, val, sizeof(*val)) ? FAIL :
+        SUCCEED;
+}
+
+/**
+ * Write image of the values a parse has stored
+ *
+ * @param counts
+ *   [IN] entries of each TYPE_MULTISTRING before parsing, the parse appends
+ *   to them
+ *
+ * @return
+ *   SUCCEED - image was written
+ *   FAIL - otherwise
+ */
+static int
+cache_save(const char *cache_file, uint64_t schema,
+           const struct cfg_line *cfg, const size_t *counts,
+           const struct cfg_result *result, time_t start)
+{
+    struct cache_header hdr;
+    struct cache_buf srcs = {NULL, 0, 0}, vals = {NULL, 0, 0};
+    struct cache_buf pool = {NULL, 0, 0};
+    struct cache_value val;
+    char *tmp = NULL, **arr;
+    size_t k, n;
+    ssize_t w;
+    int i, fd = -1, ret = FAIL;
+
+    memset(&hdr, 0, sizeof(hdr));
+
+    if (SUCCEED != cache_add_sources(&srcs, &pool, result->files, CACHE_FILE,
+                                     start, &hdr.nsources) ||
+        SUCCEED != cache_add_sources(&srcs, &pool, result->dirs, CACHE_DIR,
+                                     start, &hdr.nsources))
+        goto out;
+
+    for (i = 0; NULL != cfg[i].parameter; i++) {
+        memset(&val, 0, sizeof(val));
+        val.index = (uint32_t)i;
+        val.type = (uint32_t)cfg[i].type;
+
+        /* a value equal to the default must still override it on load */
+        if (TYPE_MULTISTRING != cfg[i].type && 0 == result->assigned[i])
+            continue;
+
+        switch (cfg[i].type) {
+        case TYPE_INT:
+            val.value = (uint64_t)*((int *)cfg[i].variable);
+            if ((size_t)-1 == cache_buf_add(&vals, &val, sizeof(val)))
+                goto out;
+            hdr.nvalues++;
+            break;
+        case TYPE_UINT64:
+            val.value = *((uint64_t *)cfg[i].variable);
+            if ((size_t)-1 == cache_buf_add(&vals, &val, sizeof(val)))
+                goto out;
+            hdr.nvalues++;
+            break;
+        case TYPE_STRING:
+        case TYPE_STRING_LIST:
+            if (SUCCEED != cache_add_string(&vals, &pool, &val,
+                                            *((char **)cfg[i].variable)))
+                goto out;
+            hdr.nvalues++;
+            break;
+        case TYPE_MULTISTRING:
+            arr = *((char ***)cfg[i].variable);
+            n = str_strarr_count(arr);
+
+            for (k = counts[i]; k < n; k++) {
+                if (SUCCEED != cache_add_string(&vals, &pool, &val, arr[k]))
+                    goto out;
+                hdr.nvalues++;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* the pool must be followed by at least its terminating null */
+    if (0 == pool.len && (size_t)-1 == cache_buf_add(&pool, "", 1))
+        goto out;
+
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = CACHE_BYTE_ORDER;
+    hdr.version = CFG_CACHE_VERSION;
+    hdr.schema = schema;
+    hdr.strings = sizeof(hdr) + srcs.len + vals.len;
+    hdr.size = hdr.strings + pool.len;
+    hdr.checksum = cache_hash(CACHE_HASH_INIT, srcs.data, srcs.len);
+    hdr.checksum = cache_hash(hdr.checksum, vals.data, vals.len);
+    hdr.checksum = cache_hash(hdr.checksum, pool.data, pool.len);
+
+    if (NULL == (tmp = str_dsprintf(NULL, "%s.%d.tmp", cache_file,
+                                    (int)getpid())))
+        goto out;
+
+    if (-1 == (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                         0600))) {
+        LOG_ERR("cannot create config cache [%s]: %s", tmp, strerror(errno));
+        goto out;
+    }
+
+    if ((ssize_t)sizeof(hdr) != (w = write(fd, &hdr, sizeof(hdr))) ||
+        (ssize_t)srcs.len != (w = write(fd, srcs.data, srcs.len)) ||
+        (ssize_t)vals.len != (w = write(fd, vals.data, vals.len)) ||
+        (ssize_t)pool.len != (w = write(fd, pool.data, pool.len))) {
+        LOG_ERR("cannot write config cache [%s]: %s", tmp,
+                -1 == w ? strerror(errno) : "short write");
+        goto out;
+    }
+
+    if (0 != close(fd)) {
+        fd = -1;
+        LOG_ERR("cannot write config cache [%s]: %s", tmp, strerror(errno));
+        goto out;
+    }
+    fd = -1;
+
+    if (0 != rename(tmp, cache_file)) {
+        LOG_ERR("cannot rename config cache [%s]: %s", tmp, strerror(errno));
+        goto out;
+    }
+
+    ret = SUCCEED;
+out:
+    if (-1 != fd)
+        close(fd);
+
+    if (SUCCEED != ret && NULL != tmp)
+        unlink(tmp);
+
+    free(tmp);
+    free(srcs.data);
+    free(vals.data);
+    free(pool.data);
+
+    return ret;
+}
+
+int parse_cfg_file_cached(const char *cfg_file, const char *cache_file,
+                          struct cfg_line *cfg, int optional, int strict,
+                          struct cfg_result **result)
+{
+    size_t *counts;
+    uint64_t schema;
+    time_t start;
+    size_t n;
+    int i, ret;
+
+    schema = cache_schema(cfg_file, cfg, optional, strict);
+
+    if (CACHE_MISS != (ret = cache_load(cache_file, schema, cfg, result)))
+        return ret;
+
+    for (n = 0; NULL != cfg[n].parameter; n++)
+        ;
+
+    if (NULL == (counts = calloc(n + 1, sizeof(*counts))))
+        return parse_cfg_file_ex(cfg_file, cfg, optional, strict, result);
+
+    for (i = 0; NULL != cfg[i].parameter; i++) {
+        if (TYPE_MULTISTRING == cfg[i].type)
+            counts[i] = str_strarr_count(*((char ***)cfg[i].variable));
+    }
+
+    start = time(NULL);
+
+    if (SUCCEED == (ret = parse_cfg_file_ex(cfg_file, cfg, optional, strict,
+                                            result)))
+        (void)cache_save(cache_file, schema, cfg, counts, *result, start);
+
+    free(counts);
+
+    return ret;
+}
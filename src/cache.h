@@ -0,0 +1,48 @@
+/*
+ * Copyleft
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "cfg.h"
+
+/* format version of cache images, bump on any change of what they hold */
+#define CFG_CACHE_VERSION   3
+
+/**
+ * Parse configuration file through a binary cache of its last parse
+ *
+ * The cache image holds the values a successful parse stored into the
+ * variables of cfg, together with the path, inode, size and modification
+ * time of every file and directory the parse visited.  When the image was
+ * written for the same table and options and none of those inputs changed,
+ * the values are taken from the mapped image without reading any config
+ * file.  Otherwise the file is parsed and the image is written again.
+ *
+ * @param cfg_file
+ *   [IN] full name of config file
+ * @param cache_file
+ *   [IN] full name of cache image, it is replaced atomically
+ * @param cfg
+ *   [IN] pointer to configuration parameter structure
+ * @param optional
+ *   [IN] do not treat missing configuration file as error
+ * @param strict
+ *   [IN] treat unknown parameters as error
+ * @param result
+ *   [OUT] parse result as of parse_cfg_file_ex(), when the cache is used
+ *   string values point into the image mapped by the result
+ *
+ * @return
+ *  SUCCEED - parsed successfully or loaded from cache
+ *  FAIL - error processing config file
+ *
+ * @comments
+ *   Failing to write the cache image is not an error.
+ */
+int parse_cfg_file_cached(const char *cfg_file, const char *cache_file,
+                          struct cfg_line *cfg, int optional, int strict,
+                          struct cfg_result **result);
+
+#endif /* CACHE_H */
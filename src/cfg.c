@@ -2,16 +2,32 @@
  * Copyleft
  */
 
+#define _GNU_SOURCE
+
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "kv.h"
+#include "pattern.h"
+#include "result.h"
+#include "scan.h"
 #include "str.h"
 #include "cfg.h"
+#ifdef HAVE_IO_URING
+#   include "uring.h"
+#endif
 
 char *CONFIG_FILE           = NULL;
 char *CONFIG_LOG_FILE       = NULL;
@@ -20,77 +36,485 @@ int CONFIG_LOG_FILE_SIZE    = 1;
 int CONFIG_ALLOW_ROOT       = 0;
 int CONFIG_TIMEOUT          = 3;
 
-static int __parse_cfg_file(const char *cfg_file, struct cfg_line *cfg,
-                            int level, int optional, int strict);
+/* how files of included directories are read, see cfg_set_io() */
+static int cfg_io           = CFG_IO_URING;
+
+/* open addressing index over the parameter names of a cfg_line table */
+struct cfg_index {
+    size_t       mask;
+    int         *slots;     /* cfg[] offset + 1, 0 means empty slot */
+    uint32_t    *hashes;    /* hash of the parameter in the slot */
+    int         *next;      /* next cfg[] entry with the same name or -1 */
+};
+
+/* state shared by a top-level parse and all files it includes */
+struct cfg_ctx {
+    struct cfg_line    *cfg;
+    struct cfg_index    index;
+    int                 strict;
+    struct arena       *arena;      /* string values, NULL to use malloc() */
+    struct cfg_result  *result;     /* NULL for parse_cfg_file() */
+    struct cfg_stats   *stats;      /* NULL unless statistics are wanted */
+    struct cfg_lazy    *lazy;       /* record values instead of converting */
+    struct cfg_kv      *kv;         /* store of all parameters or NULL */
+    const char         *section;    /* of the file being applied */
+    size_t              section_len;
+    struct str_buf      key;        /* section and parameter name */
+    struct cfg_frags   *frags;      /* files read so far */
+};
+
+/* contents of a configuration file, either mapped or read into memory */
+struct cfg_buf {
+    char       *data;
+    size_t      size;
+    size_t      map_size;   /* the data can end before the mapping */
+    int         mapped;
+};
+
+/* cfg_frag_load() result when the file cannot be opened */
+#define CFG_NO_FILE         2
+
+/*
+ * Configuration file read once per parse, it is replayed from its tokens
+ * wherever it is included again
+ */
+struct cfg_frag {
+    dev_t               dev;
+    ino_t               ino;
+    struct cfg_buf      buf;        /* the tokens point into it */
+    struct cfg_token   *tokens;
+    size_t              count;
+    int                 scan_rc;    /* SCAN_EOF or why tokenizing stopped */
+    struct cfg_token    error;      /* line that could not be tokenized */
+    struct cfg_scanner  scanner;    /* line counts after tokenizing */
+    uint64_t            scan_ns;    /* reading and tokenizing, if timed */
+    int                 active;     /* being applied, including it is a cycle */
+    uint64_t            applied;    /* times applied so far */
+};
+
+/*
+ * Files of a parse by device and inode, open addressing table looked up
+ * by the threads tokenizing included directories
+ */
+struct cfg_frags {
+    struct cfg_frag   **slots;
+    size_t              mask;
+    size_t              count;
+    size_t              kept;       /* tokens of files applied once */
+    pthread_mutex_t     lock;
+};
+
+/* initial number of slots, the table is kept at most half full */
+#define CFG_FRAGS_MIN_SLOTS     16
+
+/*
+ * Tokens of files applied once are kept up to this many in total, most
+ * files are included only once and holding on to their tokens costs more
+ * than tokenizing a mapped file again
+ */
+#define CFG_FRAGS_KEEP_TOKENS   16384
+
+/* occurrence of a parameter recorded by a lazy parse */
+struct cfg_lazy_span {
+    struct cfg_token        tok;        /* points into a kept file */
+    const char             *file;       /* recorded name of the file */
+    struct cfg_lazy_span   *next;
+};
+
+/* parameter of a lazy parse, kept for its first cfg[] entry */
+struct cfg_lazy_value {
+    struct cfg_lazy_span   *first;      /* occurrences to convert, in order */
+    struct cfg_lazy_span   *last;
+    int                     state;      /* CFG_LAZY_PENDING, SUCCEED or FAIL */
+};
+
+#define CFG_LAZY_PENDING    1
+
+/* index of a parse_cfg_file_lazy() run, owned by its result */
+struct cfg_lazy {
+    struct cfg_line        *cfg;
+    struct cfg_index        index;
+    struct cfg_lazy_value  *values;     /* one per cfg[] entry */
+    struct cfg_buf         *bufs;       /* files the spans point into */
+    size_t                  nbufs;
+    size_t                  bufs_alloc;
+    int                     status;     /* SUCCEED unless the parse failed */
+};
+
+static int __parse_cfg_file(const char *cfg_file, struct cfg_ctx *ctx,
+                            int level, int optional);
+static int parse_cfg_object(const char *cfg_file, struct cfg_ctx *ctx,
+                            int level);
 
 /**
- * See whether a file (e.g., "parameter.conf") matches a pattern (e.g.,
- * "p*.conf")
+ * Build lookup index for a configuration parameter table
+ *
+ * @param index
+ *   [OUT] index to initialize
+ * @param cfg
+ *   [IN] configuration parameter table terminated by NULL parameter
  *
  * @return
- *   SUCCEED - file matches a pattern
- *   FAIL - otherwise
+ *   SUCCEED - index was built
+ *   FAIL - out of memory
  */
 static int
-match_glob(const char *file, const char *pattern)
+cfg_index_build(struct cfg_index *index, const struct cfg_line *cfg)
 {
-    const char  *f, *g, *p, *q;
+    size_t      size, n, pos;
+    uint32_t    h;
+    int         i, j;
 
-    f = file;
-    p = pattern;
+    for (n = 0; NULL != cfg[n].parameter; n++)
+        ;
 
-    while (1) {
-        /* corner case */
-        if ('\0' == *p)
-            return '\0' == *f ? SUCCEED : FAIL;
+    /* keep load factor at or below 1/2 */
+    for (size = 8; size < n * 2; size <<= 1)
+        ;
 
-        /* find a set of literal characters */
-        while ('*' == *p)
-            p++;
+    index->mask = size - 1;
+    index->slots = calloc(size, sizeof(*index->slots));
+    index->hashes = calloc(size, sizeof(*index->hashes));
+    index->next = malloc((n + 1) * sizeof(*index->next));
 
-        for (q = p; '\0' != *q && '*' != *q; q++)
-            ;
+    if (NULL == index->slots || NULL == index->hashes || NULL == index->next) {
+        LOG_ERR("cannot allocate index for %zu parameters", n);
+        return FAIL;
+    }
 
-        /* if literal characters are at the beginning... */
-        if (pattern == p) {
-            if (0 != strncmp(f, p, q - p))
-                return FAIL;
+    for (i = 0; NULL != cfg[i].parameter; i++) {
+        index->next[i] = -1;
+        h = str_hash_n(cfg[i].parameter, strlen(cfg[i].parameter));
 
-            f += q - p;
-            p = q;
+        for (pos = h & index->mask; 0 != index->slots[pos];
+             pos = (pos + 1) & index->mask) {
 
-            continue;
+            j = index->slots[pos] - 1;
+
+            if (index->hashes[pos] != h ||
+                0 != strcmp(cfg[j].parameter, cfg[i].parameter))
+                continue;
+
+            /* same parameter registered twice, chain it to the last one */
+            while (-1 != index->next[j])
+                j = index->next[j];
+
+            index->next[j] = i;
+            break;
         }
 
-        /* if literal characters are at the end... */
-        if ('\0' == *q) {
-            for (g = f; '\0' != *g; g++)
-                ;
+        if (0 == index->slots[pos]) {
+            index->slots[pos] = i + 1;
+            index->hashes[pos] = h;
+        }
+    }
 
-            if (g - f < q - p)
-                return FAIL;
-            return 0 == strcmp(g - (q - p), p) ? SUCCEED : FAIL;
+    return SUCCEED;
+}
+
+static void
+cfg_index_free(struct cfg_index *index)
+{
+    free(index->slots);
+    free(index->hashes);
+    free(index->next);
+}
+
+/**
+ * Find the first cfg[] entry for a parameter name
+ *
+ * @return
+ *   offset in cfg[] or -1 if the parameter is unknown, further entries with
+ *   the same name are linked through index->next
+ */
+static int
+cfg_index_find(const struct cfg_index *index, const struct cfg_line *cfg,
+               const char *name, size_t len)
+{
+    size_t      pos;
+    uint32_t    h;
+    int         i;
+
+    h = str_hash_n(name, len);
+
+    for (pos = h & index->mask; 0 != index->slots[pos];
+         pos = (pos + 1) & index->mask) {
+
+        i = index->slots[pos] - 1;
+
+        if (index->hashes[pos] == h && 0 == strncmp(cfg[i].parameter, name, len)
+            && '\0' == cfg[i].parameter[len])
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * Copy a parsed value for storing into a configuration variable
+ */
+static char *
+cfg_strndup(struct cfg_ctx *ctx, const char *str, size_t n)
+{
+    if (NULL != ctx->arena)
+        return arena_strndup(ctx->arena, str, n);
+
+    return str_strndup(str, n);
+}
+
+/**
+ * Join a value continued over several lines into storage for configuration
+ * variables, so that strings need no further copy
+ *
+ * @param len
+ *   [OUT] length of the joined value
+ */
+static char *
+cfg_join_value(struct cfg_ctx *ctx, const struct cfg_token *tok, size_t *len)
+{
+    char *copy;
+
+    if (NULL != ctx->arena)
+        copy = arena_alloc(ctx->arena, tok->value_len + 1);
+    else
+        copy = malloc(tok->value_len + 1);
+
+    if (NULL != copy)
+        *len = cfg_scan_value(tok, copy);
+
+    return copy;
+}
+
+/**
+ * Remember a configuration file or included directory in the parse result
+ *
+ * @return
+ *   SUCCEED - recorded or there is no result to record into
+ *   FAIL - out of memory
+ */
+static int
+cfg_record_source(struct cfg_ctx *ctx, const char *path, int is_dir)
+{
+    if (NULL == ctx->result)
+        return SUCCEED;
+
+    if (SUCCEED != str_strarr_add(0 != is_dir ? &ctx->result->dirs :
+                                  &ctx->result->files, path)) {
+        LOG_ERR("cannot record config source [%s]", path);
+        return FAIL;
+    }
+
+    return SUCCEED;
+}
+
+/**
+ * Remember an included directory and the pattern components matching in it
+ *
+ * @return
+ *   SUCCEED - recorded or there is no result to record into
+ *   FAIL - out of memory
+ */
+static int
+cfg_record_dir(struct cfg_ctx *ctx, const char *path,
+               const struct cfg_pattern *pattern, cfg_pattern_set set)
+{
+    struct cfg_result   *r = ctx->result;
+    struct cfg_dir_glob *tmp;
+    size_t               alloc;
+
+    if (NULL == r)
+        return SUCCEED;
+
+    if (r->nglobs == r->globs_alloc) {
+        alloc = 0 == r->globs_alloc ? 16 : r->globs_alloc * 2;
+
+        if (NULL == (tmp = realloc(r->globs, alloc * sizeof(*tmp)))) {
+            LOG_ERR("cannot record config source [%s]", path);
+            return FAIL;
         }
 
-        /* if literal characters are in the middle... */
-        while (1) {
-            if ('\0' == *f)
-                return FAIL;
-            if (0 == strncmp(f, p, q - p)) {
-                f += q - p;
-                p = q;
+        r->globs = tmp;
+        r->globs_alloc = alloc;
+    }
 
-                break;
-            }
+    r->globs[r->nglobs].pattern = pattern;
+    r->globs[r->nglobs].set = set;
+    r->nglobs++;
+
+    return cfg_record_source(ctx, path, 1);
+}
+
+/**
+ * Hand a compiled pattern over to the parse result, so that the globs of
+ * the directories it matches in stay valid as long as the result
+ *
+ * @return
+ *   SUCCEED - the result owns the pattern or there is no result
+ *   FAIL - out of memory, the caller still owns the pattern
+ */
+static int
+cfg_keep_pattern(struct cfg_ctx *ctx, struct cfg_pattern *pattern)
+{
+    struct cfg_result   *r = ctx->result;
+    struct cfg_pattern **tmp;
+    size_t               alloc;
+
+    if (NULL == r)
+        return SUCCEED;
+
+    if (r->npatterns == r->patterns_alloc) {
+        alloc = 0 == r->patterns_alloc ? 4 : r->patterns_alloc * 2;
+
+        if (NULL == (tmp = realloc(r->patterns, alloc * sizeof(*tmp)))) {
+            LOG_ERR("cannot allocate include patterns");
+            return FAIL;
+        }
+
+        r->patterns = tmp;
+        r->patterns_alloc = alloc;
+    }
+
+    r->patterns[r->npatterns++] = pattern;
+
+    return SUCCEED;
+}
+
+/**
+ * Get the name recorded for the file being parsed, unlike the path it is
+ * valid as long as the parse result
+ */
+static const char *
+cfg_recorded_file(const struct cfg_ctx *ctx, const char *path)
+{
+    if (NULL == ctx->result)
+        return path;
+
+    return ctx->result->files[str_strarr_count(ctx->result->files) - 1];
+}
+
+static uint64_t
+cfg_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Start statistics of a configuration file, called right after the file was
+ * recorded by cfg_record_source()
+ *
+ * @return
+ *   offset of the file in result->file_stats, -1 if statistics are not
+ *   collected or cannot be allocated
+ */
+static long
+cfg_stats_begin(struct cfg_ctx *ctx, int level)
+{
+    struct cfg_result *r = ctx->result;
+    struct cfg_file_stats *tmp;
+    size_t alloc;
+
+    if (NULL == ctx->stats)
+        return -1;
+
+    if (level > ctx->stats->max_depth)
+        ctx->stats->max_depth = level;
+
+    if (r->nfile_stats == r->file_stats_alloc) {
+        alloc = 0 == r->file_stats_alloc ? 16 : r->file_stats_alloc * 2;
 
-            f++;
+        if (NULL == (tmp = realloc(r->file_stats, alloc * sizeof(*tmp)))) {
+            LOG_ERR("cannot allocate file statistics");
+            return -1;
         }
+
+        r->file_stats = tmp;
+        r->file_stats_alloc = alloc;
     }
+
+    memset(&r->file_stats[r->nfile_stats], 0, sizeof(*r->file_stats));
+    r->file_stats[r->nfile_stats].path =
+        r->files[str_strarr_count(r->files) - 1];
+    r->file_stats[r->nfile_stats].depth = level;
+
+    return (long)r->nfile_stats++;
+}
+
+/**
+ * Account a file that has been read and tokenized
+ */
+static void
+cfg_stats_end(struct cfg_ctx *ctx, long file, const struct cfg_frag *frag,
+              uint64_t ns)
+{
+    const struct cfg_scanner *scanner = &frag->scanner;
+    struct cfg_stats *stats = ctx->stats;
+    struct cfg_file_stats *f;
+
+    if (-1 == file)
+        return;
+
+    f = &ctx->result->file_stats[file];
+    f->bytes = frag->buf.size;
+    f->lines = (uint64_t)scanner->lineno;
+    f->ns = ns;
+
+    stats->files++;
+    stats->bytes += frag->buf.size;
+    stats->lines += (uint64_t)scanner->lineno;
+    stats->comment_lines += (uint64_t)scanner->comments;
+    stats->blank_lines += (uint64_t)scanner->blanks;
+    stats->utf8_ns += scanner->utf8_ns;
+}
+
+/**
+ * Account a file applied again from the tokens of an earlier include
+ */
+static void
+cfg_stats_replay(struct cfg_ctx *ctx, long file, const struct cfg_frag *frag,
+                 uint64_t ns)
+{
+    struct cfg_file_stats *f;
+
+    if (-1 == file)
+        return;
+
+    f = &ctx->result->file_stats[file];
+    f->bytes = frag->buf.size;
+    f->lines = (uint64_t)frag->scanner.lineno;
+    f->ns = ns;
+
+    ctx->stats->replayed++;
+}
+
+/**
+ * Convert a numeric value, timed when statistics are collected
+ */
+static int
+cfg_str2uint64(struct cfg_ctx *ctx, const char *value, size_t value_len,
+               uint64_t *var)
+{
+    uint64_t start;
+    int ret;
+
+    if (NULL == ctx->stats)
+        return str2uint64_n(value, value_len, "KMGT", var);
+
+    start = cfg_now_ns();
+    ret = str2uint64_n(value, value_len, "KMGT", var);
+    ctx->stats->numeric_ns += cfg_now_ns() - start;
+
+    return ret;
 }
 
 /**
  * Parse a glob like "/usr/local/etc/xxx.conf.d/p*.conf" into
- * "/usr/local/etc/xxx.conf.d" and "p*.conf" parts
+ * "/usr/local/etc/xxx.conf.d" and "p*.conf" parts, the pattern starts with
+ * the first path component containing "*", or "?" or "[" unless the path up
+ * to the end of that component exists as written
  *
  * @param glob
  *   [IN] glob as specified in Include directive
@@ -106,64 +530,1713 @@ match_glob(const char *file, const char *pattern)
 static int
 parse_glob(const char *glob, char **path, char **pattern)
 {
-    const char *p;
+    const char  *p, *end;
+    struct stat  sb;
+    char         c;
+    int          rc;
+
+    *path = str_strdup(glob);
+    if (NULL == *path) {
+        return FAIL;
+    }
+
+    /* names like "app[1]" that were taken literally before still are */
+    for (p = glob; '\0' != *(p += strcspn(p, "*?[")) && '*' != *p; p = end) {
+        end = p + strcspn(p, "/");
+
+        c = (*path)[end - glob];
+        (*path)[end - glob] = '\0';
+        rc = stat(*path, &sb);
+        (*path)[end - glob] = c;
+
+        if (0 != rc)
+            break;
+    }
+
+    if ('\0' == *p) {
+        *pattern = NULL;
+
+        goto trim;
+    }
+
+    do {
+        if (glob == p) {
+            LOG_ERR("%s: path should be absolute\n", glob);
+            free(*path);
+            return FAIL;
+        }
+
+        p--;
+    }
+    while (PATH_SEPARATOR != *p)
+        ;
+
+    (*path)[p - glob] = '\0';
 
-    if (NULL == (p = strchr(glob, '*'))) {
-        *path = str_strdup(glob);
-        if (NULL == *path) {
+    *pattern = str_strdup(p + 1);
+    if (NULL == *pattern) {
+        free(*path);
+        return FAIL;
+    }
+
+trim:
+    if (0 != str_rtrim(*path, "/") && NULL == *pattern) {
+        *pattern = str_strdup("*");   /* make sure path is a directory */
+        if (NULL == *pattern) {
+            free(*path);
             return FAIL;
         }
-        *pattern = NULL;
+    }
+
+    if ('\0' == (*path)[0] && '/' == glob[0]) {
+        /* retain forward slash for "/" */
+
+        (*path)[0] = '/';
+        (*path)[1] = '\0';
+    }
+
+    return SUCCEED;
+}
+
+/**
+ * Load a configuration file into memory, regular files are mapped, anything
+ * else is read into a single allocated buffer
+ *
+ * @param buf
+ *   [OUT] loaded file contents
+ * @param fd
+ *   [IN] file descriptor open for reading, it can be closed once the
+ *   function returns
+ * @param sb
+ *   [IN] status of the file
+ * @param cfg_file
+ *   [IN] file name for error messages
+ *
+ * @return
+ *   SUCCEED - file contents are available in buf
+ *   FAIL - error reading file
+ */
+static int
+cfg_buf_load(struct cfg_buf *buf, int fd, const struct stat *sb,
+             const char *cfg_file)
+{
+    size_t      size = 0, alloc;
+    ssize_t     n;
+    char       *data = NULL, *tmp;
+    void       *map;
+
+    memset(buf, 0, sizeof(*buf));
+
+    if (S_ISREG(sb->st_mode)) {
+        if (0 == sb->st_size)
+            return SUCCEED;
+
+        map = mmap(NULL, (size_t)sb->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (MAP_FAILED != map) {
+            (void)madvise(map, (size_t)sb->st_size, MADV_SEQUENTIAL);
+
+            buf->data = map;
+            buf->size = buf->map_size = (size_t)sb->st_size;
+            buf->mapped = 1;
+
+            return SUCCEED;
+        }
+    }
+
+    /* pipes, character devices and file systems without mmap support */
+    alloc = S_ISREG(sb->st_mode) ? (size_t)sb->st_size + 1 : MAX_STRING_LEN;
+
+    while (1) {
+        if (size == alloc || NULL == data) {
+            if (NULL != data)
+                alloc *= 2;
+
+            if (NULL == (tmp = realloc(data, alloc))) {
+                LOG_ERR("cannot allocate %zu bytes for config file [%s]",
+                        alloc, cfg_file);
+                goto fail;
+            }
+            data = tmp;
+        }
+
+        if (0 > (n = read(fd, data + size, alloc - size))) {
+            if (EINTR == errno)
+                continue;
+
+            LOG_ERR("cannot read config file [%s]: %s", cfg_file,
+                    strerror(errno));
+            goto fail;
+        }
+
+        if (0 == n)
+            break;
+
+        size += (size_t)n;
+    }
+
+    buf->data = data;
+    buf->size = size;
+
+    return SUCCEED;
+fail:
+    free(data);
+
+    return FAIL;
+}
+
+static void
+cfg_buf_release(struct cfg_buf *buf)
+{
+    if (0 != buf->mapped)
+        munmap(buf->data, buf->map_size);
+    else
+        free(buf->data);
+}
+
+static int
+cfg_frags_init(struct cfg_frags *frags)
+{
+    memset(frags, 0, sizeof(*frags));
+
+    if (NULL == (frags->slots = calloc(CFG_FRAGS_MIN_SLOTS,
+                                       sizeof(*frags->slots)))) {
+        LOG_ERR("cannot allocate list of config files");
+        return FAIL;
+    }
+
+    frags->mask = CFG_FRAGS_MIN_SLOTS - 1;
+    pthread_mutex_init(&frags->lock, NULL);
+
+    return SUCCEED;
+}
+
+/**
+ * Find the slot of a file or the empty slot where it belongs
+ */
+static struct cfg_frag **
+cfg_frags_slot(struct cfg_frag **slots, size_t mask, dev_t dev, ino_t ino)
+{
+    uint64_t    h;
+    size_t      pos;
+
+    /* inodes are often sequential, spread them over the table */
+    h = ((uint64_t)ino ^ ((uint64_t)dev << 32)) * 11400714819323198485u;
+
+    for (pos = (size_t)(h >> 32) & mask; ; pos = (pos + 1) & mask) {
+        if (NULL == slots[pos] || (slots[pos]->ino == ino &&
+                                   slots[pos]->dev == dev))
+            return &slots[pos];
+    }
+}
+
+static void
+cfg_frag_free(struct cfg_frag *frag)
+{
+    cfg_buf_release(&frag->buf);
+    free(frag->tokens);
+    free(frag);
+}
+
+/**
+ * Add a tokenized file unless another thread has added it meanwhile
+ *
+ * @param frag
+ *   [IN/OUT] the file, replaced by the one added before and released
+ *
+ * @return
+ *   SUCCEED - *frag is in the table
+ *   FAIL - out of memory, *frag is released
+ */
+static int
+cfg_frags_add(struct cfg_frags *frags, struct cfg_frag **frag)
+{
+    struct cfg_frag **slots, **slot;
+    size_t            size, i;
+    int               ret = FAIL;
+
+    pthread_mutex_lock(&frags->lock);
+
+    if ((frags->count + 1) * 2 > frags->mask + 1) {
+        size = (frags->mask + 1) * 2;
+
+        if (NULL == (slots = calloc(size, sizeof(*slots)))) {
+            LOG_ERR("cannot allocate list of config files");
+            cfg_frag_free(*frag);
+            goto out;
+        }
+
+        for (i = 0; i <= frags->mask; i++) {
+            if (NULL != frags->slots[i]) {
+                *cfg_frags_slot(slots, size - 1, frags->slots[i]->dev,
+                                frags->slots[i]->ino) = frags->slots[i];
+            }
+        }
+
+        free(frags->slots);
+        frags->slots = slots;
+        frags->mask = size - 1;
+    }
+
+    slot = cfg_frags_slot(frags->slots, frags->mask, (*frag)->dev,
+                          (*frag)->ino);
+
+    if (NULL != *slot) {
+        cfg_frag_free(*frag);
+        *frag = *slot;
+    }
+    else {
+        *slot = *frag;
+        frags->count++;
+    }
+
+    ret = SUCCEED;
+out:
+    pthread_mutex_unlock(&frags->lock);
+
+    return ret;
+}
+
+/**
+ * Split a loaded file into tokens, a line that cannot be tokenized stops
+ * at it and is kept in frag->error, called again for a file whose tokens
+ * were dropped
+ *
+ * @return
+ *   SUCCEED - tokenized
+ *   FAIL - out of memory
+ */
+static int
+cfg_frag_scan(struct cfg_frag *frag, const char *cfg_file, int timed)
+{
+    struct cfg_token    tok, *tokens;
+    size_t              alloc = 0;
+    int                 rc;
+
+    frag->count = 0;
+    cfg_scan_init(&frag->scanner, frag->buf.data, frag->buf.size);
+    frag->scanner.timed = timed;
+
+    while (SCAN_TOKEN == (rc = cfg_scan_next(&frag->scanner, &tok)) ||
+           SCAN_SECTION == rc) {
+        if (frag->count == alloc) {
+            alloc = 0 == alloc ? 64 : alloc * 2;
+
+            if (NULL == (tokens = realloc(frag->tokens,
+                                          alloc * sizeof(*tokens)))) {
+                LOG_ERR("cannot allocate tokens of config file [%s]",
+                        cfg_file);
+                return FAIL;
+            }
+            frag->tokens = tokens;
+        }
+
+        frag->tokens[frag->count++] = tok;
+    }
+
+    frag->scan_rc = rc;
+
+    if (SCAN_EOF != rc)
+        frag->error = tok;
+
+    return SUCCEED;
+}
+
+/**
+ * Find a file read before by this parse, possibly through another path
+ *
+ * @return
+ *   the file or NULL
+ */
+static struct cfg_frag *
+cfg_frags_find(struct cfg_frags *frags, dev_t dev, ino_t ino)
+{
+    struct cfg_frag *frag;
+
+    pthread_mutex_lock(&frags->lock);
+    frag = *cfg_frags_slot(frags->slots, frags->mask, dev, ino);
+    pthread_mutex_unlock(&frags->lock);
+
+    return frag;
+}
+
+/**
+ * Tokenize a loaded file and add it to the files of the parse
+ *
+ * @param sb
+ *   [IN] status of the file
+ * @param buf
+ *   [IN/OUT] contents of the file, taken over
+ * @param start
+ *   [IN] when loading the file started, if timed
+ * @param frag
+ *   [OUT] the tokenized file, owned by frags
+ *
+ * @return
+ *   SUCCEED - the file is tokenized
+ *   FAIL - out of memory
+ */
+static int
+cfg_frag_create(struct cfg_frags *frags, const struct stat *sb,
+                struct cfg_buf *buf, const char *cfg_file, int timed,
+                uint64_t start, struct cfg_frag **frag)
+{
+    struct cfg_frag *f;
+
+    if (NULL == (f = calloc(1, sizeof(*f)))) {
+        LOG_ERR("cannot allocate config file [%s]", cfg_file);
+        cfg_buf_release(buf);
+        return FAIL;
+    }
+
+    f->dev = sb->st_dev;
+    f->ino = sb->st_ino;
+    f->buf = *buf;
+    memset(buf, 0, sizeof(*buf));
+
+    if (SUCCEED != cfg_frag_scan(f, cfg_file, timed)) {
+        cfg_frag_free(f);
+        return FAIL;
+    }
+
+    if (0 != timed)
+        f->scan_ns = cfg_now_ns() - start;
+
+    if (SUCCEED != cfg_frags_add(frags, &f))
+        return FAIL;
+
+    *frag = f;
+
+    return SUCCEED;
+}
+
+/**
+ * Open a configuration file and read and tokenize it, unless it has been
+ * read before by this parse, possibly through another path
+ *
+ * @param frags
+ *   [IN] files read so far, the file is added to it
+ * @param dirfd
+ *   [IN] directory name is relative to, or AT_FDCWD
+ * @param name
+ *   [IN] file name to open
+ * @param cfg_file
+ *   [IN] full name of config file for error messages
+ * @param timed
+ *   [IN] measure reading and tokenizing
+ * @param frag
+ *   [OUT] the tokenized file, owned by frags
+ *
+ * @return
+ *   SUCCEED - the file is tokenized
+ *   FAIL - error reading file
+ *   CFG_NO_FILE - file cannot be opened
+ */
+static int
+cfg_frag_load(struct cfg_frags *frags, int dirfd, const char *name,
+              const char *cfg_file, int timed, struct cfg_frag **frag)
+{
+    struct cfg_buf    buf;
+    struct stat       sb;
+    uint64_t          start = 0;
+    int               fd, ret = FAIL;
+
+    if (0 != timed)
+        start = cfg_now_ns();
+
+    if (-1 == (fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC)))
+        return CFG_NO_FILE;
+
+    if (0 != fstat(fd, &sb)) {
+        LOG_ERR("cannot stat config file [%s]: %s", cfg_file, strerror(errno));
+        goto out;
+    }
+
+    /* the same file included through other globs or symbolic links */
+    if (NULL != (*frag = cfg_frags_find(frags, sb.st_dev, sb.st_ino))) {
+        ret = SUCCEED;
+        goto out;
+    }
+
+    if (SUCCEED == cfg_buf_load(&buf, fd, &sb, cfg_file))
+        ret = cfg_frag_create(frags, &sb, &buf, cfg_file, timed, start, frag);
+out:
+    close(fd);
+
+    return ret;
+}
+
+/**
+ * Report a line the scanner could not split into parameter and value
+ */
+static void
+cfg_scan_error(int rc, const struct cfg_token *tok, const char *cfg_file)
+{
+    /* we only support UTF-8 characters in the config file */
+    if (SCAN_NON_UTF8 == rc) {
+        LOG_ERR("non-UTF-8 character at line %d (%.*s) in config file [%s]",
+                tok->lineno, (int)tok->line_len, tok->line, cfg_file);
+        return;
+    }
+
+    LOG_ERR("invalid entry [%.*s] (not following \"parameter=value\" notation) "
+            "in config file [%s], line %d", (int)tok->line_len, tok->line,
+            cfg_file, tok->lineno);
+}
+
+/**
+ * Store value of one "parameter=value" line into the variables of a
+ * parameter
+ *
+ * @param ctx
+ *   parsing context
+ * @param i
+ *   first cfg[] entry of the parameter
+ * @param tok
+ *   the line
+ * @param cfg_file
+ *   full name of config file the line comes from
+ *
+ * @return
+ *   SUCCEED - value stored
+ *   FAIL - error storing value
+ */
+static int
+cfg_apply_value(struct cfg_ctx *ctx, int i, const struct cfg_token *tok,
+                const char *cfg_file)
+{
+    struct cfg_line *cfg = ctx->cfg;
+    const char *value = tok->value;
+    size_t value_len = tok->value_len;
+    char *copy, *joined = NULL;
+    uint64_t    var;
+    int ret = FAIL;
+
+    if (0 != tok->continued) {
+        if (NULL == (joined = cfg_join_value(ctx, tok, &value_len)))
+            goto copy_str_error;
+
+        value = joined;
+    }
+
+    for (; -1 != i; i = ctx->index.next[i]) {
+        switch (cfg[i].type) {
+        case TYPE_INT:
+            if (FAIL == cfg_str2uint64(ctx, value, value_len, &var))
+                goto incorrect_config;
+
+            if (cfg[i].min > var ||
+                (0 != cfg[i].max && var > cfg[i].max))
+                goto incorrect_config;
+
+            *((int *)cfg[i].variable) = (int)var;
+            break;
+        case TYPE_STRING_LIST:
+        case TYPE_STRING:
+            /* the joined copy is taken over by the first variable */
+            if (NULL != joined) {
+                copy = joined;
+                joined = NULL;
+            }
+            else if (NULL == (copy = cfg_strndup(ctx, value, value_len)))
+                goto copy_str_error;
+
+            *((char **)cfg[i].variable) = copy;
+
+            if (TYPE_STRING_LIST == cfg[i].type)
+                str_trim_str_list(copy, ',');
+            break;
+        case TYPE_MULTISTRING:
+            if (NULL == ctx->arena) {
+                if (SUCCEED != str_strarr_add_n(cfg[i].variable, value,
+                                                value_len))
+                    goto copy_str_error;
+                break;
+            }
+
+            if (NULL != joined)
+                copy = joined;
+            else if (NULL == (copy = arena_strndup(ctx->arena, value,
+                                                   value_len)))
+                goto copy_str_error;
+
+            if (SUCCEED != str_strarr_append(cfg[i].variable, copy))
+                goto copy_str_error;
+
+            joined = NULL;
+            break;
+        case TYPE_UINT64:
+            if (FAIL == cfg_str2uint64(ctx, value, value_len, &var))
+                goto incorrect_config;
+
+            if (cfg[i].min > var || (0 != cfg[i].max && var > cfg[i].max))
+                goto incorrect_config;
+
+            *((uint64_t *)cfg[i].variable) = var;
+            break;
+        default:
+            break;
+        }
+
+        if (NULL != ctx->result && NULL != ctx->result->assigned)
+            ctx->result->assigned[i] = 1;
+    }
+
+    ret = SUCCEED;
+    goto out;
+copy_str_error:
+    LOG_ERR("copying string failed at line [%.*s] in config file [%s], line %d",
+            (int)tok->line_len, tok->line, cfg_file, tok->lineno);
+    goto out;
+incorrect_config:
+    LOG_ERR("wrong value of [%s] in config file [%s], line %d",
+            cfg[i].parameter, cfg_file, tok->lineno);
+out:
+    /* arena memory goes with the arena */
+    if (NULL == ctx->arena)
+        free(joined);
+
+    return ret;
+}
+
+/**
+ * Remember where the value of a parameter is for a lazy parse, only the
+ * last occurrence of a single valued parameter is kept
+ *
+ * @return
+ *   SUCCEED - value recorded
+ *   FAIL - out of memory
+ */
+static int
+cfg_lazy_record(struct cfg_ctx *ctx, int i, const struct cfg_token *tok,
+                const char *cfg_file)
+{
+    struct cfg_lazy_value  *v = &ctx->lazy->values[i];
+    struct cfg_lazy_span   *span;
+
+    if (NULL != v->last && TYPE_MULTISTRING != ctx->cfg[i].type) {
+        span = v->last;
+    }
+    else {
+        if (NULL == (span = arena_alloc(ctx->arena, sizeof(*span)))) {
+            LOG_ERR("cannot record parameter [%s] in config file [%s], "
+                    "line %d", ctx->cfg[i].parameter, cfg_file, tok->lineno);
+            return FAIL;
+        }
+
+        span->next = NULL;
+
+        if (NULL == v->last)
+            v->first = span;
+        else
+            v->last->next = span;
+
+        v->last = span;
+    }
+
+    span->tok = *tok;
+    span->file = cfg_file;
+
+    return SUCCEED;
+}
+
+/**
+ * Keep a configuration file loaded for values recorded by a lazy parse,
+ * buf is emptied when it is taken over
+ *
+ * @return
+ *   SUCCEED - the file is owned by the lazy index
+ *   FAIL - out of memory, buf is left to the caller
+ */
+static int
+cfg_lazy_keep(struct cfg_lazy *lazy, struct cfg_buf *buf)
+{
+    struct cfg_buf *tmp;
+    size_t          alloc;
+
+    if (lazy->nbufs == lazy->bufs_alloc) {
+        alloc = 0 == lazy->bufs_alloc ? 16 : lazy->bufs_alloc * 2;
+
+        if (NULL == (tmp = realloc(lazy->bufs, alloc * sizeof(*tmp)))) {
+            LOG_ERR("cannot allocate list of config files");
+            return FAIL;
+        }
+
+        lazy->bufs = tmp;
+        lazy->bufs_alloc = alloc;
+    }
+
+    lazy->bufs[lazy->nbufs++] = *buf;
+    memset(buf, 0, sizeof(*buf));
+
+    return SUCCEED;
+}
+
+/**
+ * Release all files of a parse
+ *
+ * @param lazy
+ *   [IN] lazy index to hand the file contents over to, or NULL
+ *
+ * @return
+ *   SUCCEED - released
+ *   FAIL - the lazy index cannot take the files over
+ */
+static int
+cfg_frags_destroy(struct cfg_frags *frags, struct cfg_lazy *lazy)
+{
+    size_t  i;
+    int     ret = SUCCEED;
+
+    for (i = 0; i <= frags->mask; i++) {
+        if (NULL == frags->slots[i])
+            continue;
+
+        /* values recorded by a lazy parse point into the files */
+        if (NULL != lazy && SUCCEED == ret)
+            ret = cfg_lazy_keep(lazy, &frags->slots[i]->buf);
+
+        cfg_frag_free(frags->slots[i]);
+    }
+
+    pthread_mutex_destroy(&frags->lock);
+    free(frags->slots);
+
+    return ret;
+}
+
+/**
+ * See whether a lazy parse has found a value for a cfg[] entry, values are
+ * only checked when they are converted
+ */
+static int
+cfg_lazy_present(const struct cfg_ctx *ctx, int i)
+{
+    const char *name = ctx->cfg[i].parameter;
+
+    i = cfg_index_find(&ctx->index, ctx->cfg, name, strlen(name));
+
+    return NULL != ctx->lazy->values[i].first ? SUCCEED : FAIL;
+}
+
+/**
+ * Add a value to the store of all parameters, whether the parameter is in
+ * the cfg table or not
+ *
+ * @return
+ *   SUCCEED - value stored
+ *   FAIL - out of memory
+ */
+static int
+cfg_kv_record(struct cfg_ctx *ctx, const char *key, size_t key_len,
+              const struct cfg_token *tok, const char *cfg_file)
+{
+    char    *copy;
+
+    if (NULL == (copy = arena_alloc(ctx->arena, tok->value_len + 1))) {
+        LOG_ERR("copying string failed at line [%.*s] in config file [%s], "
+                "line %d", (int)tok->line_len, tok->line, cfg_file,
+                tok->lineno);
+        return FAIL;
+    }
+
+    cfg_scan_value(tok, copy);
+
+    return cfg_kv_add(ctx->kv, key, key_len, copy);
+}
+
+/**
+ * Store value of one "parameter=value" line, start a "[section]" or process
+ * "Include=..."
+ *
+ * @param ctx
+ *   parsing context
+ * @param tok
+ *   the line
+ * @param cfg_file
+ *   full name of config file the line comes from, it must outlive the
+ *   result of a lazy parse
+ * @param level
+ *   a level of the config file
+ *
+ * @return
+ *   SUCCEED - value stored or parameter ignored
+ *   FAIL - error storing value
+ */
+static int
+cfg_apply_token(struct cfg_ctx *ctx, const struct cfg_token *tok,
+                const char *cfg_file, int level)
+{
+    const char *key = tok->key;
+    size_t key_len = tok->key_len;
+    char *include;
+    int i;
+
+    if (NULL == tok->value) {
+        ctx->section = tok->key;
+        ctx->section_len = tok->key_len;
+
+        return SUCCEED;
+    }
+
+    if (sizeof("Include") - 1 == tok->key_len &&
+        0 == memcmp(tok->key, "Include", tok->key_len)) {
+
+        if (NULL == (include = malloc(tok->value_len + 1))) {
+            LOG_ERR("copying string failed at line [%.*s] in config file [%s],"
+                    " line %d", (int)tok->line_len, tok->line, cfg_file,
+                    tok->lineno);
+            return FAIL;
+        }
+
+        cfg_scan_value(tok, include);
+        i = parse_cfg_object(include, ctx, level);
+        free(include);
+
+        return i;
+    }
+
+    /* parameters of a section are named "section.parameter" */
+    if (0 != ctx->section_len) {
+        str_buf_reset(&ctx->key);
+
+        if (SUCCEED != str_buf_append_n(&ctx->key, ctx->section,
+                                        ctx->section_len) ||
+            SUCCEED != str_buf_append_n(&ctx->key, ".", 1) ||
+            SUCCEED != str_buf_append_n(&ctx->key, tok->key, tok->key_len)) {
+            LOG_ERR("cannot allocate parameter name at line [%.*s] in config "
+                    "file [%s], line %d", (int)tok->line_len, tok->line,
+                    cfg_file, tok->lineno);
+            return FAIL;
+        }
+
+        key = ctx->key.data;
+        key_len = ctx->key.len;
+    }
+
+    if (NULL != ctx->kv &&
+        SUCCEED != cfg_kv_record(ctx, key, key_len, tok, cfg_file))
+        return FAIL;
+
+    i = cfg_index_find(&ctx->index, ctx->cfg, key, key_len);
+
+    if (-1 == i) {
+        if (CFG_STRICT != ctx->strict)
+            return SUCCEED;
+
+        LOG_ERR("unknown parameter [%.*s] in config file [%s], line %d",
+                (int)key_len, key, cfg_file, tok->lineno);
+        return FAIL;
+    }
+
+    if (NULL != ctx->lazy)
+        return cfg_lazy_record(ctx, i, tok, cfg_file);
+
+    return cfg_apply_value(ctx, i, tok, cfg_file);
+}
+
+/**
+ * Apply a tokenized configuration file
+ *
+ * @param ctx
+ *   parsing context
+ * @param frag
+ *   the file
+ * @param cfg_file
+ *   full name the file was included by, it must outlive the result of a
+ *   lazy parse
+ * @param level
+ *   a level of the config file
+ *
+ * @return
+ *   SUCCEED - parsed successfully
+ *   FAIL - error processing config file or the file includes itself
+ */
+static int
+cfg_frag_apply(struct cfg_ctx *ctx, struct cfg_frag *frag,
+               const char *cfg_file, int level)
+{
+    const char *section = ctx->section;
+    size_t section_len = ctx->section_len, i;
+    uint64_t start = 0;
+    long file;
+    int ret = FAIL;
+
+    if (0 != frag->active) {
+        LOG_ERR("Recursion detected! '%s' includes itself, skipped "
+                "processing it.", cfg_file);
+        return FAIL;
+    }
+
+    /* included again, so it is kept from now on */
+    if (NULL == frag->tokens && 0 != frag->applied &&
+        SUCCEED != cfg_frag_scan(frag, cfg_file, 0))
+        return FAIL;
+
+    if (-1 != (file = cfg_stats_begin(ctx, level)))
+        start = cfg_now_ns();
+
+    frag->active = 1;
+
+    /* a file starts outside of any section */
+    ctx->section_len = 0;
+
+    for (i = 0; i < frag->count; i++) {
+        if (SUCCEED != cfg_apply_token(ctx, &frag->tokens[i], cfg_file, level))
+            goto out;
+    }
+
+    if (SCAN_EOF != frag->scan_rc) {
+        cfg_scan_error(frag->scan_rc, &frag->error, cfg_file);
+        goto out;
+    }
+
+    ret = SUCCEED;
+out:
+    frag->active = 0;
+    ctx->section = section;
+    ctx->section_len = section_len;
+
+    if (-1 != file) {
+        if (0 == frag->applied)
+            cfg_stats_end(ctx, file, frag, frag->scan_ns + cfg_now_ns() - start);
+        else
+            cfg_stats_replay(ctx, file, frag, cfg_now_ns() - start);
+    }
+
+    if (0 == frag->applied++) {
+        if (ctx->frags->kept + frag->count <= CFG_FRAGS_KEEP_TOKENS) {
+            ctx->frags->kept += frag->count;
+        }
+        else {
+            free(frag->tokens);
+            frag->tokens = NULL;
+        }
+    }
+
+    return ret;
+}
+
+/* a file of an included directory, read and tokenized by a worker thread */
+struct cfg_dir_file {
+    char               *path;
+    size_t              offset;     /* of path in the paths of the scan */
+    int                 dirfd;      /* the included directory */
+    const char         *name;       /* path relative to dirfd */
+    struct cfg_frag    *frag;       /* owned by the files of the parse */
+    int                 status;     /* CFG_DIR_*, CFG_NO_FILE or FAIL */
+    int                 timed;      /* collect statistics of the file */
+#ifdef HAVE_IO_URING
+    /* filled in by the I/O thread of the directory */
+    int                 io;         /* CFG_DIR_PENDING until done with it */
+    int                 fd;         /* still open if not a regular file */
+    struct statx        stx;
+    struct cfg_buf      buf;
+    size_t              done;       /* bytes read so far */
+#endif
+};
+
+#define CFG_DIR_SCANNED     0
+#define CFG_DIR_PENDING     1
+
+/* files of one included directory, applied strictly in order */
+struct cfg_dir_pool {
+    struct cfg_frags    *frags;
+#ifdef HAVE_IO_URING
+    struct cfg_uring    *ring;      /* NULL if each thread reads its files */
+    pthread_cond_t      loaded;     /* signaled when the I/O of a file ends */
+#endif
+    struct cfg_dir_file *files;
+    size_t              count;
+    size_t              next;       /* next file to be tokenized */
+    size_t              applied;    /* files applied so far */
+    int                 stop;
+    pthread_mutex_t     lock;
+    pthread_cond_t      scanned;    /* signaled when a file is tokenized */
+    pthread_cond_t      progress;   /* signaled when a file is applied */
+};
+
+/* maximum number of threads tokenizing files of one directory */
+#define CFG_DIR_MAX_THREADS     8
+/* how many files tokenizing may run ahead of applying, per thread */
+#define CFG_DIR_WINDOW          4
+
+#ifdef HAVE_IO_URING
+/* request of the I/O thread, kept in the low bits of user_data */
+#define CFG_REQ_OPEN        0
+#define CFG_REQ_STATX       1
+#define CFG_REQ_READ        2
+
+/* files of a directory read at the same time */
+#define CFG_REQ_DEPTH       64
+
+/* largest read request, longer files are read in several */
+#define CFG_REQ_MAX_READ    (1u << 30)
+
+/* io of a file the I/O thread has given up on, it is read the usual way */
+#define CFG_DIR_UNREAD      3
+
+/* how often requests the kernel has taken are polled once the ring fails */
+#define CFG_REQ_POLL_NS     1000000
+
+/**
+ * Queue the next request for a file of an included directory, there is
+ * never more than one per file in flight, so there is always room for it
+ */
+static void
+cfg_dir_io_prep(struct cfg_uring *ring, struct cfg_dir_file *files, size_t i,
+                int req)
+{
+    struct cfg_dir_file *f = &files[i];
+    struct io_uring_sqe *sqe = cfg_uring_sqe(ring);
+    size_t               len;
+
+    switch (req) {
+    case CFG_REQ_OPEN:
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = f->dirfd;
+        sqe->addr = (uint64_t)(uintptr_t)f->name;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        break;
+    case CFG_REQ_STATX:
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = f->fd;
+        sqe->addr = (uint64_t)(uintptr_t)"";
+        sqe->len = STATX_BASIC_STATS;
+        sqe->statx_flags = AT_EMPTY_PATH;
+        sqe->off = (uint64_t)(uintptr_t)&f->stx;
+        break;
+    default:
+        len = f->buf.size - f->done;
+
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = f->fd;
+        sqe->addr = (uint64_t)(uintptr_t)(f->buf.data + f->done);
+        sqe->len = (unsigned)(CFG_REQ_MAX_READ < len ? CFG_REQ_MAX_READ : len);
+        sqe->off = f->done;
+        break;
+    }
+
+    sqe->user_data = (uint64_t)i << 2 | (uint64_t)req;
+}
+
+/**
+ * Hand a file over to the tokenizing threads
+ */
+static void
+cfg_dir_io_done(struct cfg_dir_pool *pool, struct cfg_dir_file *f, int status)
+{
+    if (SUCCEED != status) {
+        cfg_buf_release(&f->buf);
+        memset(&f->buf, 0, sizeof(f->buf));
+    }
+
+    /* anything but a regular file is read by the thread tokenizing it */
+    if (-1 != f->fd && (SUCCEED != status || NULL != f->frag ||
+                        S_ISREG(f->stx.stx_mode))) {
+        close(f->fd);
+        f->fd = -1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    f->io = status;
+    pthread_cond_broadcast(&pool->loaded);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Take the completion of a request and queue the next one for the file
+ *
+ * @param abandon
+ *   [IN] 0 to go on with the file, otherwise the status it gets instead of
+ *   queueing another request
+ *
+ * @return
+ *   1 - the file is done with
+ *   0 - another request of the file is queued
+ */
+static int
+cfg_dir_io_step(struct cfg_dir_pool *pool, const struct io_uring_cqe *cqe,
+                int abandon)
+{
+    struct cfg_dir_file *f;
+    size_t               i = (size_t)(cqe->user_data >> 2);
+    int                  req = (int)(cqe->user_data & 3);
+
+    f = &pool->files[i];
+
+    if (CFG_REQ_OPEN == req) {
+        if (0 > cqe->res) {
+            cfg_dir_io_done(pool, f, CFG_NO_FILE);
+            return 1;
+        }
+
+        f->fd = cqe->res;
+    }
+
+    if (0 != abandon) {
+        cfg_dir_io_done(pool, f, abandon);
+        return 1;
+    }
+
+    switch (req) {
+    case CFG_REQ_OPEN:
+        cfg_dir_io_prep(pool->ring, pool->files, i, CFG_REQ_STATX);
+        return 0;
+    case CFG_REQ_STATX:
+        if (0 > cqe->res) {
+            LOG_ERR("cannot stat config file [%s]: %s", f->path,
+                    strerror(-cqe->res));
+            goto fail;
+        }
+
+        /* the same file included through other globs or symbolic links */
+        f->frag = cfg_frags_find(pool->frags, makedev(f->stx.stx_dev_major,
+                                                      f->stx.stx_dev_minor),
+                                 f->stx.stx_ino);
+
+        if (NULL != f->frag || !S_ISREG(f->stx.stx_mode) ||
+            0 == f->stx.stx_size)
+            break;
+
+        /* populated at once, the read does not fault on every page */
+        f->buf.data = mmap(NULL, f->stx.stx_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+
+        if (MAP_FAILED == f->buf.data) {
+            LOG_ERR("cannot allocate %llu bytes for config file [%s]",
+                    (unsigned long long)f->stx.stx_size, f->path);
+            f->buf.data = NULL;
+            goto fail;
+        }
+
+        f->buf.size = f->buf.map_size = f->stx.stx_size;
+        f->buf.mapped = 1;
+        cfg_dir_io_prep(pool->ring, pool->files, i, CFG_REQ_READ);
+        return 0;
+    default:
+        if (0 > cqe->res) {
+            LOG_ERR("cannot read config file [%s]: %s", f->path,
+                    strerror(-cqe->res));
+            goto fail;
+        }
+
+        /* the file has become shorter since statx */
+        if (0 == cqe->res)
+            f->buf.size = f->done;
+
+        if ((f->done += (size_t)cqe->res) < f->buf.size) {
+            cfg_dir_io_prep(pool->ring, pool->files, i, CFG_REQ_READ);
+            return 0;
+        }
+        break;
+    }
+
+    cfg_dir_io_done(pool, f, SUCCEED);
+
+    return 1;
+fail:
+    cfg_dir_io_done(pool, f, FAIL);
+
+    return 1;
+}
+
+/**
+ * Open, stat and read the files of an included directory in order, with as
+ * many requests in flight as the ring takes, while the files read so far
+ * are tokenized and applied; once the ring fails the files it has not read
+ * are left to the threads tokenizing them
+ */
+static void *
+cfg_dir_io(void *arg)
+{
+    struct cfg_dir_pool *pool = arg;
+    struct cfg_uring    *ring = pool->ring;
+    struct io_uring_cqe  cqe;
+    struct timespec      delay = {0, CFG_REQ_POLL_NS};
+    uint64_t             user_data;
+    size_t               next = 0, inflight = 0, i;
+    int                  stop, failed = 0, abandon;
+
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        stop = pool->stop;
+        pthread_mutex_unlock(&pool->lock);
+
+        for (; 0 == stop && 0 == failed && next < pool->count &&
+             inflight < ring->entries; next++, inflight++) {
+            cfg_dir_io_prep(ring, pool->files, next, CFG_REQ_OPEN);
+        }
+
+        if (0 == inflight)
+            break;
+
+        if (0 != failed) {
+            /* the requests the kernel has taken still complete */
+            nanosleep(&delay, NULL);
+        }
+        else if (SUCCEED != cfg_uring_submit(ring, 1)) {
+            failed = 1;
+
+            /* files whose next request was not taken are read as they come */
+            while (SUCCEED == cfg_uring_unqueue(ring, &user_data)) {
+                cfg_dir_io_done(pool, &pool->files[user_data >> 2],
+                                CFG_DIR_UNREAD);
+                inflight--;
+            }
+        }
+
+        if (0 != failed)
+            abandon = CFG_DIR_UNREAD;
+        else
+            abandon = 0 != stop ? FAIL : 0;
+
+        while (SUCCEED == cfg_uring_cqe(ring, &cqe))
+            inflight -= (size_t)cfg_dir_io_step(pool, &cqe, abandon);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    /* files not opened */
+    for (i = next; i < pool->count; i++)
+        pool->files[i].io = 0 != stop ? FAIL : CFG_DIR_UNREAD;
+
+    pthread_cond_broadcast(&pool->loaded);
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static void
+cfg_statx_stat(const struct statx *stx, struct stat *sb)
+{
+    memset(sb, 0, sizeof(*sb));
+    sb->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    sb->st_ino = stx->stx_ino;
+    sb->st_mode = stx->stx_mode;
+    sb->st_size = (off_t)stx->stx_size;
+}
+
+/**
+ * Tokenize a file of an included directory once the I/O thread is done
+ * with it
+ *
+ * @return
+ *   status of the file, CFG_DIR_UNREAD if the I/O thread has given up on it
+ */
+static int
+cfg_dir_file_read(struct cfg_dir_pool *pool, struct cfg_dir_file *f)
+{
+    struct stat sb;
+    uint64_t    start = 0;
+    int         rc;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (CFG_DIR_PENDING == f->io)
+        pthread_cond_wait(&pool->loaded, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (SUCCEED != f->io)
+        return f->io;
+
+    if (NULL != f->frag)
+        return CFG_DIR_SCANNED;
+
+    if (0 != f->timed)
+        start = cfg_now_ns();
+
+    cfg_statx_stat(&f->stx, &sb);
+
+    /* pipes and devices are read as they come */
+    if (-1 != f->fd) {
+        rc = cfg_buf_load(&f->buf, f->fd, &sb, f->path);
+        close(f->fd);
+        f->fd = -1;
+
+        if (SUCCEED != rc)
+            return FAIL;
+    }
+
+    if (SUCCEED != cfg_frag_create(pool->frags, &sb, &f->buf, f->path,
+                                   f->timed, start, &f->frag))
+        return FAIL;
+
+    return CFG_DIR_SCANNED;
+}
+#endif
+
+/**
+ * Read and tokenize a file of an included directory
+ *
+ * @return
+ *   status of the file
+ */
+static int
+cfg_dir_file_scan(struct cfg_dir_pool *pool, struct cfg_dir_file *f)
+{
+    int rc;
+
+#ifdef HAVE_IO_URING
+    if (NULL != pool->ring &&
+        CFG_DIR_UNREAD != (rc = cfg_dir_file_read(pool, f)))
+        return rc;
+#endif
+
+    if (SUCCEED == (rc = cfg_frag_load(pool->frags, f->dirfd, f->name,
+                                       f->path, f->timed, &f->frag)))
+        return CFG_DIR_SCANNED;
+
+    return rc;
+}
+
+/**
+ * Take the next file to tokenize
+ *
+ * @return
+ *   the file or NULL if there is no more work, called with lock held
+ */
+static struct cfg_dir_file *
+cfg_dir_pool_take(struct cfg_dir_pool *pool, size_t window)
+{
+    while (0 == pool->stop && pool->next < pool->count &&
+           pool->next >= pool->applied + window) {
+        pthread_cond_wait(&pool->progress, &pool->lock);
+    }
+
+    if (0 != pool->stop || pool->next >= pool->count)
+        return NULL;
+
+    return &pool->files[pool->next++];
+}
+
+static void *
+cfg_dir_worker(void *arg)
+{
+    struct cfg_dir_pool *pool = arg;
+    struct cfg_dir_file *f;
+    int status;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (NULL != (f = cfg_dir_pool_take(pool, CFG_DIR_MAX_THREADS *
+                                          CFG_DIR_WINDOW))) {
+        pthread_mutex_unlock(&pool->lock);
+        status = cfg_dir_file_scan(pool, f);
+        pthread_mutex_lock(&pool->lock);
+
+        f->status = status;
+        pthread_cond_broadcast(&pool->scanned);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/**
+ * Apply a tokenized file of an included directory
+ *
+ * @return
+ *   SUCCEED - parsed successfully
+ *   FAIL - error processing config file
+ */
+static int
+cfg_dir_file_apply(struct cfg_ctx *ctx, const struct cfg_dir_file *f,
+                   int level)
+{
+    const char *path;
+
+    if (++level > MAX_INCLUDE_LEVEL) {
+        LOG_ERR("Recursion detected! Skipped processing of '%s'.", f->path);
+        return FAIL;
+    }
+
+    if (SUCCEED != cfg_record_source(ctx, f->path, 0))
+        return FAIL;
+
+    path = cfg_recorded_file(ctx, f->path);
+
+    if (CFG_DIR_SCANNED != f->status)
+        return FAIL;
+
+    return cfg_frag_apply(ctx, f->frag, path, level);
+}
+
+/**
+ * Parse files of an included directory, files are read and tokenized by a
+ * pool of threads while the values are applied by the calling thread in
+ * the order of the files array, so the result is the same as when parsing
+ * them one after another; with io_uring the files are opened, stat'ed and
+ * read by batches of requests from a thread of their own instead, and only
+ * tokenized by the pool
+ *
+ * @param files
+ *   files to parse, in order
+ * @param count
+ *   number of files
+ * @param ctx
+ *   parsing context
+ * @param level
+ *   a level of included file
+ *
+ * @return
+ *   SUCCEED - parsed successfully
+ *   FAIL - error processing files
+ */
+static int
+cfg_dir_parse_files(struct cfg_dir_file *files, size_t count,
+                    struct cfg_ctx *ctx, int level)
+{
+    struct cfg_dir_pool pool;
+    pthread_t threads[CFG_DIR_MAX_THREADS];
+    struct cfg_dir_file *f;
+    long cpus;
+    size_t i, nthreads = 0, want;
+    int ret = SUCCEED, status;
+#ifdef HAVE_IO_URING
+    struct cfg_uring ring;
+    pthread_t io;
+#endif
+
+    memset(&pool, 0, sizeof(pool));
+    pool.frags = ctx->frags;
+    pool.files = files;
+    pool.count = count;
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.scanned, NULL);
+    pthread_cond_init(&pool.progress, NULL);
+
+#ifdef HAVE_IO_URING
+    pthread_cond_init(&pool.loaded, NULL);
+
+    /* a single file has nothing to batch */
+    if (CFG_IO_URING == cfg_io && 1 < count &&
+        SUCCEED == cfg_uring_init(&ring, CFG_REQ_DEPTH)) {
+        pool.ring = &ring;
+
+        if (0 != pthread_create(&io, NULL, cfg_dir_io, &pool)) {
+            cfg_uring_destroy(&ring);
+            pool.ring = NULL;
+        }
+    }
+#endif
+
+    want = 0 < (cpus = sysconf(_SC_NPROCESSORS_ONLN)) ? (size_t)cpus : 1;
+
+    if (CFG_DIR_MAX_THREADS < want)
+        want = CFG_DIR_MAX_THREADS;
+
+    /* a single file is read by the calling thread */
+    if (count < want)
+        want = 1 < count ? count : 0;
+
+    for (; nthreads < want; nthreads++) {
+        if (0 != pthread_create(&threads[nthreads], NULL, cfg_dir_worker,
+                                &pool))
+            break;
+    }
+
+    for (i = 0; i < count && SUCCEED == ret; i++) {
+        pthread_mutex_lock(&pool.lock);
+
+        /* help out when no worker has picked up the file yet */
+        while (CFG_DIR_PENDING == files[i].status) {
+            if (pool.next == i && NULL != (f = cfg_dir_pool_take(&pool, 1))) {
+                pthread_mutex_unlock(&pool.lock);
+                status = cfg_dir_file_scan(&pool, f);
+                pthread_mutex_lock(&pool.lock);
+
+                f->status = status;
+                continue;
+            }
+
+            pthread_cond_wait(&pool.scanned, &pool.lock);
+        }
+
+        pthread_mutex_unlock(&pool.lock);
+
+        ret = cfg_dir_file_apply(ctx, &files[i], level);
+
+        pthread_mutex_lock(&pool.lock);
+        pool.applied = i + 1;
+        pthread_cond_broadcast(&pool.progress);
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.progress);
+    pthread_mutex_unlock(&pool.lock);
+
+    while (0 < nthreads)
+        pthread_join(threads[--nthreads], NULL);
+
+#ifdef HAVE_IO_URING
+    if (NULL != pool.ring) {
+        pthread_join(io, NULL);
+        cfg_uring_destroy(&ring);
+
+        /* files read ahead of a failure */
+        for (i = 0; i < count; i++) {
+            if (-1 != files[i].fd)
+                close(files[i].fd);
+
+            cfg_buf_release(&files[i].buf);
+        }
+    }
+
+    pthread_cond_destroy(&pool.loaded);
+#endif
+
+    pthread_cond_destroy(&pool.progress);
+    pthread_cond_destroy(&pool.scanned);
+    pthread_mutex_destroy(&pool.lock);
+
+    return ret;
+}
+
+static int
+cfg_dir_file_compare(const void *a, const void *b)
+{
+    return strcmp(((const struct cfg_dir_file *)a)->name,
+                  ((const struct cfg_dir_file *)b)->name);
+}
+
+/* subdirectory where some pattern components still match */
+struct cfg_dir_subdir {
+    size_t              name;       /* offset of its relative path in names */
+    cfg_pattern_set     set;
+};
+
+/* files and subdirectories of an included directory matching a pattern */
+struct cfg_dir_scan {
+    const char                 *path;       /* the included directory */
+    const struct cfg_pattern   *pattern;
+    struct cfg_dir_file        *files;
+    size_t                      count;
+    size_t                      alloc;
+    struct cfg_dir_subdir      *dirs;       /* scanned in order of discovery */
+    size_t                      ndirs;
+    size_t                      dirs_alloc;
+    struct str_buf              paths;      /* null separated file paths */
+    struct str_buf              names;      /* null separated subdirectories */
+    struct str_buf              rel;        /* directory being scanned */
+    struct str_buf              full;       /* its full path */
+};
+
+static int
+cfg_dir_add_file(struct cfg_dir_scan *scan, struct cfg_ctx *ctx, int dirfd,
+                 const char *name)
+{
+    struct cfg_dir_file *tmp;
+    size_t               offset = scan->paths.len;
+
+    if (scan->count == scan->alloc) {
+        scan->alloc = 0 == scan->alloc ? 16 : scan->alloc * 2;
+
+        if (NULL == (tmp = realloc(scan->files,
+                                   scan->alloc * sizeof(*scan->files)))) {
+            LOG_ERR("cannot allocate file list of directory [%s]", scan->path);
+            return FAIL;
+        }
+        scan->files = tmp;
+    }
+
+    /* paths are resolved once the buffer does not move anymore */
+    if (SUCCEED != str_buf_printf(&scan->paths, "%s/%s%s%s%c", scan->path,
+                                  scan->rel.data, 0 == scan->rel.len ? "" : "/",
+                                  name, '\0')) {
+        LOG_ERR("cannot allocate file list of directory [%s]", scan->path);
+        return FAIL;
+    }
+
+    memset(&scan->files[scan->count], 0, sizeof(*scan->files));
+    scan->files[scan->count].offset = offset;
+    scan->files[scan->count].dirfd = dirfd;
+    scan->files[scan->count].timed = NULL != ctx->stats;
+#ifdef HAVE_IO_URING
+    scan->files[scan->count].io = CFG_DIR_PENDING;
+    scan->files[scan->count].fd = -1;
+#endif
+    scan->files[scan->count++].status = CFG_DIR_PENDING;
+
+    if (NULL != ctx->stats)
+        ctx->stats->dir_matches++;
+
+    return SUCCEED;
+}
+
+static int
+cfg_dir_add_subdir(struct cfg_dir_scan *scan, const char *name,
+                   cfg_pattern_set set)
+{
+    struct cfg_dir_subdir   *tmp;
+    size_t                   offset = scan->names.len;
+
+    if (scan->ndirs == scan->dirs_alloc) {
+        scan->dirs_alloc = 0 == scan->dirs_alloc ? 16 : scan->dirs_alloc * 2;
+
+        if (NULL == (tmp = realloc(scan->dirs,
+                                   scan->dirs_alloc * sizeof(*scan->dirs)))) {
+            LOG_ERR("cannot allocate subdirectory list of directory [%s]",
+                    scan->path);
+            return FAIL;
+        }
+        scan->dirs = tmp;
+    }
+
+    if (SUCCEED != str_buf_printf(&scan->names, "%s%s%s%c", scan->rel.data,
+                                  0 == scan->rel.len ? "" : "/", name, '\0')) {
+        LOG_ERR("cannot allocate subdirectory list of directory [%s]",
+                scan->path);
+        return FAIL;
+    }
+
+    scan->dirs[scan->ndirs].name = offset;
+    scan->dirs[scan->ndirs++].set = set;
+
+    return SUCCEED;
+}
+
+/**
+ * Collect files and subdirectories of a directory matching the pattern
+ *
+ * @param scan
+ *   [IN/OUT] matches so far, rel is the path of the directory relative to
+ *   the included one, "" for itself
+ * @param ctx
+ *   [IN] parsing context
+ * @param dir
+ *   [IN] directory being scanned
+ * @param basefd
+ *   [IN] the included directory, files are opened relative to it
+ * @param set
+ *   [IN] pattern components matching in the directory
+ *
+ * @return
+ *   SUCCEED - scanned successfully
+ *   FAIL - out of memory
+ */
+static int
+cfg_dir_scan(struct cfg_dir_scan *scan, struct cfg_ctx *ctx, DIR *dir,
+             int basefd, cfg_pattern_set set)
+{
+    struct dirent   *d;
+    struct stat      sb;
+    cfg_pattern_set  sub;
+    mode_t           mode;
+    int              file, link;
+
+    while (NULL != (d = readdir(dir))) {
+        if (NULL != ctx->stats)
+            ctx->stats->dir_entries++;
+
+        if ('.' == d->d_name[0] && ('\0' == d->d_name[1] ||
+                                    ('.' == d->d_name[1] && '\0' == d->d_name[2])))
+            continue;
+
+        file = SUCCEED == cfg_pattern_match_file(scan->pattern, set, d->d_name);
+        sub = cfg_pattern_match_dir(scan->pattern, set, d->d_name, 0);
+
+        if (0 == file && 0 == sub)
+            continue;
+
+        link = 0;
+
+        switch (d->d_type) {
+        case DT_REG:
+            mode = S_IFREG;
+            break;
+        case DT_DIR:
+            mode = S_IFDIR;
+            break;
+        case DT_UNKNOWN:
+            if (0 != fstatat(dirfd(dir), d->d_name, &sb, AT_SYMLINK_NOFOLLOW))
+                continue;
+
+            if (0 == S_ISLNK(sb.st_mode)) {
+                mode = sb.st_mode & S_IFMT;
+                break;
+            }
+            /* fall through */
+        case DT_LNK:
+            /* symbolic links are followed like open() does */
+            if (0 != fstatat(dirfd(dir), d->d_name, &sb, 0))
+                continue;
+
+            mode = sb.st_mode & S_IFMT;
+            link = 1;
+            break;
+        default:
+            continue;
+        }
 
-        goto trim;
-    }
+        if (S_ISREG(mode) && 0 != file) {
+            if (SUCCEED != cfg_dir_add_file(scan, ctx, basefd, d->d_name))
+                return FAIL;
+        }
+        else if (S_ISDIR(mode) && 0 != sub) {
+            if (0 != link &&
+                0 == (sub = cfg_pattern_match_dir(scan->pattern, set,
+                                                  d->d_name, 1)))
+                continue;
 
-    if (NULL != strchr(p + 1, PATH_SEPARATOR)) {
-        LOG_ERR("%s: glob pattern should be the last component of the path\n",
-                glob);
-        return FAIL;
+            if (SUCCEED != cfg_dir_add_subdir(scan, d->d_name, sub))
+                return FAIL;
+        }
     }
 
-    do {
-        if (glob == p) {
-            LOG_ERR("%s: path should be absolute\n", glob);
-            return FAIL;
-        }
+    return SUCCEED;
+}
 
-        p--;
+/**
+ * Scan a subdirectory of an included directory
+ *
+ * @return
+ *   SUCCEED - scanned successfully
+ *   FAIL - subdirectory cannot be read or out of memory
+ */
+static int
+cfg_dir_scan_subdir(struct cfg_dir_scan *scan, struct cfg_ctx *ctx, int dirfd,
+                    const struct cfg_dir_subdir *sub)
+{
+    DIR     *dir;
+    int      fd, ret;
+
+    /* names may grow while the subdirectory is scanned, copy its path */
+    str_buf_reset(&scan->rel);
+    str_buf_reset(&scan->full);
+
+    if (SUCCEED != str_buf_append(&scan->rel, scan->names.data + sub->name) ||
+        SUCCEED != str_buf_printf(&scan->full, "%s/%s", scan->path,
+                                  scan->rel.data)) {
+        LOG_ERR("cannot allocate subdirectory list of directory [%s]",
+                scan->path);
+        return FAIL;
     }
-    while (PATH_SEPARATOR != *p)
-        ;
 
-    *path = str_strdup(glob);
-    if (NULL == *path) {
+    if (SUCCEED != cfg_record_dir(ctx, scan->full.data, scan->pattern,
+                                  sub->set))
         return FAIL;
-    }
-    (*path)[p - glob] = '\0';
 
-    *pattern = str_strdup(p + 1);
-    if (NULL == *pattern) {
-        free(*path);
+    if (-1 == (fd = openat(dirfd, scan->rel.data, O_RDONLY | O_DIRECTORY |
+                           O_CLOEXEC)))
         return FAIL;
-    }
 
-trim:
-    if (0 != str_rtrim(*path, "/") && NULL == *pattern) {
-        *pattern = str_strdup("*");   /* make sure path is a directory */
-        if (NULL == *pattern) {
-            free(*path);
-            return FAIL;
-        }
+    if (NULL == (dir = fdopendir(fd))) {
+        close(fd);
+        return FAIL;
     }
 
-    if ('\0' == (*path)[0] && '/' == glob[0]) {
-        /* retain forward slash for "/" */
+    ret = cfg_dir_scan(scan, ctx, dir, dirfd, sub->set);
 
-        (*path)[0] = '/';
-        (*path)[1] = '\0';
-    }
+    if (0 != closedir(dir))
+        ret = FAIL;
 
-    return SUCCEED;
+    return ret;
 }
 
 /**
@@ -173,56 +2246,90 @@ trim:
  *   full path to directory
  * @param pattern
  *   pattern that files in the directory should match
- * @param cfg
- *   pointer to configuration parameter structure
+ * @param ctx
+ *   parsing context
  * @param level
  *   a level of included file
- * @param strict
- *   treat unknown parameters as error
+ * @param required
+ *   fail if no file matches, for patterns without "*" that name files
  *
  * @return
  *   SUCCEED - parsed successfully
  *   FAIL - error processing directory
+ *
+ * @comments
+ *   files are parsed in the order of their paths relative to the directory;
+ *   entries are matched against the pattern before anything else, the file
+ *   type is taken from readdir() where the file system provides it and files
+ *   are opened relative to the directory, so no path is resolved more than
+ *   once
  */
 static int
-parse_cfg_dir(const char *path, const char *pattern, struct cfg_line *cfg,
-              int level, int strict)
+parse_cfg_dir(const char *path, const struct cfg_pattern *pattern,
+              struct cfg_ctx *ctx, int level, int required)
 {
-    DIR             *dir;
-    struct dirent   *d;
-    struct stat      sb;
-    char            *file = NULL;
-    int              ret = FAIL;
+    DIR                 *dir;
+    struct cfg_dir_scan  scan;
+    size_t               i, len;
+    int                  ret = FAIL, dirfd;
+
+    memset(&scan, 0, sizeof(scan));
+    scan.path = path;
+    scan.pattern = pattern;
+    str_buf_init(&scan.paths);
+    str_buf_init(&scan.names);
+    str_buf_init(&scan.rel);
+    str_buf_init(&scan.full);
+
+    if (SUCCEED != cfg_record_dir(ctx, path, pattern,
+                                  cfg_pattern_start(pattern)))
+        goto out;
+
+    if (-1 == (dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)))
+        goto out;
 
-    if (NULL == (dir = opendir(path))) {
+    if (NULL == (dir = fdopendir(dirfd))) {
+        close(dirfd);
         goto out;
     }
 
-    while (NULL != (d = readdir(dir))) {
-        file = str_dsprintf(file, "%s/%s", path, d->d_name);
+    ret = cfg_dir_scan(&scan, ctx, dir, dirfd, cfg_pattern_start(pattern));
 
-        if (0 != stat(file, &sb) || 0 == S_ISREG(sb.st_mode))
-            continue;
+    /* subdirectories are queued while scanning, so the queue may grow */
+    for (i = 0; SUCCEED == ret && i < scan.ndirs; i++)
+        ret = cfg_dir_scan_subdir(&scan, ctx, dirfd, &scan.dirs[i]);
 
-        if (NULL != pattern && SUCCEED != match_glob(d->d_name, pattern))
-            continue;
+    if (SUCCEED == ret && 0 != required && 0 == scan.count) {
+        LOG_ERR("no config file in [%s] matches the include pattern", path);
+        ret = FAIL;
+    }
+
+    if (SUCCEED == ret) {
+        len = strlen(path);
+
+        for (i = 0; i < scan.count; i++) {
+            scan.files[i].path = scan.paths.data + scan.files[i].offset;
+            scan.files[i].name = scan.files[i].path + len + 1;
+        }
+
+        if (0 != scan.count)
+            qsort(scan.files, scan.count, sizeof(*scan.files),
+                  cfg_dir_file_compare);
 
-        if (SUCCEED != __parse_cfg_file(file, cfg, level, CFG_FILE_REQUIRED,
-                                        strict))
-            goto close;
+        ret = cfg_dir_parse_files(scan.files, scan.count, ctx, level);
     }
 
-    ret = SUCCEED;
-close:
     if (0 != closedir(dir)) {
         ret = FAIL;
     }
-
-    if (NULL != file) {
-        free(file);
-    }
-
 out:
+    free(scan.files);
+    free(scan.dirs);
+    str_buf_free(&scan.paths);
+    str_buf_free(&scan.names);
+    str_buf_free(&scan.rel);
+    str_buf_free(&scan.full);
+
     return ret;
 }
 
@@ -231,22 +2338,21 @@ out:
  *
  * @param cfg_file
  *   full name of config file
- * @param cfg
- *   pointer to configuration parameter structure
+ * @param ctx
+ *   parsing context
  * @param level
  *   a level of included file
- * @param strict
- *   treat unknown parameters as error
  *
  * @return
  *   SUCCEED - parsed successfully
  *   FAIL - error processing object
  */
-static int  parse_cfg_object(const char *cfg_file, struct cfg_line *cfg,
-                             int level, int strict)
+static int  parse_cfg_object(const char *cfg_file, struct cfg_ctx *ctx,
+                             int level)
 {
     int ret = FAIL;
     char *path = NULL, *pattern = NULL;
+    struct cfg_pattern *compiled = NULL;
     struct stat  sb;
 
     if (SUCCEED != parse_glob(cfg_file, &path, &pattern))
@@ -258,7 +2364,7 @@ static int  parse_cfg_object(const char *cfg_file, struct cfg_line *cfg,
 
     if (0 == S_ISDIR(sb.st_mode)) {
         if (NULL == pattern) {
-            ret = __parse_cfg_file(path, cfg, level, CFG_FILE_REQUIRED, strict);
+            ret = __parse_cfg_file(path, ctx, level, CFG_FILE_REQUIRED);
             goto clean;
         }
 
@@ -266,8 +2372,23 @@ static int  parse_cfg_object(const char *cfg_file, struct cfg_line *cfg,
         goto clean;
     }
 
-    ret = parse_cfg_dir(path, pattern, cfg, level, strict);
+    /* the pattern is compiled once for all entries of the directory tree */
+    if (NULL == (compiled = cfg_pattern_compile(NULL != pattern ? pattern :
+                                                "*")))
+        goto clean;
+
+    /* the result tells the watcher which names of the directories count */
+    if (SUCCEED != cfg_keep_pattern(ctx, compiled))
+        goto clean;
+
+    /* like a missing file, "?" and "[" alone do not make it optional */
+    ret = parse_cfg_dir(path, compiled, ctx, level, NULL != pattern &&
+                        NULL == strchr(pattern, '*'));
+
+    if (NULL != ctx->result)
+        compiled = NULL;
 clean:
+    cfg_pattern_free(compiled);
     free(pattern);
     free(path);
 
@@ -279,121 +2400,44 @@ clean:
  *
  * @param cfg_file
  *   full name of config file
- * @param cfg
- *   pointer to configuration parameter structure
+ * @param ctx
+ *   parsing context
  * @param level
  *   a level of included file
  * @param optional
  *   do not treat missing configuration file as error
- * @param strict
- *   treat unknown parameters as error
  *
  * @return
  *  SUCCEED - parsed successfully
  *  FAIL - error processing config file
  */
 static int
-__parse_cfg_file(const char *cfg_file, struct cfg_line *cfg, int level,
-                 int optional, int strict)
+__parse_cfg_file(const char *cfg_file, struct cfg_ctx *ctx, int level,
+                 int optional)
 {
-#define MAX_INCLUDE_LEVEL   10
+    struct cfg_line *cfg = ctx->cfg;
+    struct cfg_frag *frag;
+    int i, rc;
 
-#define CFG_LTRIM_CHARS "\t "
-#define CFG_RTRIM_CHARS CFG_LTRIM_CHARS "\r\n"
-
-    FILE *file;
-    int i, lineno, param_valid;
-    char line[MAX_STRING_LEN], *parameter, *value;
-    uint64_t    var;
     if (++level > MAX_INCLUDE_LEVEL) {
         LOG_ERR("Recursion detected! Skipped processing of '%s'.", cfg_file);
         return FAIL;
     }
 
     if (NULL != cfg_file) {
-        if (NULL == (file = fopen(cfg_file, "r")))
-            goto cannot_open;
-
-        for (lineno = 1; NULL != fgets(line, sizeof(line), file); lineno++) {
-            str_ltrim(line, CFG_LTRIM_CHARS);
-            str_rtrim(line, CFG_RTRIM_CHARS);
-
-            if ('#' == *line || '\0' == *line)
-                continue;
+        if (SUCCEED != cfg_record_source(ctx, cfg_file, 0))
+            goto error;
 
-            /* we only support UTF-8 characters in the config file */
-            if (SUCCEED != str_is_utf8(line))
-                goto non_utf8;
+        cfg_file = cfg_recorded_file(ctx, cfg_file);
 
-            parameter = line;
-            if (NULL == (value = strchr(line, '=')))
-                goto non_key_value;
-
-            *value++ = '\0';
-
-            str_rtrim(parameter, CFG_RTRIM_CHARS);
-            str_ltrim(value, CFG_LTRIM_CHARS);
-
-            if (0 == strcmp(parameter, "Include")) {
-                if (FAIL == parse_cfg_object(value, cfg, level, strict)) {
-                    fclose(file);
-                    goto error;
-                }
-
-                continue;
-            }
-
-            param_valid = 0;
-
-            for (i = 0; NULL != cfg[i].parameter; i++) {
-                if (0 != strcmp(cfg[i].parameter, parameter))
-                    continue;
-
-                param_valid = 1;
-
-                switch (cfg[i].type) {
-                case TYPE_INT:
-                    if (FAIL == str2uint64(value, "KMGT", &var))
-                        goto incorrect_config;
-
-                    if (cfg[i].min > var ||
-                        (0 != cfg[i].max && var > cfg[i].max))
-                        goto incorrect_config;
-
-                    *((int *)cfg[i].variable) = (int)var;
-                    break;
-                case TYPE_STRING_LIST:
-                    str_trim_str_list(value, ',');
-                    /* break; is not missing here */
-                case TYPE_STRING:
-                    *((char **)cfg[i].variable) = str_strdup(value);
-                    if (NULL == *((char **)cfg[i].variable)) {
-                        goto copy_str_error;
-                    }
-                    break;
-                case TYPE_MULTISTRING:
-                    if (SUCCEED != str_strarr_add(cfg[i].variable, value)) {
-                        goto copy_str_error;
-                    }
-                    break;
-                case TYPE_UINT64:
-                    if (FAIL == str2uint64(value, "KMGT", &var))
-                        goto incorrect_config;
-
-                    if (cfg[i].min > var || (0 != cfg[i].max && var > cfg[i].max))
-                        goto incorrect_config;
-
-                    *((uint64_t *)cfg[i].variable) = var;
-                    break;
-                default:
-                    break;
-                }
-            }
+        if (CFG_NO_FILE == (rc = cfg_frag_load(ctx->frags, AT_FDCWD, cfg_file,
+                                               cfg_file, NULL != ctx->stats,
+                                               &frag)))
+            goto cannot_open;
 
-            if (0 == param_valid && CFG_STRICT == strict)
-                goto unknown_parameter;
-        }
-        fclose(file);
+        if (SUCCEED != rc || SUCCEED != cfg_frag_apply(ctx, frag, cfg_file,
+                                                       level))
+            goto error;
     }
 
     if (1 != level) /* skip mandatory parameters check for included files */
@@ -407,11 +2451,23 @@ __parse_cfg_file(const char *cfg_file, struct cfg_line *cfg, int level,
 
         switch (cfg[i].type) {
         case TYPE_INT:
+            if (NULL != ctx->lazy) {
+                if (SUCCEED != cfg_lazy_present(ctx, i))
+                    goto missing_mandatory;
+                break;
+            }
+
             if (0 == *((int *)cfg[i].variable))
                 goto missing_mandatory;
             break;
         case TYPE_STRING:
         case TYPE_STRING_LIST:
+            if (NULL != ctx->lazy) {
+                if (SUCCEED != cfg_lazy_present(ctx, i))
+                    goto missing_mandatory;
+                break;
+            }
+
             if (NULL == (*(char **)cfg[i].variable))
                 goto missing_mandatory;
             break;
@@ -425,31 +2481,6 @@ cannot_open:
     if (0 != optional)
         return SUCCEED;
     goto error;
-non_utf8:
-    fclose(file);
-    LOG_ERR("non-UTF-8 character at line %d (%s) in config file [%s]", lineno,
-            line, cfg_file);
-    goto error;
-copy_str_error:
-    fclose(file);
-    LOG_ERR("copying string failed at line [%s] in config file [%s], line %d",
-            line, cfg_file, lineno);
-    goto error;
-non_key_value:
-    fclose(file);
-    LOG_ERR("invalid entry [%s] (not following \"parameter=value\" notation) "
-            "in config file [%s], line %d", line, cfg_file, lineno);
-    goto error;
-incorrect_config:
-    fclose(file);
-    LOG_ERR("wrong value of [%s] in config file [%s], line %d",
-            cfg[i].parameter, cfg_file, lineno);
-    goto error;
-unknown_parameter:
-    fclose(file);
-    LOG_ERR("unknown parameter [%s] in config file [%s], line %d",
-            parameter, cfg_file, lineno);
-    goto error;
 
 missing_mandatory:
     LOG_ERR("missing mandatory parameter [%s] in config file [%s]",
@@ -458,6 +2489,72 @@ error:
     return FAIL;
 }
 
+/**
+ * Parse top-level configuration file with a prepared context
+ *
+ * @param cfg_file
+ *   full name of config file
+ * @param ctx
+ *   parsing context with parameter table and options filled in
+ * @param optional
+ *   do not treat missing configuration file as error
+ *
+ * @return
+ *  SUCCEED - parsed successfully
+ *  FAIL - error processing config file
+ */
+static int
+parse_cfg_top(const char *cfg_file, struct cfg_ctx *ctx, int optional)
+{
+    struct cfg_frags frags;
+    size_t n;
+    int ret = FAIL;
+
+    /* values of a lazy parse are only stored once they are read */
+    if (NULL != ctx->result && NULL == ctx->lazy) {
+        for (n = 0; NULL != ctx->cfg[n].parameter; n++)
+            ;
+
+        if (NULL == (ctx->result->assigned = calloc(n + 1, 1))) {
+            LOG_ERR("cannot allocate parse result");
+            return FAIL;
+        }
+    }
+
+    if (SUCCEED != cfg_frags_init(&frags))
+        return FAIL;
+
+    ctx->frags = &frags;
+    str_buf_init(&ctx->key);
+
+    if (SUCCEED == cfg_index_build(&ctx->index, ctx->cfg))
+        ret = __parse_cfg_file(cfg_file, ctx, 0, optional);
+
+    str_buf_free(&ctx->key);
+
+    /* values recorded by a lazy parse point into the files */
+    if (SUCCEED != cfg_frags_destroy(&frags, SUCCEED == ret ? ctx->lazy :
+                                     NULL))
+        ret = FAIL;
+
+    /* a lazy parse looks parameters up again when they are read */
+    if (NULL != ctx->lazy)
+        ctx->lazy->index = ctx->index;
+    else
+        cfg_index_free(&ctx->index);
+
+    return ret;
+}
+
+int cfg_set_io(int io)
+{
+    int old = cfg_io;
+
+    cfg_io = io;
+
+    return old;
+}
+
 /**
  * Parse configuration file
  *
@@ -476,5 +2573,264 @@ error:
  */
 int parse_cfg_file(const char *cfg_file, struct cfg_line *cfg, int optional, int strict)
 {
-    return __parse_cfg_file(cfg_file, cfg, 0, optional, strict);
+    struct cfg_ctx  ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.cfg = cfg;
+    ctx.strict = strict;
+
+    return parse_cfg_top(cfg_file, &ctx, optional);
+}
+
+int parse_cfg_file_ex(const char *cfg_file, struct cfg_line *cfg, int optional,
+                      int strict, struct cfg_result **result)
+{
+    return parse_cfg_file_stats(cfg_file, cfg, optional, strict, result, NULL);
+}
+
+int parse_cfg_file_stats(const char *cfg_file, struct cfg_line *cfg,
+                         int optional, int strict, struct cfg_result **result,
+                         struct cfg_stats *stats)
+{
+    struct cfg_ctx  ctx;
+    uint64_t        start = 0;
+    int             ret;
+
+    if (NULL != stats) {
+        memset(stats, 0, sizeof(*stats));
+        start = cfg_now_ns();
+    }
+
+    if (NULL == (*result = cfg_result_create())) {
+        LOG_ERR("cannot allocate parse result");
+        return FAIL;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.cfg = cfg;
+    ctx.strict = strict;
+    ctx.arena = (*result)->arena;
+    ctx.result = *result;
+    ctx.stats = stats;
+
+    ret = parse_cfg_top(cfg_file, &ctx, optional);
+
+    if (NULL != stats) {
+        stats->allocs = (*result)->arena->allocs;
+        stats->alloc_bytes = (*result)->arena->bytes;
+        stats->file_stats = (*result)->file_stats;
+        stats->nfile_stats = (*result)->nfile_stats;
+        stats->total_ns = cfg_now_ns() - start;
+    }
+
+    return ret;
+}
+
+int parse_cfg_file_lazy(const char *cfg_file, struct cfg_line *cfg,
+                        int optional, int strict, struct cfg_result **result)
+{
+    struct cfg_ctx   ctx;
+    struct cfg_lazy *lazy;
+    size_t           n, i;
+
+    if (NULL == (*result = cfg_result_create())) {
+        LOG_ERR("cannot allocate parse result");
+        return FAIL;
+    }
+
+    for (n = 0; NULL != cfg[n].parameter; n++)
+        ;
+
+    if (NULL == (lazy = calloc(1, sizeof(*lazy))) ||
+        NULL == (lazy->values = calloc(n + 1, sizeof(*lazy->values)))) {
+        LOG_ERR("cannot allocate index for %zu parameters", n);
+        free(lazy);
+        return FAIL;
+    }
+
+    lazy->cfg = cfg;
+    (*result)->lazy = lazy;
+
+    for (i = 0; i < n; i++)
+        lazy->values[i].state = CFG_LAZY_PENDING;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.cfg = cfg;
+    ctx.strict = strict;
+    ctx.arena = (*result)->arena;
+    ctx.result = *result;
+    ctx.lazy = lazy;
+
+    lazy->status = parse_cfg_top(cfg_file, &ctx, optional);
+
+    return lazy->status;
+}
+
+int cfg_lazy_get(struct cfg_result *result, const char *parameter)
+{
+    struct cfg_lazy        *lazy = result->lazy;
+    struct cfg_lazy_value  *v;
+    struct cfg_lazy_span   *span;
+    struct cfg_ctx          ctx;
+    int                     i;
+
+    if (NULL == lazy || SUCCEED != lazy->status) {
+        LOG_ERR("cannot read parameter [%s] of a failed or not lazy parse",
+                parameter);
+        return FAIL;
+    }
+
+    i = cfg_index_find(&lazy->index, lazy->cfg, parameter, strlen(parameter));
+
+    if (-1 == i) {
+        LOG_ERR("unknown parameter [%s]", parameter);
+        return FAIL;
+    }
+
+    v = &lazy->values[i];
+
+    if (CFG_LAZY_PENDING != v->state)
+        return v->state;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.cfg = lazy->cfg;
+    ctx.index = lazy->index;
+    ctx.arena = result->arena;
+    ctx.result = result;
+
+    v->state = SUCCEED;
+
+    for (span = v->first; NULL != span && SUCCEED == v->state;
+         span = span->next)
+        v->state = cfg_apply_value(&ctx, i, &span->tok, span->file);
+
+    return v->state;
+}
+
+int parse_cfg_file_all(const char *cfg_file, struct cfg_line *cfg,
+                       int optional, int strict, struct cfg_result **result)
+{
+    struct cfg_ctx  ctx;
+    struct cfg_kv  *kv;
+
+    if (NULL == (*result = cfg_result_create())) {
+        LOG_ERR("cannot allocate parse result");
+        return FAIL;
+    }
+
+    if (NULL == (kv = malloc(sizeof(*kv)))) {
+        LOG_ERR("cannot allocate parameter store");
+        goto fail;
+    }
+
+    if (SUCCEED != cfg_kv_init(kv, (*result)->arena)) {
+        free(kv);
+        goto fail;
+    }
+
+    (*result)->kv = kv;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.cfg = cfg;
+    ctx.strict = strict;
+    ctx.arena = (*result)->arena;
+    ctx.result = *result;
+    ctx.kv = kv;
+
+    if (SUCCEED != parse_cfg_top(cfg_file, &ctx, optional))
+        return FAIL;
+
+    return cfg_kv_index(kv);
+fail:
+    /* a result without the store would look like one of parse_cfg_file_ex() */
+    cfg_free(*result);
+    *result = NULL;
+
+    return FAIL;
+}
+
+static void
+cfg_lazy_free(struct cfg_lazy *lazy)
+{
+    size_t  i;
+
+    if (NULL == lazy)
+        return;
+
+    for (i = 0; i < lazy->nbufs; i++)
+        cfg_buf_release(&lazy->bufs[i]);
+
+    cfg_index_free(&lazy->index);
+    free(lazy->bufs);
+    free(lazy->values);
+    free(lazy);
+}
+
+struct cfg_result *cfg_result_create(void)
+{
+    struct cfg_result *result;
+
+    if (NULL == (result = calloc(1, sizeof(*result))) ||
+        NULL == (result->arena = arena_create()) ||
+        SUCCEED != str_strarr_init(&result->files) ||
+        SUCCEED != str_strarr_init(&result->dirs)) {
+        cfg_free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+void cfg_free(struct cfg_result *result)
+{
+    if (NULL == result)
+        return;
+
+    if (NULL != result->image)
+        munmap(result->image, result->image_size);
+
+    cfg_lazy_free(result->lazy);
+
+    if (NULL != result->kv) {
+        cfg_kv_destroy(result->kv);
+        free(result->kv);
+    }
+    while (0 != result->npatterns)
+        cfg_pattern_free(result->patterns[--result->npatterns]);
+
+    arena_destroy(result->arena);
+    str_strarr_free(result->files);
+    str_strarr_free(result->dirs);
+    free(result->globs);
+    free(result->patterns);
+    free(result->assigned);
+    free(result->file_stats);
+    free(result);
+}
+
+char **cfg_result_files(const struct cfg_result *result)
+{
+    return result->files;
+}
+
+char **cfg_result_dirs(const struct cfg_result *result)
+{
+    return result->dirs;
+}
+
+int cfg_result_dir_match(const struct cfg_result *result, size_t dir,
+                         const char *name)
+{
+    const struct cfg_dir_glob   *g;
+
+    if (dir >= result->nglobs)
+        return SUCCEED;
+
+    g = &result->globs[dir];
+
+    if (SUCCEED == cfg_pattern_match_file(g->pattern, g->set, name) ||
+        0 != cfg_pattern_match_dir(g->pattern, g->set, name, 0))
+        return SUCCEED;
+
+    return FAIL;
 }
@@ -29,6 +29,17 @@
 #define CFG_NOT_STRICT      0
 #define CFG_STRICT          1
 
+/* how files matched by an "Include=" glob are read, see cfg_set_io() */
+#define CFG_IO_SYNC         0
+#define CFG_IO_URING        1
+
+/*
+ * deepest level of "Include=..." nesting, the main file is level 1; a file
+ * including itself is rejected at once, files are told apart by device and
+ * inode, so symbolic links and overlapping globs lead to the same file
+ */
+#define MAX_INCLUDE_LEVEL   10
+
 #ifndef S_ISREG
 #	define S_ISREG(x) (((x) & S_IFMT) == S_IFREG)
 #endif
@@ -40,11 +51,21 @@
 #ifndef LOG_ERR
 #define LOG_ERR(f, arg...)                                              \
     do {                                                                \
-        fprintf(stderr, "["__FILE__"][%s:%d]: "f"\n",                   \
+        fprintf(stderr, "[" __FILE__ "][%s:%d]: " f "\n",               \
                 __func__, __LINE__, ##arg);                             \
     } while (0)
 #endif
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Parameters after a "[section]" line are named "section.parameter" until
+ * the next section, "[]" or the end of the file, so cfg entries of sections
+ * are listed as e.g. "db.replica.host"; dotted names can also be set
+ * directly without a section
+ */
 struct cfg_line {
     const char *parameter;
     void       *variable;
@@ -54,7 +75,291 @@ struct cfg_line {
     uint64_t    max;
 };
 
+/* result of a parse_cfg_file_ex() run, owns memory of parsed string values */
+struct cfg_result;
+
+/* statistics of one configuration file */
+struct cfg_file_stats {
+    const char *path;
+    int         depth;      /* include level, the main file is 1 */
+    uint64_t    bytes;
+    uint64_t    lines;
+    uint64_t    ns;         /* wall time, including the files it includes */
+};
+
+/* statistics of a parse_cfg_file_stats() run */
+struct cfg_stats {
+    uint64_t    files;          /* files read */
+    uint64_t    replayed;       /* includes of files read before, not read again */
+    uint64_t    bytes;          /* bytes read */
+    uint64_t    lines;
+    uint64_t    comment_lines;
+    uint64_t    blank_lines;
+    int         max_depth;      /* deepest include level reached */
+    uint64_t    dir_entries;    /* entries of included directories scanned */
+    uint64_t    dir_matches;    /* of them regular files matching the glob */
+    uint64_t    allocs;         /* string values allocated */
+    uint64_t    alloc_bytes;
+    uint64_t    utf8_ns;        /* validating values with non-ASCII text */
+    uint64_t    numeric_ns;     /* converting TYPE_INT and TYPE_UINT64 */
+    uint64_t    total_ns;
+    struct cfg_file_stats *file_stats;  /* in the order files were opened */
+    size_t      nfile_stats;
+};
+
+/**
+ * Choose how the files of included directories are read by later parses
+ *
+ * @param io
+ *   [IN] CFG_IO_URING, the default, to open, stat and read them with
+ *   batches of io_uring requests while the ones read so far are parsed, or
+ *   CFG_IO_SYNC to open and read each file from the thread tokenizing it;
+ *   CFG_IO_URING reads like CFG_IO_SYNC where io_uring is not available
+ *
+ * @return
+ *   the previous choice
+ *
+ * @comments
+ *   Not thread safe, meant to be called before parsing.
+ */
+int cfg_set_io(int io);
+
 int parse_cfg_file(const char *cfg_file, struct cfg_line *cfg, int optional,
                    int strict);
 
+/**
+ * Parse configuration file, string values are allocated from an arena owned
+ * by the returned result instead of separate malloc() calls
+ *
+ * @param cfg_file
+ *   [IN] full name of config file
+ * @param cfg
+ *   [IN] pointer to configuration parameter structure
+ * @param optional
+ *   [IN] do not treat missing configuration file as error
+ * @param strict
+ *   [IN] treat unknown parameters as error
+ * @param result
+ *   [OUT] parse result, set even if parsing fails because some variables
+ *   may already point into it; release it with cfg_free() once the string
+ *   variables of cfg are not used anymore
+ *
+ * @return
+ *  SUCCEED - parsed successfully
+ *  FAIL - error processing config file
+ */
+int parse_cfg_file_ex(const char *cfg_file, struct cfg_line *cfg, int optional,
+                      int strict, struct cfg_result **result);
+
+/**
+ * Parse configuration file like parse_cfg_file_ex() and collect statistics
+ *
+ * @param stats
+ *   [OUT] statistics, also filled in when parsing fails; file_stats stays
+ *   valid until result is released with cfg_free()
+ *
+ * @comments
+ *   Measuring time costs two clock reads per file, per numeric value and
+ *   per value with non-ASCII text, so use parse_cfg_file_ex() when the
+ *   statistics are not needed.
+ */
+int parse_cfg_file_stats(const char *cfg_file, struct cfg_line *cfg,
+                         int optional, int strict, struct cfg_result **result,
+                         struct cfg_stats *stats);
+
+/**
+ * Index configuration file without converting values, a value is converted
+ * into its variable only when cfg_lazy_get() first asks for it
+ *
+ * @param cfg_file
+ *   [IN] full name of config file
+ * @param cfg
+ *   [IN] pointer to configuration parameter structure, it must stay valid
+ *   until the result is released
+ * @param optional
+ *   [IN] do not treat missing configuration file as error
+ * @param strict
+ *   [IN] treat unknown parameters as error
+ * @param result
+ *   [OUT] parse result, keeps the files loaded; release it with cfg_free()
+ *
+ * @return
+ *  SUCCEED - parsed successfully
+ *  FAIL - error processing config file
+ *
+ * @comments
+ *   Lines are split, "Include=..." is followed and unknown parameters are
+ *   reported as by parse_cfg_file_ex(), but values are only checked when
+ *   they are read.  A parameter set more than once takes its last value
+ *   and a mandatory parameter only needs to be present.
+ */
+int parse_cfg_file_lazy(const char *cfg_file, struct cfg_line *cfg,
+                        int optional, int strict, struct cfg_result **result);
+
+/**
+ * Convert the value of a parameter of a lazy parse into its variable, the
+ * conversion is done once and its outcome is remembered
+ *
+ * @param result
+ *   [IN] result of a successful parse_cfg_file_lazy()
+ * @param parameter
+ *   [IN] parameter name as in the cfg table
+ *
+ * @return
+ *  SUCCEED - the variable holds the value, or is left as it is when the
+ *  configuration does not set the parameter
+ *  FAIL - unknown parameter or invalid value
+ *
+ * @comments
+ *   Not thread safe, string values are allocated from the result.
+ */
+int cfg_lazy_get(struct cfg_result *result, const char *parameter);
+
+/**
+ * Parse configuration file like parse_cfg_file_ex() and also keep every
+ * "parameter=value" of it, known to cfg or not, for cfg_get_str(),
+ * cfg_get_uint64() and cfg_get_multi()
+ *
+ * @param cfg
+ *   [IN] pointer to configuration parameter structure, can be empty when
+ *   values are only read through the getters
+ *
+ * @comments
+ *   The result can be shared by any number of readers, the getters do not
+ *   modify it.  Use CFG_NOT_STRICT unless cfg lists every parameter.
+ *   When the parameter store cannot be allocated result is set to NULL.
+ */
+int parse_cfg_file_all(const char *cfg_file, struct cfg_line *cfg,
+                       int optional, int strict, struct cfg_result **result);
+
+/**
+ * Get the last value of a parameter
+ *
+ * @param result
+ *   [IN] result of parse_cfg_file_all()
+ * @param key
+ *   [IN] parameter name
+ * @param value
+ *   [OUT] the value, valid until cfg_free()
+ *
+ * @return
+ *   SUCCEED - the parameter has a value
+ *   FAIL - otherwise
+ */
+int cfg_get_str(const struct cfg_result *result, const char *key,
+                const char **value);
+
+/**
+ * Get the last value of a parameter as 64bit unsigned integer, suffixes
+ * K, M, G and T are accepted
+ *
+ * @return
+ *   SUCCEED - the parameter has a numeric value
+ *   FAIL - otherwise
+ */
+int cfg_get_uint64(const struct cfg_result *result, const char *key,
+                   uint64_t *value);
+
+/**
+ * Get all values of a parameter in the order they were parsed
+ *
+ * @param values
+ *   [OUT] NULL terminated list of values, valid until cfg_free()
+ * @param count
+ *   [OUT] number of values, optional, can be NULL
+ *
+ * @return
+ *   SUCCEED - the parameter has at least one value
+ *   FAIL - otherwise
+ */
+int cfg_get_multi(const struct cfg_result *result, const char *key,
+                  char ***values, size_t *count);
+
+/* called for each parameter found by cfg_get_prefix(), anything but
+   SUCCEED stops the walk */
+typedef int (*cfg_key_cb)(const char *key, char **values, size_t count,
+                          void *arg);
+
+/**
+ * Walk parameters whose names start with a prefix in the order of their
+ * names, e.g. all parameters of section "db.replica" with prefix
+ * "db.replica."
+ *
+ * @param result
+ *   [IN] result of parse_cfg_file_all()
+ * @param prefix
+ *   [IN] name prefix, "" for all parameters
+ * @param cb
+ *   [IN] callback receiving the name and all values of a parameter
+ *
+ * @return
+ *   SUCCEED - every matching parameter was reported, possibly none
+ *   FAIL - result has no parameter store
+ *   value returned by cb if it stopped the walk
+ *
+ * @comments
+ *   Names are kept in a radix trie, so the walk costs the length of the
+ *   prefix plus the number of parameters reported.
+ */
+int cfg_get_prefix(const struct cfg_result *result, const char *prefix,
+                   cfg_key_cb cb, void *arg);
+
+/**
+ * Release all string values of a parse result at once
+ *
+ * @param result
+ *   [IN] result of parse_cfg_file_ex(), can be NULL
+ *
+ * @comments
+ *   TYPE_MULTISTRING arrays are initialized by the caller and stay owned by
+ *   it, only the strings they point to are released; the arrays themselves
+ *   are released by str_strarr_free().
+ */
+void cfg_free(struct cfg_result *result);
+
+/**
+ * Get configuration files a parse has read or tried to read
+ *
+ * @param result
+ *   [IN] result of parse_cfg_file_ex()
+ *
+ * @return
+ *   NULL terminated list of file names, valid until cfg_free()
+ */
+char **cfg_result_files(const struct cfg_result *result);
+
+/**
+ * Get directories a parse has scanned for "Include=..." patterns
+ *
+ * @param result
+ *   [IN] result of parse_cfg_file_ex()
+ *
+ * @return
+ *   NULL terminated list of directory names, valid until cfg_free()
+ */
+char **cfg_result_dirs(const struct cfg_result *result);
+
+/**
+ * See whether a name in an included directory is one the parse would take
+ *
+ * @param result
+ *   [IN] result of parse_cfg_file_ex()
+ * @param dir
+ *   [IN] index of the directory in cfg_result_dirs()
+ * @param name
+ *   [IN] name of an entry of the directory
+ *
+ * @return
+ *   SUCCEED - a file of that name would be parsed or a subdirectory of that
+ *   name searched, or the result does not keep the "Include=..." pattern,
+ *   e.g. one loaded from a cache image
+ *   FAIL - the name does not match the pattern
+ */
+int cfg_result_dir_match(const struct cfg_result *result, size_t dir,
+                         const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* CFG_H */
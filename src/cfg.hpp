@@ -0,0 +1,513 @@
+/*
+ * Copyleft
+ */
+
+#ifndef CFG_HPP
+#define CFG_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cfg.h"
+
+/*
+ * C++17 binding of the configuration parser
+ *
+ * A schema is declared at compile time from pointers to members of a plain
+ * struct and parses straight into it:
+ *
+ *     struct server {
+ *         int                     port = 0;
+ *         std::string_view        host;
+ *         cconf::multistring      alias;
+ *     };
+ *
+ *     constexpr auto schema = cconf::make_schema(
+ *         cconf::param("Port", &server::port, PARM_MAND, 1, 65535),
+ *         cconf::param("Host", &server::host),
+ *         cconf::param("Alias", &server::alias));
+ *
+ *     server          s;
+ *     cconf::result   r;
+ *
+ *     if (SUCCEED != schema.parse("/etc/server.conf", s, r))
+ *         ...
+ *
+ * Member types select the parameter type: int is TYPE_INT, uint64_t is
+ * TYPE_UINT64, std::string_view is TYPE_STRING, cconf::string_list is
+ * TYPE_STRING_LIST and cconf::multistring is TYPE_MULTISTRING.  String values
+ * are views into the memory owned by the result, no std::string is made.
+ */
+namespace cconf {
+
+template <class T, class... P>
+class schema;
+
+/**
+ * Parse result owning the memory of all string values, see cfg_free()
+ */
+class result {
+public:
+    result() noexcept = default;
+    result(const result &) = delete;
+    result &operator=(const result &) = delete;
+
+    result(result &&other) noexcept
+        : res_(std::exchange(other.res_, nullptr)),
+          stored_(std::move(other.stored_))
+    {
+    }
+
+    result &operator=(result &&other) noexcept
+    {
+        if (this != &other) {
+            reset(std::exchange(other.res_, nullptr));
+            stored_ = std::move(other.stored_);
+        }
+        return *this;
+    }
+
+    ~result()
+    {
+        cfg_free(res_);
+    }
+
+    /* release the current values and take over another parse result */
+    void reset(struct cfg_result *res = nullptr) noexcept
+    {
+        cfg_free(std::exchange(res_, res));
+        stored_.clear();
+    }
+
+    struct cfg_result *get() const noexcept
+    {
+        return res_;
+    }
+
+    /* configuration files the parse has read, see cfg_result_files() */
+    char **files() const noexcept
+    {
+        return cfg_result_files(res_);
+    }
+
+    /* directories the parse has scanned, see cfg_result_dirs() */
+    char **dirs() const noexcept
+    {
+        return cfg_result_dirs(res_);
+    }
+
+private:
+    template <class T, class... P>
+    friend class schema;
+
+    /* whether schema::parse() pointed member i into this result */
+    bool stored(std::size_t i) const noexcept
+    {
+        return i < stored_.size() && stored_[i];
+    }
+
+    struct cfg_result  *res_ = nullptr;
+    std::vector<bool>   stored_;    /* by offset in the schema */
+};
+
+/**
+ * TYPE_STRING_LIST value, items are separated by "," with the surrounding
+ * whitespace already removed by the parser
+ */
+class string_list {
+public:
+    class iterator {
+    public:
+        constexpr iterator() noexcept = default;
+
+        constexpr explicit iterator(std::string_view rest) noexcept
+            : rest_(rest), item_(rest.substr(0, rest.find(',')))
+        {
+        }
+
+        constexpr std::string_view operator*() const noexcept
+        {
+            return item_;
+        }
+
+        constexpr iterator &operator++() noexcept
+        {
+            if (item_.size() == rest_.size())
+                rest_ = item_ = std::string_view();
+            else {
+                rest_.remove_prefix(item_.size() + 1);
+                item_ = rest_.substr(0, rest_.find(','));
+            }
+            return *this;
+        }
+
+        constexpr bool operator==(const iterator &other) const noexcept
+        {
+            return rest_.data() == other.rest_.data() &&
+                   rest_.size() == other.rest_.size();
+        }
+
+        constexpr bool operator!=(const iterator &other) const noexcept
+        {
+            return !(*this == other);
+        }
+
+    private:
+        std::string_view    rest_;
+        std::string_view    item_;
+    };
+
+    constexpr string_list() noexcept = default;
+
+    constexpr explicit string_list(std::string_view str) noexcept : str_(str)
+    {
+    }
+
+    /* the whole list as found in the file */
+    constexpr std::string_view str() const noexcept
+    {
+        return str_;
+    }
+
+    constexpr bool empty() const noexcept
+    {
+        return str_.empty();
+    }
+
+    constexpr iterator begin() const noexcept
+    {
+        return str_.empty() ? iterator() : iterator(str_);
+    }
+
+    constexpr iterator end() const noexcept
+    {
+        return iterator();
+    }
+
+private:
+    std::string_view    str_;
+};
+
+/**
+ * TYPE_MULTISTRING value, one entry per occurrence of the parameter
+ */
+class multistring {
+public:
+    class iterator {
+    public:
+        explicit iterator(char **p) noexcept : p_(p)
+        {
+        }
+
+        std::string_view operator*() const noexcept
+        {
+            return *p_;
+        }
+
+        iterator &operator++() noexcept
+        {
+            ++p_;
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const noexcept
+        {
+            return p_ == other.p_;
+        }
+
+        bool operator!=(const iterator &other) const noexcept
+        {
+            return p_ != other.p_;
+        }
+
+    private:
+        char  **p_;
+    };
+
+    multistring() noexcept = default;
+    multistring(const multistring &) = delete;
+    multistring &operator=(const multistring &) = delete;
+
+    multistring(multistring &&other) noexcept
+        : arr_(std::exchange(other.arr_, nullptr))
+    {
+    }
+
+    multistring &operator=(multistring &&other) noexcept
+    {
+        if (this != &other)
+            str_strarr_free(std::exchange(arr_, std::exchange(other.arr_,
+                                                              nullptr)));
+        return *this;
+    }
+
+    ~multistring()
+    {
+        str_strarr_free(arr_);
+    }
+
+    std::size_t size() const noexcept
+    {
+        return nullptr == arr_ ? 0 : str_strarr_count(arr_);
+    }
+
+    bool empty() const noexcept
+    {
+        return 0 == size();
+    }
+
+    iterator begin() const noexcept
+    {
+        return iterator(arr_);
+    }
+
+    iterator end() const noexcept
+    {
+        return iterator(nullptr == arr_ ? arr_ : arr_ + str_strarr_count(arr_));
+    }
+
+    /* NULL terminated array as filled in by the C parser */
+    char **get() const noexcept
+    {
+        return arr_;
+    }
+
+private:
+    template <class T, class... P> friend class schema;
+
+    /* entries of an earlier parse point into its result, start over */
+    int reset() noexcept
+    {
+        str_strarr_free(std::exchange(arr_, nullptr));
+        return str_strarr_init(&arr_);
+    }
+
+    char  **arr_ = nullptr;
+};
+
+namespace detail {
+
+template <class M> struct cfg_type;
+
+template <> struct cfg_type<int> {
+    static constexpr int value = TYPE_INT;
+};
+
+template <> struct cfg_type<uint64_t> {
+    static constexpr int value = TYPE_UINT64;
+};
+
+template <> struct cfg_type<std::string_view> {
+    static constexpr int value = TYPE_STRING;
+};
+
+template <> struct cfg_type<string_list> {
+    static constexpr int value = TYPE_STRING_LIST;
+};
+
+template <> struct cfg_type<multistring> {
+    static constexpr int value = TYPE_MULTISTRING;
+};
+
+/*
+ * Names of a schema, checked for duplicates when the schema is built; the C
+ * parser indexes them again for every parse, lookups here are only for
+ * find()
+ */
+template <std::size_t N>
+class name_set {
+public:
+    constexpr explicit name_set(const std::array<std::string_view, N> &names)
+        : names_(names)
+    {
+        for (std::size_t i = 0; i < N; i++) {
+            for (std::size_t j = 0; j < i; j++) {
+                if (names[i] == names[j])
+                    throw std::logic_error("duplicate parameter name");
+            }
+        }
+    }
+
+    /* offset of a name in the schema or -1 if there is no such parameter */
+    constexpr int find(std::string_view name) const noexcept
+    {
+        for (std::size_t i = 0; i < N; i++) {
+            if (names_[i] == name)
+                return static_cast<int>(i);
+        }
+
+        return -1;
+    }
+
+private:
+    std::array<std::string_view, N> names_{};
+};
+
+} /* namespace detail */
+
+/**
+ * Parameter of a schema bound to a member of T
+ */
+template <class T, class M>
+struct parameter {
+    static constexpr int type = detail::cfg_type<M>::value;
+
+    const char *name;
+    M T::      *member;
+    int         mandatory;
+    uint64_t    min;
+    uint64_t    max;
+};
+
+/**
+ * Declare a parameter, arguments after the member are those of struct
+ * cfg_line
+ */
+template <class T, class M>
+constexpr parameter<T, M>
+param(const char *name, M T::*member, int mandatory = PARM_OPT,
+      uint64_t min = 0, uint64_t max = 0)
+{
+    return parameter<T, M>{name, member, mandatory, min, max};
+}
+
+/**
+ * Configuration schema of struct T, build it with make_schema()
+ */
+template <class T, class... P>
+class schema {
+public:
+    static constexpr std::size_t size = sizeof...(P);
+
+    constexpr explicit schema(const P &... params)
+        : params_(params...), names_(std::array<std::string_view, size>{
+                                         std::string_view(params.name)...})
+    {
+    }
+
+    /**
+     * Parse configuration file into the members of obj
+     *
+     * @param cfg_file
+     *   [IN] full name of config file
+     * @param obj
+     *   [IN/OUT] members get the values found in the file, others are left
+     *   as they are, except string members the parse res held has set:
+     *   they point into it and are cleared
+     * @param res
+     *   [IN/OUT] owner of the string values, replaced even if parsing fails
+     * @param optional
+     *   [IN] do not treat missing configuration file as error
+     * @param strict
+     *   [IN] treat unknown parameters as error
+     *
+     * @return
+     *  SUCCEED - parsed successfully
+     *  FAIL - error processing config file
+     */
+    int parse(const char *cfg_file, T &obj, result &res,
+              int optional = CFG_FILE_REQUIRED, int strict = CFG_STRICT) const
+    {
+        return parse(cfg_file, obj, res, optional, strict,
+                     std::index_sequence_for<P...>());
+    }
+
+    /* offset of a parameter in the schema or -1 if it is not declared */
+    constexpr int find(std::string_view name) const noexcept
+    {
+        return names_.find(name);
+    }
+
+private:
+    template <std::size_t... I>
+    int parse(const char *cfg_file, T &obj, result &res, int optional,
+              int strict, std::index_sequence<I...>) const
+    {
+        struct cfg_line     cfg[size + 1];
+        char               *strings[size + 1] = {};
+        struct cfg_result  *r = nullptr;
+        std::vector<bool>   stored(size);
+        int                 ret;
+
+        if (!((SUCCEED == bind(std::get<I>(params_), obj, cfg[I],
+                               strings[I])) && ...))
+            return FAIL;
+
+        cfg[size] = {nullptr, nullptr, 0, 0, 0, 0};
+
+        ret = parse_cfg_file_ex(cfg_file, cfg, optional, strict, &r);
+
+        /* members are rebound before the strings of the old result go */
+        ((stored[I] = store(std::get<I>(params_), obj, strings[I],
+                            res.stored(I))), ...);
+
+        res.reset(r);
+        res.stored_ = std::move(stored);
+
+        return ret;
+    }
+
+    template <class M>
+    static int bind(const parameter<T, M> &p, T &obj, struct cfg_line &line,
+                    char *&str)
+    {
+        line = {p.name, nullptr, p.type, p.mandatory, p.min, p.max};
+
+        if constexpr (std::is_same_v<M, multistring>) {
+            line.variable = &(obj.*p.member).arr_;
+            return (obj.*p.member).reset();
+        }
+        else if constexpr (std::is_same_v<M, std::string_view> ||
+                           std::is_same_v<M, string_list>) {
+            line.variable = &str;
+        }
+        else
+            line.variable = &(obj.*p.member);
+
+        return SUCCEED;
+    }
+
+    /* returns whether the member now points into the new result */
+    template <class M>
+    static bool store(const parameter<T, M> &p, T &obj, const char *str,
+                      bool stored)
+    {
+        if constexpr (std::is_same_v<M, std::string_view> ||
+                      std::is_same_v<M, string_list>) {
+            if (nullptr != str) {
+                obj.*p.member = M(std::string_view(str));
+                return true;
+            }
+
+            if (stored)
+                obj.*p.member = M();
+        }
+
+        return false;
+    }
+
+    std::tuple<P...>                    params_;
+    detail::name_set<sizeof...(P)>      names_;
+};
+
+/**
+ * Build a schema from parameters of the same struct, declare it constexpr
+ * so that duplicate names are rejected at compile time
+ */
+template <class T, class... M>
+constexpr schema<T, parameter<T, M>...>
+make_schema(const parameter<T, M> &... params)
+{
+    return schema<T, parameter<T, M>...>(params...);
+}
+
+} /* namespace cconf */
+
+#endif /* CFG_HPP */
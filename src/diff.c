@@ -0,0 +1,289 @@
+/*
+ * Copyleft
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "cfg.h"
+#include "kv.h"
+#include "result.h"
+#include "diff.h"
+
+/* initial number of slots, the table is kept at most half full */
+#define SUBS_MIN_SLOTS      16
+
+struct cfg_sub {
+    cfg_diff_cb         cb;
+    void               *arg;
+    struct cfg_sub     *next;
+};
+
+/* subscriptions of one parameter name or prefix */
+struct cfg_sub_key {
+    char               *name;       /* NULL for an empty slot */
+    size_t              len;
+    uint32_t            hash;
+    int                 prefix;
+    struct cfg_sub     *first;      /* in the order of subscribing */
+    struct cfg_sub     *last;
+};
+
+struct cfg_subs {
+    struct cfg_sub_key *slots;
+    size_t              mask;
+    size_t              count;
+    size_t             *lengths;    /* distinct prefix lengths, ascending */
+    size_t              nlengths;
+};
+
+int cfg_diff(const struct cfg_result *prev, const struct cfg_result *next,
+             cfg_diff_cb cb, void *arg)
+{
+    const struct cfg_kv         *from, *to = next->kv;
+    const struct cfg_kv_entry   *e, *o;
+    size_t                       i;
+
+    if (NULL == to)
+        return FAIL;
+
+    from = NULL != prev ? prev->kv : NULL;
+
+    for (i = 0; i <= to->mask; i++) {
+        if (NULL == (e = &to->slots[i])->key)
+            continue;
+
+        if (NULL == from || NULL == (o = cfg_kv_find(from, e->key, e->key_len)))
+            cb(e->key, CFG_KEY_ADDED, NULL, e->values, arg);
+        else if (o->value_hash != e->value_hash || o->count != e->count)
+            cb(e->key, CFG_KEY_CHANGED, o->values, e->values, arg);
+    }
+
+    if (NULL == from)
+        return SUCCEED;
+
+    for (i = 0; i <= from->mask; i++) {
+        if (NULL == (o = &from->slots[i])->key)
+            continue;
+
+        if (NULL == cfg_kv_find(to, o->key, o->key_len))
+            cb(o->key, CFG_KEY_REMOVED, o->values, NULL, arg);
+    }
+
+    return SUCCEED;
+}
+
+int cfg_subs_create(struct cfg_subs **subs)
+{
+    struct cfg_subs *s;
+
+    if (NULL == (s = calloc(1, sizeof(*s))) ||
+        NULL == (s->slots = calloc(SUBS_MIN_SLOTS, sizeof(*s->slots)))) {
+        LOG_ERR("cannot allocate subscriptions");
+        free(s);
+        return FAIL;
+    }
+
+    s->mask = SUBS_MIN_SLOTS - 1;
+    *subs = s;
+
+    return SUCCEED;
+}
+
+/**
+ * Find the slot of a name or the empty slot where it belongs
+ */
+static struct cfg_sub_key *
+subs_slot(struct cfg_sub_key *slots, size_t mask, const char *name,
+          size_t len, uint32_t hash, int prefix)
+{
+    struct cfg_sub_key  *k;
+    size_t               pos;
+
+    for (pos = hash & mask; ; pos = (pos + 1) & mask) {
+        k = &slots[pos];
+
+        if (NULL == k->name || (k->hash == hash && k->prefix == prefix &&
+                                k->len == len && 0 == memcmp(k->name, name,
+                                                             len)))
+            return k;
+    }
+}
+
+static int
+subs_grow(struct cfg_subs *subs)
+{
+    struct cfg_sub_key  *slots, *k;
+    size_t               size = (subs->mask + 1) * 2, i;
+
+    if (NULL == (slots = calloc(size, sizeof(*slots)))) {
+        LOG_ERR("cannot allocate %zu subscription slots", size);
+        return FAIL;
+    }
+
+    for (i = 0; i <= subs->mask; i++) {
+        k = &subs->slots[i];
+
+        if (NULL != k->name)
+            *subs_slot(slots, size - 1, k->name, k->len, k->hash, k->prefix) = *k;
+    }
+
+    free(subs->slots);
+    subs->slots = slots;
+    subs->mask = size - 1;
+
+    return SUCCEED;
+}
+
+/**
+ * Remember a prefix length to look changed names up with
+ */
+static int
+subs_add_length(struct cfg_subs *subs, size_t len)
+{
+    size_t  *tmp, i;
+
+    for (i = 0; i < subs->nlengths && subs->lengths[i] < len; i++)
+        ;
+
+    if (i < subs->nlengths && subs->lengths[i] == len)
+        return SUCCEED;
+
+    if (NULL == (tmp = realloc(subs->lengths,
+                               (subs->nlengths + 1) * sizeof(*tmp)))) {
+        LOG_ERR("cannot allocate subscription prefix lengths");
+        return FAIL;
+    }
+
+    subs->lengths = tmp;
+    memmove(&tmp[i + 1], &tmp[i], (subs->nlengths - i) * sizeof(*tmp));
+    tmp[i] = len;
+    subs->nlengths++;
+
+    return SUCCEED;
+}
+
+static int
+subs_add(struct cfg_subs *subs, const char *name, int prefix, cfg_diff_cb cb,
+         void *arg)
+{
+    struct cfg_sub_key  *k;
+    struct cfg_sub      *sub;
+    size_t               len = strlen(name);
+    uint32_t             hash = str_hash_n(name, len);
+
+    if ((subs->count + 1) * 2 > subs->mask + 1 && SUCCEED != subs_grow(subs))
+        return FAIL;
+
+    if (0 != prefix && SUCCEED != subs_add_length(subs, len))
+        return FAIL;
+
+    if (NULL == (sub = malloc(sizeof(*sub))))
+        goto fail;
+
+    k = subs_slot(subs->slots, subs->mask, name, len, hash, prefix);
+
+    if (NULL == k->name) {
+        if (NULL == (k->name = str_strndup(name, len))) {
+            free(sub);
+            goto fail;
+        }
+
+        k->len = len;
+        k->hash = hash;
+        k->prefix = prefix;
+        subs->count++;
+    }
+
+    sub->cb = cb;
+    sub->arg = arg;
+    sub->next = NULL;
+
+    if (NULL == k->last)
+        k->first = sub;
+    else
+        k->last->next = sub;
+
+    k->last = sub;
+
+    return SUCCEED;
+fail:
+    LOG_ERR("cannot allocate subscription to [%s]", name);
+    return FAIL;
+}
+
+int cfg_subscribe(struct cfg_subs *subs, const char *key, cfg_diff_cb cb,
+                  void *arg)
+{
+    return subs_add(subs, key, 0, cb, arg);
+}
+
+int cfg_subscribe_prefix(struct cfg_subs *subs, const char *prefix,
+                         cfg_diff_cb cb, void *arg)
+{
+    return subs_add(subs, prefix, 1, cb, arg);
+}
+
+static void
+subs_call(const struct cfg_sub_key *k, const char *key, int change,
+          char **old_values, char **new_values)
+{
+    const struct cfg_sub    *sub;
+
+    if (NULL == k->name)
+        return;
+
+    for (sub = k->first; NULL != sub; sub = sub->next)
+        sub->cb(key, change, old_values, new_values, sub->arg);
+}
+
+/**
+ * Invoke subscriptions of a differing parameter, a cfg_diff() callback
+ */
+static void
+subs_dispatch(const char *key, int change, char **old_values,
+              char **new_values, void *arg)
+{
+    const struct cfg_subs   *subs = arg;
+    size_t                   len = strlen(key), i, n;
+
+    subs_call(subs_slot(subs->slots, subs->mask, key, len,
+                        str_hash_n(key, len), 0), key, change, old_values,
+              new_values);
+
+    for (i = 0; i < subs->nlengths && (n = subs->lengths[i]) <= len; i++) {
+        subs_call(subs_slot(subs->slots, subs->mask, key, n,
+                            str_hash_n(key, n), 1), key, change, old_values,
+                  new_values);
+    }
+}
+
+int cfg_subs_notify(struct cfg_subs *subs, const struct cfg_result *prev,
+                    const struct cfg_result *next)
+{
+    return cfg_diff(prev, next, subs_dispatch, subs);
+}
+
+void cfg_subs_destroy(struct cfg_subs *subs)
+{
+    struct cfg_sub  *sub;
+    size_t           i;
+
+    if (NULL == subs)
+        return;
+
+    for (i = 0; i <= subs->mask; i++) {
+        while (NULL != (sub = subs->slots[i].first)) {
+            subs->slots[i].first = sub->next;
+            free(sub);
+        }
+
+        free(subs->slots[i].name);
+    }
+
+    free(subs->slots);
+    free(subs->lengths);
+    free(subs);
+}
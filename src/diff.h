@@ -0,0 +1,121 @@
+/*
+ * Copyleft
+ */
+
+#ifndef DIFF_H
+#define DIFF_H
+
+#include "cfg.h"
+
+/* how a parameter differs between two parse results */
+#define CFG_KEY_ADDED       1
+#define CFG_KEY_REMOVED     2
+#define CFG_KEY_CHANGED     3
+
+/**
+ * Callback for a parameter that differs between two parse results
+ *
+ * @param key
+ *   [IN] parameter name
+ * @param change
+ *   [IN] CFG_KEY_ADDED, CFG_KEY_REMOVED or CFG_KEY_CHANGED
+ * @param old_values
+ *   [IN] NULL terminated values in the older result, NULL if added
+ * @param new_values
+ *   [IN] NULL terminated values in the newer result, NULL if removed
+ * @param arg
+ *   [IN] argument given with the callback
+ */
+typedef void (*cfg_diff_cb)(const char *key, int change, char **old_values,
+                            char **new_values, void *arg);
+
+/* callbacks for changes of single parameters or all under a prefix */
+struct cfg_subs;
+
+/**
+ * Report parameters that differ between two results of parse_cfg_file_all()
+ *
+ * @param prev
+ *   [IN] older result, NULL or a result without parameter store reports
+ *   every parameter of next as added
+ * @param next
+ *   [IN] newer result
+ * @param cb
+ *   [IN] called once for each differing parameter
+ *
+ * @return
+ *   SUCCEED - all differences were reported
+ *   FAIL - next has no parameter store
+ *
+ * @comments
+ *   Parameters are compared by a 64bit hash of all their values kept in the
+ *   store, so the cost is proportional to the number of parameters and not
+ *   to the size of their values.  Values that are equal but repeated a
+ *   different number of times count as changed.
+ */
+int cfg_diff(const struct cfg_result *prev, const struct cfg_result *next,
+             cfg_diff_cb cb, void *arg);
+
+/**
+ * Create an empty set of subscriptions
+ *
+ * @param subs
+ *   [OUT] the set, release it with cfg_subs_destroy()
+ *
+ * @return
+ *   SUCCEED - created
+ *   FAIL - out of memory
+ */
+int cfg_subs_create(struct cfg_subs **subs);
+
+/**
+ * Call cb whenever a parameter changes
+ *
+ * @param key
+ *   [IN] full parameter name, e.g. "db.replica.timeout"
+ *
+ * @return
+ *   SUCCEED - subscribed
+ *   FAIL - out of memory
+ */
+int cfg_subscribe(struct cfg_subs *subs, const char *key, cfg_diff_cb cb,
+                  void *arg);
+
+/**
+ * Call cb for every changed parameter whose name starts with a prefix
+ *
+ * @param prefix
+ *   [IN] name prefix, e.g. "db.replica." for a whole section
+ *
+ * @return
+ *   SUCCEED - subscribed
+ *   FAIL - out of memory
+ */
+int cfg_subscribe_prefix(struct cfg_subs *subs, const char *prefix,
+                         cfg_diff_cb cb, void *arg);
+
+/**
+ * Compare two parse results and invoke the subscriptions of every differing
+ * parameter, those of the exact name first, then prefix ones from the
+ * shortest prefix
+ *
+ * @return
+ *   as cfg_diff()
+ *
+ * @comments
+ *   A changed parameter costs one lookup for its name and one for each
+ *   distinct prefix length subscribed to, unchanged parameters cost nothing
+ *   beyond the comparison.
+ */
+int cfg_subs_notify(struct cfg_subs *subs, const struct cfg_result *prev,
+                    const struct cfg_result *next);
+
+/**
+ * Release a set of subscriptions
+ *
+ * @param subs
+ *   [IN] the set, can be NULL
+ */
+void cfg_subs_destroy(struct cfg_subs *subs);
+
+#endif /* DIFF_H */
@@ -0,0 +1,371 @@
+/*
+ * Copyleft
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "cfg.h"
+#include "result.h"
+#include "kv.h"
+
+/* initial number of slots, the table is kept at most half full */
+#define KV_MIN_SLOTS        64
+
+#define KV_HASH_BASIS       14695981039346656037u
+#define KV_HASH_PRIME       1099511628211u
+
+int
+cfg_kv_init(struct cfg_kv *kv, struct arena *arena)
+{
+    memset(kv, 0, sizeof(*kv));
+    kv->arena = arena;
+
+    if (NULL == (kv->slots = calloc(KV_MIN_SLOTS, sizeof(*kv->slots)))) {
+        LOG_ERR("cannot allocate parameter store");
+        return FAIL;
+    }
+
+    kv->mask = KV_MIN_SLOTS - 1;
+
+    return SUCCEED;
+}
+
+/**
+ * Find the slot of a key or the empty slot where it belongs
+ */
+static struct cfg_kv_entry *
+kv_slot(struct cfg_kv_entry *slots, size_t mask, const char *key, size_t len,
+        uint32_t hash)
+{
+    struct cfg_kv_entry *e;
+    size_t               pos;
+
+    for (pos = hash & mask; ; pos = (pos + 1) & mask) {
+        e = &slots[pos];
+
+        if (NULL == e->key || (e->hash == hash && e->key_len == len &&
+                               0 == memcmp(e->key, key, len)))
+            return e;
+    }
+}
+
+/**
+ * Add a value to the 64bit FNV-1a hash of the values before it, the null
+ * character is included so that value boundaries count
+ */
+static uint64_t
+kv_value_hash(uint64_t h, const char *value)
+{
+    do {
+        h ^= (unsigned char)*value;
+        h *= KV_HASH_PRIME;
+    }
+    while ('\0' != *value++);
+
+    return h;
+}
+
+/**
+ * Double the table, entries are moved by their stored hash
+ */
+static int
+kv_grow(struct cfg_kv *kv)
+{
+    struct cfg_kv_entry *slots;
+    size_t               size = (kv->mask + 1) * 2, i;
+
+    if (NULL == (slots = calloc(size, sizeof(*slots)))) {
+        LOG_ERR("cannot allocate parameter store of %zu slots", size);
+        return FAIL;
+    }
+
+    for (i = 0; i <= kv->mask; i++) {
+        if (NULL != kv->slots[i].key) {
+            *kv_slot(slots, size - 1, kv->slots[i].key, kv->slots[i].key_len,
+                     kv->slots[i].hash) = kv->slots[i];
+        }
+    }
+
+    free(kv->slots);
+    kv->slots = slots;
+    kv->mask = size - 1;
+
+    return SUCCEED;
+}
+
+int
+cfg_kv_add(struct cfg_kv *kv, const char *key, size_t len, char *value)
+{
+    struct cfg_kv_entry *e;
+    char               **values;
+    uint32_t             hash = str_hash_n(key, len);
+    size_t               alloc;
+
+    if ((kv->count + 1) * 2 > kv->mask + 1 && SUCCEED != kv_grow(kv))
+        return FAIL;
+
+    e = kv_slot(kv->slots, kv->mask, key, len, hash);
+
+    if (NULL == e->key) {
+        if (NULL == (e->key = arena_strndup(kv->arena, key, len)))
+            goto fail;
+
+        e->key_len = len;
+        e->hash = hash;
+        e->value_hash = KV_HASH_BASIS;
+        kv->count++;
+    }
+
+    /* most parameters have a single value, arrays grow by doubling */
+    if (e->count + 1 >= e->alloc) {
+        alloc = 0 == e->alloc ? 2 : e->alloc * 2;
+
+        if (NULL == (values = arena_alloc(kv->arena, alloc * sizeof(*values))))
+            goto fail;
+
+        if (0 != e->count)
+            memcpy(values, e->values, e->count * sizeof(*values));
+
+        e->values = values;
+        e->alloc = alloc;
+    }
+
+    e->values[e->count++] = value;
+    e->values[e->count] = NULL;
+    e->value_hash = kv_value_hash(e->value_hash, value);
+
+    return SUCCEED;
+fail:
+    LOG_ERR("cannot store parameter [%.*s]", (int)len, key);
+    return FAIL;
+}
+
+const struct cfg_kv_entry *
+cfg_kv_find(const struct cfg_kv *kv, const char *key, size_t len)
+{
+    const struct cfg_kv_entry *e;
+
+    e = kv_slot(kv->slots, kv->mask, key, len, str_hash_n(key, len));
+
+    return NULL != e->key ? e : NULL;
+}
+
+static int
+kv_compare(const void *a, const void *b)
+{
+    return strcmp((*(const struct cfg_kv_entry *const *)a)->key,
+                  (*(const struct cfg_kv_entry *const *)b)->key);
+}
+
+/**
+ * Build the subtree of sorted keys sharing their first depth bytes
+ */
+static int
+kv_build(struct cfg_kv *kv, struct cfg_kv_node *node,
+         const struct cfg_kv_entry **e, size_t n, size_t depth)
+{
+    const char  *first = e[0]->key, *last = e[n - 1]->key;
+    size_t       end, i, j, k, c;
+
+    /* keys are sorted, so the first and the last share the least */
+    for (end = depth; '\0' != first[end] && first[end] == last[end]; end++)
+        ;
+
+    memset(node, 0, sizeof(*node));
+    node->key = first;
+    node->start = depth;
+    node->end = end;
+
+    i = 0;
+
+    if ('\0' == first[end])
+        node->entry = e[i++];
+
+    for (j = i; j < n; j = k) {
+        for (k = j + 1; k < n && e[k]->key[end] == e[j]->key[end]; k++)
+            ;
+        node->nchildren++;
+    }
+
+    if (0 == node->nchildren)
+        return SUCCEED;
+
+    node->children = arena_alloc(kv->arena,
+                                 node->nchildren * sizeof(*node->children));
+    if (NULL == node->children)
+        return FAIL;
+
+    for (j = i, c = 0; j < n; j = k, c++) {
+        for (k = j + 1; k < n && e[k]->key[end] == e[j]->key[end]; k++)
+            ;
+
+        if (SUCCEED != kv_build(kv, &node->children[c], e + j, k - j, end))
+            return FAIL;
+    }
+
+    return SUCCEED;
+}
+
+int
+cfg_kv_index(struct cfg_kv *kv)
+{
+    const struct cfg_kv_entry **e;
+    size_t                      i, n = 0;
+    int                         ret = FAIL;
+
+    if (0 == kv->count)
+        return SUCCEED;
+
+    if (NULL == (e = malloc(kv->count * sizeof(*e))))
+        goto out;
+
+    for (i = 0; i <= kv->mask; i++) {
+        if (NULL != kv->slots[i].key)
+            e[n++] = &kv->slots[i];
+    }
+
+    qsort(e, n, sizeof(*e), kv_compare);
+
+    if (NULL != (kv->root = arena_alloc(kv->arena, sizeof(*kv->root))))
+        ret = kv_build(kv, kv->root, e, n, 0);
+out:
+    if (SUCCEED != ret) {
+        LOG_ERR("cannot index %zu parameters", kv->count);
+        kv->root = NULL;
+    }
+
+    free(e);
+
+    return ret;
+}
+
+void
+cfg_kv_destroy(struct cfg_kv *kv)
+{
+    free(kv->slots);
+    memset(kv, 0, sizeof(*kv));
+}
+
+/**
+ * Find a parameter of a parse_cfg_file_all() result
+ */
+static const struct cfg_kv_entry *
+kv_get(const struct cfg_result *result, const char *key)
+{
+    if (NULL == result->kv)
+        return NULL;
+
+    return cfg_kv_find(result->kv, key, strlen(key));
+}
+
+int cfg_get_str(const struct cfg_result *result, const char *key,
+                const char **value)
+{
+    const struct cfg_kv_entry *e;
+
+    if (NULL == (e = kv_get(result, key)))
+        return FAIL;
+
+    *value = e->values[e->count - 1];
+
+    return SUCCEED;
+}
+
+int cfg_get_uint64(const struct cfg_result *result, const char *key,
+                   uint64_t *value)
+{
+    const struct cfg_kv_entry *e;
+    const char                *str;
+
+    if (NULL == (e = kv_get(result, key)))
+        return FAIL;
+
+    str = e->values[e->count - 1];
+
+    return str2uint64_n(str, strlen(str), "KMGT", value);
+}
+
+int cfg_get_multi(const struct cfg_result *result, const char *key,
+                  char ***values, size_t *count)
+{
+    const struct cfg_kv_entry *e;
+
+    if (NULL == (e = kv_get(result, key)))
+        return FAIL;
+
+    *values = e->values;
+
+    if (NULL != count)
+        *count = e->count;
+
+    return SUCCEED;
+}
+
+/**
+ * Report every key of a subtree in order
+ */
+static int
+kv_walk(const struct cfg_kv_node *node, cfg_key_cb cb, void *arg)
+{
+    size_t  i;
+    int     ret;
+
+    if (NULL != node->entry && SUCCEED != (ret = cb(node->entry->key,
+                                                    node->entry->values,
+                                                    node->entry->count, arg)))
+        return ret;
+
+    for (i = 0; i < node->nchildren; i++) {
+        if (SUCCEED != (ret = kv_walk(&node->children[i], cb, arg)))
+            return ret;
+    }
+
+    return SUCCEED;
+}
+
+int cfg_get_prefix(const struct cfg_result *result, const char *prefix,
+                   cfg_key_cb cb, void *arg)
+{
+    const struct cfg_kv_node    *node;
+    size_t                       len = strlen(prefix), pos = 0, n, lo, hi, mid;
+    unsigned char                c;
+
+    if (NULL == result->kv)
+        return FAIL;
+
+    for (node = result->kv->root; NULL != node; ) {
+        n = node->end - node->start;
+
+        if (n > len - pos)
+            n = len - pos;
+
+        if (0 != memcmp(node->key + node->start, prefix + pos, n))
+            break;
+
+        if ((pos += n) == len)
+            return kv_walk(node, cb, arg);
+
+        /* the label is used up, descend by the next byte of the prefix */
+        c = (unsigned char)prefix[pos];
+
+        for (lo = 0, hi = node->nchildren; lo < hi; ) {
+            mid = lo + (hi - lo) / 2;
+
+            if ((unsigned char)node->children[mid].key[pos] < c)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo == node->nchildren ||
+            (unsigned char)node->children[lo].key[pos] != c)
+            break;
+
+        node = &node->children[lo];
+    }
+
+    return SUCCEED;
+}
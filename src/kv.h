@@ -0,0 +1,104 @@
+/*
+ * Copyleft
+ */
+
+#ifndef KV_H
+#define KV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/* every value a parameter was given, in the order of the parse */
+struct cfg_kv_entry {
+    const char     *key;        /* null terminated, NULL for an empty slot */
+    size_t          key_len;
+    uint32_t        hash;
+    size_t          count;
+    size_t          alloc;
+    char          **values;     /* null terminated, strings in the arena */
+    uint64_t        value_hash; /* of all values in order, for comparing */
+};
+
+/*
+ * Node of the radix trie over the keys, its label is key[start, end) and
+ * children are sorted by the first byte of their labels
+ */
+struct cfg_kv_node {
+    const char                 *key;        /* some key below the node */
+    size_t                      start;
+    size_t                      end;
+    const struct cfg_kv_entry  *entry;      /* key ending here or NULL */
+    struct cfg_kv_node         *children;
+    size_t                      nchildren;
+};
+
+/**
+ * Open addressing hash table of all parameters of a parse, keys and values
+ * are allocated from the arena of the parse result
+ */
+struct cfg_kv {
+    struct arena           *arena;
+    struct cfg_kv_entry    *slots;
+    size_t                  mask;
+    size_t                  count;      /* distinct keys */
+    struct cfg_kv_node     *root;       /* NULL until cfg_kv_index() */
+};
+
+/**
+ * Initialize an empty store
+ *
+ * @param arena
+ *   [IN] arena keys are copied into, it must outlive the store
+ *
+ * @return
+ *   SUCCEED - initialized
+ *   FAIL - out of memory
+ */
+int
+cfg_kv_init(struct cfg_kv *kv, struct arena *arena);
+
+/**
+ * Add a value of a parameter
+ *
+ * @param key
+ *   [IN] parameter name, does not need to be null terminated
+ * @param len
+ *   [IN] length of the name
+ * @param value
+ *   [IN] null terminated value, kept as it is, so it must outlive the store
+ *
+ * @return
+ *   SUCCEED - added
+ *   FAIL - out of memory
+ */
+int
+cfg_kv_add(struct cfg_kv *kv, const char *key, size_t len, char *value);
+
+/**
+ * Find a parameter
+ *
+ * @return
+ *   the entry or NULL if the parameter has no value
+ */
+const struct cfg_kv_entry *
+cfg_kv_find(const struct cfg_kv *kv, const char *key, size_t len);
+
+/**
+ * Build the radix trie for prefix queries once all keys are added
+ *
+ * @return
+ *   SUCCEED - built
+ *   FAIL - out of memory
+ */
+int
+cfg_kv_index(struct cfg_kv *kv);
+
+/**
+ * Release the table, keys and values go with the arena
+ */
+void
+cfg_kv_destroy(struct cfg_kv *kv);
+
+#endif /* KV_H */
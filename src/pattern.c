@@ -0,0 +1,358 @@
+/*
+ * Copyleft
+ */
+
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "cfg.h"
+#include "pattern.h"
+
+#define PATTERN_LITERAL     0   /* plain name, compared as a string */
+#define PATTERN_WILD        1   /* "*", "?" or "[...]" inside a name */
+#define PATTERN_RECURSIVE   2   /* "**", zero or more directories */
+#define PATTERN_FNMATCH     3   /* wildcards too long for an automaton */
+
+#define PATTERN_BIT(i)      ((uint64_t)1 << (i))
+
+/*
+ * A wildcard component is a Shift-And automaton: state i is set when the
+ * first i characters, "?" or classes of the component matched, states
+ * preceded by "*" loop on any character
+ */
+struct cfg_pattern_component {
+    int         type;
+    char       *literal;    /* also the component given to fnmatch() */
+    uint64_t    loops;      /* states staying active on any character */
+    uint64_t    accept;     /* state reached when the whole name matched */
+    uint64_t   *table;      /* states entered on a character, 256 entries */
+};
+
+/*
+ * A set has a bit per component, patterns with more components than that
+ * and without "**" only ever have one matching, their sets hold its index
+ * plus one instead
+ */
+struct cfg_pattern {
+    size_t                          count;
+    int                             indexed;
+    struct cfg_pattern_component    components[];
+};
+
+/**
+ * Parse a "[...]" class starting at str[i]
+ *
+ * @param set
+ *   [OUT] characters of the class, 256 entries
+ *
+ * @return
+ *   offset past the closing bracket or 0 if the bracket is not closed
+ */
+static size_t
+pattern_class(const char *str, size_t len, size_t i, unsigned char *set)
+{
+    size_t  start, end, j;
+    int     negate = 0, c;
+
+    start = i + 1;
+
+    if (start < len && ('!' == str[start] || '^' == str[start])) {
+        negate = 1;
+        start++;
+    }
+
+    /* a leading "]" belongs to the class */
+    for (end = start < len && ']' == str[start] ? start + 1 : start;
+         end < len && ']' != str[end]; end++)
+        ;
+
+    if (end >= len)
+        return 0;
+
+    memset(set, 0, 256);
+
+    for (j = start; j < end; j++) {
+        if (j + 2 < end && '-' == str[j + 1]) {
+            for (c = (unsigned char)str[j]; c <= (unsigned char)str[j + 2]; c++)
+                set[c] = 1;
+            j += 2;
+        }
+        else
+            set[(unsigned char)str[j]] = 1;
+    }
+
+    if (0 != negate) {
+        for (c = 0; c < 256; c++)
+            set[c] = !set[c];
+    }
+
+    return end + 1;
+}
+
+/**
+ * Compile a wildcard component into its automaton, components with more
+ * characters than the automaton has states are left to fnmatch()
+ *
+ * @return
+ *   SUCCEED - compiled
+ *   FAIL - out of memory
+ */
+static int
+pattern_compile_wild(struct cfg_pattern_component *comp, const char *str,
+                     size_t len)
+{
+    unsigned char   set[256];
+    size_t          i, next;
+    int             k = 0, c;
+
+    if (NULL == (comp->table = calloc(256, sizeof(*comp->table)))) {
+        LOG_ERR("cannot allocate pattern [%.*s]", (int)len, str);
+        return FAIL;
+    }
+
+    for (i = 0; i < len; i = next) {
+        next = i + 1;
+
+        if ('*' == str[i]) {
+            comp->loops |= PATTERN_BIT(k);
+            continue;
+        }
+
+        if (CFG_PATTERN_MAX_LENGTH == k) {
+            free(comp->table);
+            memset(comp, 0, sizeof(*comp));
+            comp->type = PATTERN_FNMATCH;
+
+            if (NULL == (comp->literal = str_strndup(str, len))) {
+                LOG_ERR("cannot allocate pattern [%.*s]", (int)len, str);
+                return FAIL;
+            }
+
+            return SUCCEED;
+        }
+
+        if ('?' == str[i])
+            memset(set, 1, sizeof(set));
+        else if ('[' != str[i] || 0 == (next = pattern_class(str, len, i, set))) {
+            /* literal character, including "[" without a closing "]" */
+            memset(set, 0, sizeof(set));
+            set[(unsigned char)str[i]] = 1;
+            next = i + 1;
+        }
+
+        for (c = 1; c < 256; c++) {
+            if (0 != set[c])
+                comp->table[c] |= PATTERN_BIT(k + 1);
+        }
+
+        k++;
+    }
+
+    comp->accept = PATTERN_BIT(k);
+
+    return SUCCEED;
+}
+
+static int
+pattern_compile_component(struct cfg_pattern_component *comp, const char *str,
+                          size_t len)
+{
+    memset(comp, 0, sizeof(*comp));
+
+    if (2 == len && 0 == strncmp(str, "**", 2)) {
+        comp->type = PATTERN_RECURSIVE;
+        return SUCCEED;
+    }
+
+    if (len <= strcspn(str, "*?[")) {
+        comp->type = PATTERN_LITERAL;
+
+        if (NULL == (comp->literal = str_strndup(str, len))) {
+            LOG_ERR("cannot allocate pattern [%.*s]", (int)len, str);
+            return FAIL;
+        }
+
+        return SUCCEED;
+    }
+
+    comp->type = PATTERN_WILD;
+
+    return pattern_compile_wild(comp, str, len);
+}
+
+struct cfg_pattern *
+cfg_pattern_compile(const char *pattern)
+{
+    struct cfg_pattern *p;
+    const char         *s, *e;
+    size_t              count = 0;
+    int                 recursive = 0;
+
+    for (s = pattern; '\0' != *s; s = e) {
+        for (; '/' == *s; s++)
+            ;
+        for (e = s; '\0' != *e && '/' != *e; e++)
+            ;
+        if (e != s)
+            count++;
+        if (2 == e - s && 0 == strncmp(s, "**", 2))
+            recursive = 1;
+    }
+
+    if (0 == count) {
+        LOG_ERR("pattern [%s] is empty", pattern);
+        return NULL;
+    }
+
+    if (CFG_PATTERN_MAX_COMPONENTS < count && 0 != recursive) {
+        LOG_ERR("pattern [%s] with \"**\" has more than %d components",
+                pattern, CFG_PATTERN_MAX_COMPONENTS);
+        return NULL;
+    }
+
+    p = calloc(1, sizeof(*p) + count * sizeof(p->components[0]));
+    if (NULL == p) {
+        LOG_ERR("cannot allocate pattern [%s]", pattern);
+        return NULL;
+    }
+
+    p->indexed = CFG_PATTERN_MAX_COMPONENTS < count;
+
+    for (s = pattern; '\0' != *s; s = e) {
+        for (; '/' == *s; s++)
+            ;
+        for (e = s; '\0' != *e && '/' != *e; e++)
+            ;
+        if (e == s)
+            continue;
+
+        if (SUCCEED != pattern_compile_component(&p->components[p->count++], s,
+                                                 e - s)) {
+            cfg_pattern_free(p);
+            return NULL;
+        }
+    }
+
+    return p;
+}
+
+/**
+ * Add components that "**" lets match without consuming a directory
+ */
+static cfg_pattern_set
+pattern_closure(const struct cfg_pattern *pattern, cfg_pattern_set set)
+{
+    size_t  i;
+
+    for (i = 0; i + 1 < pattern->count; i++) {
+        if (0 != (set & PATTERN_BIT(i)) &&
+            PATTERN_RECURSIVE == pattern->components[i].type)
+            set |= PATTERN_BIT(i + 1);
+    }
+
+    return set;
+}
+
+static int
+pattern_match_component(const struct cfg_pattern_component *comp,
+                        const char *name)
+{
+    const unsigned char *c;
+    uint64_t             state = 1;
+
+    switch (comp->type) {
+    case PATTERN_LITERAL:
+        return 0 == strcmp(comp->literal, name) ? SUCCEED : FAIL;
+    case PATTERN_RECURSIVE:
+        return SUCCEED;
+    case PATTERN_FNMATCH:
+        return 0 == fnmatch(comp->literal, name, FNM_NOESCAPE) ? SUCCEED :
+            FAIL;
+    }
+
+    for (c = (const unsigned char *)name; '\0' != *c; c++) {
+        state = ((state << 1) & comp->table[*c]) | (state & comp->loops);
+
+        if (0 == state)
+            return FAIL;
+    }
+
+    return 0 != (state & comp->accept) ? SUCCEED : FAIL;
+}
+
+cfg_pattern_set
+cfg_pattern_start(const struct cfg_pattern *pattern)
+{
+    if (0 != pattern->indexed)
+        return 1;
+
+    return pattern_closure(pattern, 1);
+}
+
+int
+cfg_pattern_match_file(const struct cfg_pattern *pattern, cfg_pattern_set set,
+                       const char *name)
+{
+    size_t  last = pattern->count - 1;
+
+    if (0 != pattern->indexed ? last + 1 != set :
+        0 == (set & PATTERN_BIT(last)))
+        return FAIL;
+
+    return pattern_match_component(&pattern->components[last], name);
+}
+
+cfg_pattern_set
+cfg_pattern_match_dir(const struct cfg_pattern *pattern, cfg_pattern_set set,
+                      const char *name, int link)
+{
+    const struct cfg_pattern_component *comp;
+    cfg_pattern_set                     next = 0;
+    size_t                              i;
+
+    if (0 != pattern->indexed) {
+        i = (size_t)set - 1;
+
+        if (0 == set || i + 1 >= pattern->count ||
+            SUCCEED != pattern_match_component(&pattern->components[i], name))
+            return 0;
+
+        return set + 1;
+    }
+
+    for (i = 0; i < pattern->count; i++) {
+        if (0 == (set & PATTERN_BIT(i)))
+            continue;
+
+        comp = &pattern->components[i];
+
+        if (PATTERN_RECURSIVE == comp->type) {
+            if (0 == link)
+                next |= PATTERN_BIT(i);
+        }
+        else if (i + 1 < pattern->count &&
+                 SUCCEED == pattern_match_component(comp, name))
+            next |= PATTERN_BIT(i + 1);
+    }
+
+    return pattern_closure(pattern, next);
+}
+
+void
+cfg_pattern_free(struct cfg_pattern *pattern)
+{
+    size_t  i;
+
+    if (NULL == pattern)
+        return;
+
+    for (i = 0; i < pattern->count; i++) {
+        free(pattern->components[i].literal);
+        free(pattern->components[i].table);
+    }
+
+    free(pattern);
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyleft
+ */
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdint.h>
+
+/* most path components a pattern with "**" can have */
+#define CFG_PATTERN_MAX_COMPONENTS  64
+/* most characters, "?" and "[...]" of a component matched by an automaton */
+#define CFG_PATTERN_MAX_LENGTH      63
+
+/**
+ * Compiled "Include=..." pattern relative to its base directory
+ *
+ * A pattern is a list of path components separated by "/".  Within a
+ * component "*" matches any run of characters, "?" any single character and
+ * "[...]" any character of a class such as "[a-z_]", "[!0-9]" or "[^.]"; a
+ * "]" right after the opening bracket belongs to the class and a "[" without
+ * a closing bracket is a literal.  A component of exactly "**" matches zero or
+ * more directories.  Every other component must match a directory on the
+ * way, the last one matches the files.
+ *
+ * Components are compiled into bit-parallel automata, so matching a name
+ * costs one table lookup, shift and mask per character whatever the pattern;
+ * longer components are matched with fnmatch() instead.
+ */
+struct cfg_pattern;
+
+/* components of a pattern still matching at some directory, bit per index */
+typedef uint64_t cfg_pattern_set;
+
+/**
+ * Compile a pattern, use cfg_pattern_free() to free it.
+ *
+ * @param pattern
+ *   [IN] pattern without the base directory, e.g. "p[0-9]*.conf"
+ *
+ * @return
+ *   compiled pattern or NULL if it is invalid or out of memory
+ */
+struct cfg_pattern *
+cfg_pattern_compile(const char *pattern);
+
+/**
+ * Get components matching names in the base directory
+ */
+cfg_pattern_set
+cfg_pattern_start(const struct cfg_pattern *pattern);
+
+/**
+ * See whether a file matches in a directory
+ *
+ * @param set
+ *   [IN] components matching in the directory
+ * @param name
+ *   [IN] file name
+ *
+ * @return
+ *   SUCCEED - file matches
+ *   FAIL - otherwise
+ */
+int
+cfg_pattern_match_file(const struct cfg_pattern *pattern, cfg_pattern_set set,
+                       const char *name);
+
+/**
+ * Get components matching names in a subdirectory
+ *
+ * @param set
+ *   [IN] components matching in the directory
+ * @param name
+ *   [IN] subdirectory name
+ * @param link
+ *   [IN] subdirectory is a symbolic link, those are not descended into
+ *   through "**"
+ *
+ * @return
+ *   components matching in the subdirectory, 0 if nothing can match there
+ */
+cfg_pattern_set
+cfg_pattern_match_dir(const struct cfg_pattern *pattern, cfg_pattern_set set,
+                      const char *name, int link);
+
+/**
+ * Release a compiled pattern
+ */
+void
+cfg_pattern_free(struct cfg_pattern *pattern);
+
+#endif /* PATTERN_H */
@@ -0,0 +1,49 @@
+/*
+ * Copyleft
+ */
+
+#ifndef RESULT_H
+#define RESULT_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "cfg.h"
+#include "pattern.h"
+
+/* pattern components still matching in an included directory */
+struct cfg_dir_glob {
+    const struct cfg_pattern   *pattern;
+    cfg_pattern_set             set;
+};
+
+/* library internal layout of a parse result */
+struct cfg_result {
+    struct arena   *arena;
+    char          **files;      /* configuration files opened or tried */
+    char          **dirs;       /* included directories */
+    struct cfg_dir_glob *globs; /* of each of dirs, none from a cache image */
+    size_t          nglobs;
+    size_t          globs_alloc;
+    struct cfg_pattern **patterns;  /* compiled patterns globs refer to */
+    size_t          npatterns;
+    size_t          patterns_alloc;
+    void           *image;      /* mapped cache image values point into */
+    size_t          image_size;
+    struct cfg_file_stats *file_stats;
+    size_t          nfile_stats;
+    size_t          file_stats_alloc;
+    struct cfg_lazy *lazy;      /* index of a lazy parse, NULL otherwise */
+    struct cfg_kv  *kv;         /* all parameters, NULL unless wanted */
+    unsigned char  *assigned;   /* cfg[] entries the files set, not lazily */
+};
+
+/**
+ * Allocate an empty parse result
+ *
+ * @return
+ *   the result or NULL if out of memory, release it with cfg_free()
+ */
+struct cfg_result *cfg_result_create(void);
+
+#endif /* RESULT_H */
@@ -0,0 +1,287 @@
+/*
+ * Copyleft
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <time.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "str.h"
+#include "scan.h"
+
+/* CFG_LTRIM_CHARS and CFG_RTRIM_CHARS of the line based parser */
+#define SCAN_IS_LTRIM(c)    ('\t' == (c) || ' ' == (c))
+#define SCAN_IS_RTRIM(c)    (SCAN_IS_LTRIM(c) || '\r' == (c) || '\n' == (c))
+
+#ifdef __SSE2__
+/**
+ * Count plain bytes at the start of a 16 byte block
+ *
+ * @param p
+ *   [IN] block to scan, 16 bytes must be available
+ * @param stop
+ *   [IN] byte that ends the current part of the line besides '\n'
+ *
+ * @return
+ *   number of ASCII bytes before the first stop, '\n' or non-ASCII byte,
+ *   16 if there is none
+ */
+static size_t
+scan_block(const char *p, char stop)
+{
+    __m128i v, special;
+    unsigned int mask;
+
+    v = _mm_loadu_si128((const __m128i *)p);
+    special = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                           _mm_cmpeq_epi8(v, _mm_set1_epi8(stop)));
+
+    if (0 == (mask = (unsigned int)(_mm_movemask_epi8(special) |
+                                    _mm_movemask_epi8(v))))
+        return 16;
+
+    return __builtin_ctz(mask);
+}
+#endif
+
+/**
+ * Find the first stop, '\n' or non-ASCII byte
+ */
+static const char *
+scan_plain(const char *p, const char *end, char stop)
+{
+#ifdef __SSE2__
+    size_t len;
+
+    while (16 <= end - p) {
+        p += (len = scan_block(p, stop));
+        if (16 != len)
+            return p;
+    }
+#endif
+    while (p < end && stop != *p && '\n' != *p && 0 == (*p & 0x80))
+        p++;
+
+    return p;
+}
+
+static uint64_t
+scan_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void
+cfg_scan_init(struct cfg_scanner *s, const char *data, size_t size)
+{
+    memset(s, 0, sizeof(*s));
+    s->p = data;
+    s->end = data + size;
+}
+
+int
+cfg_scan_next(struct cfg_scanner *s, struct cfg_token *tok)
+{
+    const char *p = s->p, *end = s->end, *line, *sep, *eol, *seg, *q, *bs;
+    uint64_t start = 0;
+    size_t len;
+    int rc;
+
+next_line:
+    if (p >= end) {
+        s->p = end;
+        return SCAN_EOF;
+    }
+
+    tok->lineno = ++s->lineno;
+
+    while (p < end && SCAN_IS_LTRIM(*p))
+        p++;
+
+    if (p < end && '#' == *p) {
+        if (NULL == (p = memchr(p, '\n', end - p)))
+            p = end;
+
+        s->comments++;
+        p++;
+        goto next_line;
+    }
+
+    if (p == end || '\n' == *p) {
+        s->blanks++;
+        p++;
+        goto next_line;
+    }
+
+    /* parameter, stops at '=', end of line or non-ASCII character */
+    for (line = p; ; ) {
+        p = scan_plain(p, end, '=');
+
+        if (p == end || '=' == *p || '\n' == *p)
+            break;
+
+        if (0 == (len = str_utf8_char_len(p, end - p)))
+            goto non_utf8;
+
+        p += len;
+    }
+
+    if (p == end || '\n' == *p) {
+        for (eol = p; eol > line && SCAN_IS_RTRIM(eol[-1]); eol--)
+            ;
+
+        if (eol == line) {      /* nothing but trailing whitespace */
+            s->blanks++;
+            p++;
+            goto next_line;
+        }
+
+        tok->line = line;
+        tok->line_len = eol - line;
+        s->p = p < end ? p + 1 : end;
+
+        if ('[' != *line || 2 > eol - line || ']' != eol[-1])
+            return SCAN_NO_VALUE;
+
+        for (p = line + 1; p < eol - 1 && SCAN_IS_LTRIM(*p); p++)
+            ;
+        for (sep = eol - 1; sep > p && SCAN_IS_LTRIM(sep[-1]); sep--)
+            ;
+
+        tok->key = p;
+        tok->key_len = sep - p;
+        tok->value = NULL;
+        tok->value_len = 0;
+        tok->continued = 0;
+
+        return SCAN_SECTION;
+    }
+
+    for (sep = p; p > line && SCAN_IS_RTRIM(p[-1]); p--)
+        ;
+
+    tok->key = line;
+    tok->key_len = p - line;
+    tok->line = line;
+
+    /* value */
+    for (p = sep + 1; p < end && SCAN_IS_LTRIM(*p); p++)
+        ;
+
+    tok->value = seg = p;
+    tok->continued = 0;
+value_line:
+    if (p < end && '\n' != *p && 0 == (*p & 0x80))
+        p = scan_plain(p, end, '\n');
+
+    if (p < end && '\n' != *p) {
+        /* hand the rest of the line to the vectorized validator */
+        if (NULL == (eol = memchr(p, '\n', end - p)))
+            eol = end;
+
+        if (0 != s->timed)
+            start = scan_now_ns();
+
+        rc = str_is_utf8_n(p, eol - p);
+
+        if (0 != s->timed)
+            s->utf8_ns += scan_now_ns() - start;
+
+        if (SUCCEED != rc)
+            goto non_utf8;
+
+        p = eol;
+    }
+
+    /*
+     * an odd run of backslashes right before the line break continues the
+     * value, every pair of them stands for one backslash
+     */
+    q = p;
+    if (q > seg && '\r' == q[-1])
+        q--;
+
+    for (bs = q; bs > seg && '\\' == bs[-1]; bs--)
+        ;
+
+    if (0 != (q - bs) % 2 && p < end) {
+        tok->continued++;
+        s->lineno++;
+
+        for (p++; p < end && SCAN_IS_LTRIM(*p); p++)
+            ;
+
+        seg = p;
+        goto value_line;
+    }
+
+    s->p = p < end ? p + 1 : end;
+
+    /* a lone backslash at the end of the file has nothing to continue */
+    if (q > bs)
+        p = bs + (q - bs + 1) / 2;
+
+    while (p > seg && SCAN_IS_RTRIM(p[-1]))
+        p--;
+
+    tok->value_len = p - tok->value;
+    tok->line_len = (0 != tok->value_len ? p : sep + 1) - line;
+
+    return SCAN_TOKEN;
+non_utf8:
+    if (NULL == (eol = memchr(p, '\n', end - p)))
+        eol = end;
+
+    s->p = eol < end ? eol + 1 : end;
+
+    while (eol > line && SCAN_IS_RTRIM(eol[-1]))
+        eol--;
+
+    tok->line = line;
+    tok->line_len = eol - line;
+
+    return SCAN_NON_UTF8;
+}
+
+size_t
+cfg_scan_value(const struct cfg_token *tok, char *dest)
+{
+    const char *p = tok->value, *end = tok->value + tok->value_len, *nl, *q;
+    const char *bs;
+    char       *d = dest;
+    int         n;
+
+    /* every line break inside the value follows a continuation backslash */
+    for (n = tok->continued; 0 < n; n--) {
+        if (NULL == (nl = memchr(p, '\n', end - p)))
+            break;
+
+        q = '\r' == nl[-1] ? nl - 2 : nl - 1;
+
+        /* half of the backslashes before the continuing one are kept */
+        for (bs = q; bs > p && '\\' == bs[-1]; bs--)
+            ;
+        q = bs + (q - bs) / 2;
+
+        memcpy(d, p, q - p);
+        d += q - p;
+
+        for (p = nl + 1; p < end && SCAN_IS_LTRIM(*p); p++)
+            ;
+    }
+
+    memcpy(d, p, end - p);
+    d += end - p;
+    *d = '\0';
+
+    return d - dest;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyleft
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* cfg_scan_next() return values */
+#define SCAN_TOKEN          1
+#define SCAN_SECTION        2
+#define SCAN_EOF            0
+#define SCAN_NON_UTF8      -1
+#define SCAN_NO_VALUE      -2
+
+/**
+ * A "parameter=value" line or "[section]" header of a configuration file,
+ * all pointers refer to the scanned buffer
+ */
+struct cfg_token {
+    const char *key;        /* parameter or section name */
+    size_t      key_len;
+    const char *value;      /* raw value, see cfg_scan_value() if continued,
+                               NULL for a section header */
+    size_t      value_len;
+    const char *line;       /* trimmed line, for error messages */
+    size_t      line_len;
+    int         lineno;     /* first line of the token */
+    int         continued;  /* number of continuation lines of the value */
+};
+
+struct cfg_scanner {
+    const char *p;
+    const char *end;
+    int         lineno;
+    int         comments;   /* comment lines skipped */
+    int         blanks;     /* blank lines skipped */
+    int         timed;      /* set to measure utf8_ns */
+    uint64_t    utf8_ns;    /* time spent validating non-ASCII values */
+};
+
+/**
+ * Prepare scanning of a configuration file loaded into memory
+ *
+ * @param s
+ *   [OUT] scanner
+ * @param data
+ *   [IN] file contents, does not need to be null terminated
+ * @param size
+ *   [IN] number of bytes in data
+ */
+void
+cfg_scan_init(struct cfg_scanner *s, const char *data, size_t size);
+
+/**
+ * Get next "parameter=value" line or "[section]" header
+ *
+ * Splitting into lines, skipping comments and blank lines, trimming, finding
+ * the '=' separator and UTF-8 validation are all done in one forward pass
+ * over the buffer.  Lines have no length limit.
+ *
+ * A value whose line ends with a backslash continues on the next line, the
+ * backslash, the line break and blanks starting the next line are dropped
+ * by cfg_scan_value().  Continuation lines are taken as they are, even if
+ * they look like comments.  Backslashes ending a line escape each other in
+ * pairs: "C:\\" is the value "C:\" and does not continue, an odd one at the
+ * end of the file is kept.
+ *
+ * A line of a name in brackets starts a section, blanks around the name are
+ * trimmed and "[]" ends the section.
+ *
+ * @param s
+ *   [IN/OUT] scanner
+ * @param tok
+ *   [OUT] the line found, on errors only line, line_len and lineno are set
+ *
+ * @return
+ *   SCAN_TOKEN - tok holds the next key and value
+ *   SCAN_SECTION - tok holds the name of the next section in key
+ *   SCAN_EOF - no more lines
+ *   SCAN_NON_UTF8 - line with invalid UTF-8 sequence
+ *   SCAN_NO_VALUE - line not following "parameter=value" notation
+ */
+int
+cfg_scan_next(struct cfg_scanner *s, struct cfg_token *tok);
+
+/**
+ * Copy the value of a token with its continuation lines joined
+ *
+ * @param tok
+ *   [IN] token returned by cfg_scan_next()
+ * @param dest
+ *   [OUT] buffer of at least value_len + 1 bytes, the copy is null
+ *   terminated
+ *
+ * @return
+ *   length of the copy
+ */
+size_t
+cfg_scan_value(const struct cfg_token *tok, char *dest);
+
+#endif /* SCAN_H */
@@ -0,0 +1,339 @@
+/*
+ * Copyleft
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "cfg.h"
+#include "diff.h"
+#include "snapshot.h"
+
+/*
+ * Snapshots are reclaimed with quiescent-state based epochs: publishing a
+ * snapshot advances the store epoch and retires the replaced one with that
+ * epoch, readers copy the store epoch when they stop using what they have
+ * read, and a retired snapshot is released once every online reader has
+ * copied an epoch at least as new as its own.  Reading the current snapshot
+ * is then a plain atomic load with no writes to shared memory.
+ */
+
+/* a snapshot with everything it owns */
+struct cfg_snap {
+    struct cfg_snapshot pub;        /* must be first */
+    void               *data;
+    struct cfg_result  *result;
+    uint64_t            retired;    /* store epoch it was replaced in */
+    struct cfg_snap    *next;       /* next retired snapshot */
+};
+
+struct cfg_reader {
+    struct cfg_store   *store;
+    uint64_t            epoch;      /* last epoch seen, 0 while offline */
+    struct cfg_reader  *next;
+};
+
+struct cfg_store {
+    struct cfg_snap    *current;
+    uint64_t            epoch;
+    uint64_t            version;
+    char               *cfg_file;
+    struct cfg_line    *cfg;        /* variables are CFG_FIELD() offsets */
+    size_t              size;
+    int                 optional;
+    int                 strict;
+    pthread_mutex_t     lock;       /* readers and retired list */
+    struct cfg_reader  *readers;
+    struct cfg_snap    *retired;
+    struct cfg_subs    *subs;       /* notified of changes on reload */
+};
+
+static void
+cfg_snap_free(struct cfg_store *store, struct cfg_snap *snap)
+{
+    int i;
+
+    if (NULL == snap)
+        return;
+
+    if (NULL != snap->data) {
+        for (i = 0; NULL != store->cfg[i].parameter; i++) {
+            if (TYPE_MULTISTRING == store->cfg[i].type)
+                str_strarr_free(*(char ***)((char *)snap->data +
+                                            (size_t)store->cfg[i].variable));
+        }
+    }
+
+    cfg_free(snap->result);
+    free(snap->data);
+    free(snap);
+}
+
+/**
+ * Parse configuration file into a snapshot that is not published yet
+ *
+ * @return
+ *   the snapshot or NULL on error
+ */
+static struct cfg_snap *
+cfg_snap_parse(struct cfg_store *store)
+{
+    struct cfg_snap *snap;
+    struct cfg_line *cfg = NULL;
+    size_t n;
+    int i;
+
+    for (n = 0; NULL != store->cfg[n].parameter; n++)
+        ;
+
+    if (NULL == (snap = calloc(1, sizeof(*snap))) ||
+        NULL == (snap->data = calloc(1, store->size)) ||
+        NULL == (cfg = malloc((n + 1) * sizeof(*cfg)))) {
+        LOG_ERR("cannot allocate snapshot of [%s]", store->cfg_file);
+        goto fail;
+    }
+
+    memcpy(cfg, store->cfg, (n + 1) * sizeof(*cfg));
+
+    for (i = 0; NULL != cfg[i].parameter; i++) {
+        cfg[i].variable = (char *)snap->data + (size_t)store->cfg[i].variable;
+
+        if (TYPE_MULTISTRING == cfg[i].type &&
+            SUCCEED != str_strarr_init(cfg[i].variable)) {
+            LOG_ERR("cannot allocate snapshot of [%s]", store->cfg_file);
+            goto fail;
+        }
+    }
+
+    /* changes can only be told from results that keep every parameter */
+    if (NULL != store->subs) {
+        if (SUCCEED != parse_cfg_file_all(store->cfg_file, cfg, store->optional,
+                                          store->strict, &snap->result))
+            goto fail;
+    }
+    else if (SUCCEED != parse_cfg_file_ex(store->cfg_file, cfg,
+                                          store->optional, store->strict,
+                                          &snap->result))
+        goto fail;
+
+    free(cfg);
+
+    snap->pub.data = snap->data;
+
+    return snap;
+fail:
+    free(cfg);
+    cfg_snap_free(store, snap);
+
+    return NULL;
+}
+
+/**
+ * Release retired snapshots no online reader can still hold, called with
+ * lock held
+ */
+static size_t
+cfg_store_reclaim_locked(struct cfg_store *store)
+{
+    struct cfg_snap **p, *snap;
+    struct cfg_reader *r;
+    uint64_t oldest = UINT64_MAX, e;
+    size_t left = 0;
+
+    for (r = store->readers; NULL != r; r = r->next) {
+        e = __atomic_load_n(&r->epoch, __ATOMIC_ACQUIRE);
+
+        if (0 != e && e < oldest)
+            oldest = e;
+    }
+
+    for (p = &store->retired; NULL != (snap = *p);) {
+        if (snap->retired <= oldest) {
+            *p = snap->next;
+            cfg_snap_free(store, snap);
+            continue;
+        }
+
+        left++;
+        p = &snap->next;
+    }
+
+    return left;
+}
+
+int cfg_store_create(struct cfg_store **store, const char *cfg_file,
+                     const struct cfg_line *cfg, size_t size, int optional,
+                     int strict)
+{
+    struct cfg_store *s;
+    size_t n;
+
+    for (n = 0; NULL != cfg[n].parameter; n++)
+        ;
+
+    if (NULL == (s = calloc(1, sizeof(*s))) ||
+        NULL == (s->cfg_file = str_strdup(cfg_file)) ||
+        NULL == (s->cfg = malloc((n + 1) * sizeof(*cfg)))) {
+        LOG_ERR("cannot allocate config store of [%s]", cfg_file);
+        goto fail;
+    }
+
+    memcpy(s->cfg, cfg, (n + 1) * sizeof(*cfg));
+    s->size = size;
+    s->optional = optional;
+    s->strict = strict;
+    s->epoch = 1;
+    pthread_mutex_init(&s->lock, NULL);
+
+    if (SUCCEED != cfg_store_reload(s)) {
+        pthread_mutex_destroy(&s->lock);
+        goto fail;
+    }
+
+    *store = s;
+
+    return SUCCEED;
+fail:
+    if (NULL != s) {
+        free(s->cfg);
+        free(s->cfg_file);
+        free(s);
+    }
+
+    return FAIL;
+}
+
+int cfg_store_reload(struct cfg_store *store)
+{
+    struct cfg_snap *snap, *old;
+
+    if (NULL == (snap = cfg_snap_parse(store)))
+        return FAIL;
+
+    snap->pub.version = ++store->version;
+
+    old = __atomic_exchange_n(&store->current, snap, __ATOMIC_SEQ_CST);
+
+    /* old cannot be released before it is retired below */
+    if (NULL != store->subs)
+        cfg_subs_notify(store->subs, NULL != old ? old->result : NULL,
+                        snap->result);
+
+    pthread_mutex_lock(&store->lock);
+
+    if (NULL != old) {
+        old->retired = __atomic_add_fetch(&store->epoch, 1, __ATOMIC_SEQ_CST);
+        old->next = store->retired;
+        store->retired = old;
+    }
+
+    cfg_store_reclaim_locked(store);
+    pthread_mutex_unlock(&store->lock);
+
+    return SUCCEED;
+}
+
+void cfg_store_notify(struct cfg_store *store, struct cfg_subs *subs)
+{
+    store->subs = subs;
+}
+
+const struct cfg_snapshot *cfg_store_current(struct cfg_store *store)
+{
+    return &__atomic_load_n(&store->current, __ATOMIC_ACQUIRE)->pub;
+}
+
+size_t cfg_store_reclaim(struct cfg_store *store)
+{
+    size_t left;
+
+    pthread_mutex_lock(&store->lock);
+    left = cfg_store_reclaim_locked(store);
+    pthread_mutex_unlock(&store->lock);
+
+    return left;
+}
+
+void cfg_store_destroy(struct cfg_store *store)
+{
+    struct cfg_snap *snap;
+
+    if (NULL == store)
+        return;
+
+    while (NULL != (snap = store->retired)) {
+        store->retired = snap->next;
+        cfg_snap_free(store, snap);
+    }
+
+    cfg_snap_free(store, store->current);
+    pthread_mutex_destroy(&store->lock);
+    free(store->cfg);
+    free(store->cfg_file);
+    free(store);
+}
+
+struct cfg_reader *cfg_reader_register(struct cfg_store *store)
+{
+    struct cfg_reader *r;
+
+    if (NULL == (r = calloc(1, sizeof(*r)))) {
+        LOG_ERR("cannot allocate reader of [%s]", store->cfg_file);
+        return NULL;
+    }
+
+    r->store = store;
+
+    pthread_mutex_lock(&store->lock);
+    cfg_reader_online(r);
+    r->next = store->readers;
+    store->readers = r;
+    pthread_mutex_unlock(&store->lock);
+
+    return r;
+}
+
+void cfg_reader_unregister(struct cfg_reader *reader)
+{
+    struct cfg_store *store;
+    struct cfg_reader **p;
+
+    if (NULL == reader)
+        return;
+
+    store = reader->store;
+
+    pthread_mutex_lock(&store->lock);
+
+    for (p = &store->readers; NULL != *p; p = &(*p)->next) {
+        if (reader == *p) {
+            *p = reader->next;
+            break;
+        }
+    }
+
+    cfg_store_reclaim_locked(store);
+    pthread_mutex_unlock(&store->lock);
+
+    free(reader);
+}
+
+void cfg_reader_quiescent(struct cfg_reader *reader)
+{
+    __atomic_store_n(&reader->epoch,
+                     __atomic_load_n(&reader->store->epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+}
+
+void cfg_reader_offline(struct cfg_reader *reader)
+{
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_SEQ_CST);
+}
+
+void cfg_reader_online(struct cfg_reader *reader)
+{
+    cfg_reader_quiescent(reader);
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyleft
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cfg.h"
+#include "diff.h"
+
+/**
+ * Variable of a snapshot table: offset of a member in the caller's config
+ * structure instead of a pointer to a global
+ */
+#define CFG_FIELD(type, member)     ((void *)offsetof(type, member))
+
+/**
+ * Immutable result of one parse, data points to a structure of the size
+ * given to cfg_store_create() with members filled as described by the table
+ */
+struct cfg_snapshot {
+    uint64_t    version;
+    const void *data;
+};
+
+/* current snapshot of a configuration file and the ones still being read */
+struct cfg_store;
+
+/* thread reading snapshots of a store */
+struct cfg_reader;
+
+/**
+ * Create a store and parse the first snapshot
+ *
+ * @param store
+ *   [OUT] the store, release it with cfg_store_destroy()
+ * @param cfg_file
+ *   [IN] full name of config file
+ * @param cfg
+ *   [IN] configuration parameter table whose variables are CFG_FIELD()
+ *   offsets, it is copied
+ * @param size
+ *   [IN] size of the config structure
+ * @param optional
+ *   [IN] do not treat missing configuration file as error
+ * @param strict
+ *   [IN] treat unknown parameters as error
+ *
+ * @return
+ *   SUCCEED - the store holds snapshot version 1
+ *   FAIL - error processing config file or out of memory
+ */
+int cfg_store_create(struct cfg_store **store, const char *cfg_file,
+                     const struct cfg_line *cfg, size_t size, int optional,
+                     int strict);
+
+/**
+ * Parse configuration file into a new snapshot and publish it
+ *
+ * @param store
+ *   [IN] the store
+ *
+ * @return
+ *   SUCCEED - the new snapshot is current
+ *   FAIL - error processing config file, the current snapshot is kept
+ *
+ * @comments
+ *   Reloads of one store should not run concurrently.  Replaced snapshots
+ *   are released once every online reader has passed a quiescent state.
+ */
+int cfg_store_reload(struct cfg_store *store);
+
+/**
+ * Notify subscriptions of the parameters that differ on each reload
+ *
+ * @param store
+ *   [IN] the store
+ * @param subs
+ *   [IN] subscriptions, NULL to stop notifying, they must outlive the store
+ *   or the next call
+ *
+ * @comments
+ *   Snapshots parsed from then on keep every parameter as
+ *   parse_cfg_file_all() does.  Callbacks run on the reloading thread after
+ *   the new snapshot is published, the first reload after this reports
+ *   every parameter as added since the snapshot it replaces does not keep
+ *   them.
+ */
+void cfg_store_notify(struct cfg_store *store, struct cfg_subs *subs);
+
+/**
+ * Get the current snapshot, this is a single atomic load
+ *
+ * @param store
+ *   [IN] the store
+ *
+ * @return
+ *   the snapshot, valid until the calling reader's next
+ *   cfg_reader_quiescent() or cfg_reader_offline()
+ */
+const struct cfg_snapshot *cfg_store_current(struct cfg_store *store);
+
+/**
+ * Release snapshots that are not read anymore
+ *
+ * @return
+ *   number of snapshots still waiting for readers
+ */
+size_t cfg_store_reclaim(struct cfg_store *store);
+
+/**
+ * Release a store and all its snapshots, no reader may be registered
+ */
+void cfg_store_destroy(struct cfg_store *store);
+
+/**
+ * Register the calling thread as a reader, it starts online
+ *
+ * @return
+ *   the reader or NULL if out of memory
+ */
+struct cfg_reader *cfg_reader_register(struct cfg_store *store);
+
+/**
+ * Unregister a reader, snapshots it got must not be used anymore
+ */
+void cfg_reader_unregister(struct cfg_reader *reader);
+
+/**
+ * Tell that snapshots got so far are not used anymore, e.g. between two
+ * requests of a worker loop
+ */
+void cfg_reader_quiescent(struct cfg_reader *reader);
+
+/**
+ * Stop holding up reclamation while not reading snapshots, e.g. before
+ * blocking for a long time
+ */
+void cfg_reader_offline(struct cfg_reader *reader);
+
+/**
+ * Resume reading snapshots after cfg_reader_offline()
+ */
+void cfg_reader_online(struct cfg_reader *reader);
+
+#endif /* SNAPSHOT_H */
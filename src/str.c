@@ -2,13 +2,20 @@
  * Copyleft
  */
 
-#include <ctype.h>
+#define _GNU_SOURCE
+
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+#include "arena.h"
 #include "str.h"
 
 char *
@@ -25,6 +32,33 @@ str_strdup(const char *str)
     }
 }
 
+char *
+str_strndup(const char *str, size_t n)
+{
+    char *tmp = (char *)malloc(n + 1);
+
+    if (NULL == tmp)
+        return NULL;
+
+    memcpy(tmp, str, n);
+    tmp[n] = '\0';
+
+    return tmp;
+}
+
+uint32_t
+str_hash_n(const char *str, size_t n)
+{
+    uint32_t    h = 2166136261u;
+
+    while (0 < n--) {
+        h ^= (unsigned char)*str++;
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
 /**
  * Strip characters from the end of a string
  *
@@ -99,39 +133,176 @@ str_lrtrim(char *str, const char *charlist)
     str_ltrim(str, charlist);
 }
 
+void
+str_buf_init(struct str_buf *sb)
+{
+    sb->data = sb->inline_data;
+    sb->data[0] = '\0';
+    sb->len = 0;
+    sb->alloc = sizeof(sb->inline_data);
+}
+
+int
+str_buf_reserve(struct str_buf *sb, size_t n)
+{
+    size_t  alloc;
+    char   *data;
+
+    if (n < sb->alloc - sb->len)
+        return SUCCEED;
+
+    /* double, or grow right to the size needed by a long append */
+    if ((alloc = sb->alloc * 2) - sb->len <= n)
+        alloc = sb->len + n + 1;
+
+    if (sb->data == sb->inline_data) {
+        if (NULL == (data = malloc(alloc)))
+            return FAIL;
+
+        memcpy(data, sb->data, sb->len + 1);
+    }
+    else if (NULL == (data = realloc(sb->data, alloc)))
+        return FAIL;
+
+    sb->data = data;
+    sb->alloc = alloc;
+
+    return SUCCEED;
+}
+
+int
+str_buf_append_n(struct str_buf *sb, const char *str, size_t n)
+{
+    if (SUCCEED != str_buf_reserve(sb, n))
+        return FAIL;
+
+    memcpy(sb->data + sb->len, str, n);
+    sb->len += n;
+    sb->data[sb->len] = '\0';
+
+    return SUCCEED;
+}
+
+int
+str_buf_append(struct str_buf *sb, const char *str)
+{
+    return str_buf_append_n(sb, str, strlen(str));
+}
+
+int
+str_buf_vprintf(struct str_buf *sb, const char *f, va_list args)
+{
+    va_list curr;
+    int     n;
+
+    va_copy(curr, args);
+    n = vsnprintf(sb->data + sb->len, sb->alloc - sb->len, f, curr);
+    va_end(curr);
+
+    if (0 > n)
+        goto fail;
+
+    if ((size_t)n >= sb->alloc - sb->len) {
+        /* truncated, n bytes + trailing '\0' are needed */
+        if (SUCCEED != str_buf_reserve(sb, (size_t)n))
+            goto fail;
+
+        va_copy(curr, args);
+        n = vsnprintf(sb->data + sb->len, sb->alloc - sb->len, f, curr);
+        va_end(curr);
+
+        if (0 > n)
+            goto fail;
+    }
+
+    sb->len += (size_t)n;
+
+    return SUCCEED;
+fail:
+    sb->data[sb->len] = '\0';
+
+    return FAIL;
+}
+
+int
+str_buf_printf(struct str_buf *sb, const char *f, ...)
+{
+    va_list args;
+    int     ret;
+
+    va_start(args, f);
+    ret = str_buf_vprintf(sb, f, args);
+    va_end(args);
+
+    return ret;
+}
+
+void
+str_buf_truncate(struct str_buf *sb, size_t len)
+{
+    if (len < sb->len) {
+        sb->len = len;
+        sb->data[len] = '\0';
+    }
+}
+
+void
+str_buf_reset(struct str_buf *sb)
+{
+    str_buf_truncate(sb, 0);
+}
+
+void
+str_buf_free(struct str_buf *sb)
+{
+    if (sb->data != sb->inline_data)
+        free(sb->data);
+
+    str_buf_init(sb);
+}
+
 /**
  * Dynamical formatted output conversion
  *
  * @return
- *   formatted string, a pointer to allocated memory
+ *   formatted string, a pointer to allocated memory, NULL if out of memory
+ *
+ * @comments
+ *   the string is formatted on the stack and copied out at its exact size,
+ *   only strings longer than the stack buffer are formatted twice
  */
 char *
 str_dvsprintf(char *dest, const char *f, va_list args)
 {
-    char *string = NULL;
-    int n, size = MAX_STRING_LEN >> 1;
-
+    char    buf[MAX_STRING_LEN >> 1], *string = NULL;
     va_list curr;
+    int     n;
 
-    while (1) {
-        string = malloc(size);
+    va_copy(curr, args);
+    n = vsnprintf(buf, sizeof(buf), f, curr);
+    va_end(curr);
 
-        va_copy(curr, args);
-        n = vsnprintf(string, size, f, curr);
-        va_end(curr);
+    if (0 > n)
+        goto out;
 
-        if (0 <= n && n < size)
-            break;
+    if ((size_t)n < sizeof(buf)) {
+        string = str_strndup(buf, (size_t)n);
+        goto out;
+    }
 
-        /* result was truncated */
-        if (-1 == n)
-            size = size * 3 / 2 + 1;    /* the length is unknown */
-        else
-            size = n + 1;   /* n bytes + trailing '\0' */
+    /* result was truncated, n bytes + trailing '\0' are needed */
+    if (NULL == (string = malloc((size_t)n + 1)))
+        goto out;
 
+    va_copy(curr, args);
+    n = vsnprintf(string, (size_t)n + 1, f, curr);
+    va_end(curr);
+
+    if (0 > n) {
         free(string);
+        string = NULL;
     }
-
+out:
     free(dest);
 
     return string;
@@ -159,91 +330,363 @@ str_dsprintf(char *dest, const char *f, ...)
 }
 
 /**
- * Check UTF-8 sequences
+ * Validate a single UTF-8 character
  *
- * @param
- *   text - [IN] pointer to the string
+ * @param text
+ *   [IN] pointer to the first byte of the character
+ * @param n
+ *   [IN] number of bytes available, at least 1
  *
  * @return
- *   SUCCEED if string is valid or FAIL otherwise
+ *   length of the character or 0 if it is not valid
  */
-int str_is_utf8(const char *text)
+size_t
+str_utf8_char_len(const char *text, size_t n)
 {
     size_t i, mb_len, expecting_bytes = 0;
-    const unsigned char *utf8;
+    const unsigned char *utf8 = (const unsigned char *)text;
     unsigned int utf32;
 
-    while ('\0' != *text) {
-        /* single ASCII character */
-        if (0 == (*text & 0x80)) {
-            text++;
-            continue;
-        }
+    /* single ASCII character */
+    if (0 == (*text & 0x80))
+        return 1;
+
+    /* unexpected continuation byte or invalid UTF-8 bytes '\xfe' & '\xff' */
+    if (0x80 == (*text & 0xc0) || 0xfe == (*text & 0xfe))
+        return 0;
+
+    /* multibyte sequence */
 
-        /* unexpected continuation byte or invalid UTF-8 bytes '\xfe' & '\xff' */
-        if (0x80 == (*text & 0xc0) || 0xfe == (*text & 0xfe))
+    if (0xc0 == (*text & 0xe0))     /* 2-bytes multibyte sequence */
+        expecting_bytes = 1;
+    else if (0xe0 == (*text & 0xf0))    /* 3-bytes multibyte sequence */
+        expecting_bytes = 2;
+    else if (0xf0 == (*text & 0xf8))    /* 4-bytes multibyte sequence */
+        expecting_bytes = 3;
+    else if (0xf8 == (*text & 0xfc))    /* 5-bytes multibyte sequence */
+        expecting_bytes = 4;
+    else if (0xfc == (*text & 0xfe))    /* 6-bytes multibyte sequence */
+        expecting_bytes = 5;
+
+    mb_len = expecting_bytes + 1;
+
+    if (n < mb_len)
+        return 0;   /* truncated sequence */
+
+    for (i = 1; i < mb_len; i++) {
+        /* not a continuation byte */
+        if (0x80 != (utf8[i] & 0xc0))
+            return 0;
+    }
+
+    /* overlong sequence */
+    if (0xc0 == (utf8[0] & 0xfe) ||
+        (0xe0 == utf8[0] && 0x00 == (utf8[1] & 0x20)) ||
+        (0xf0 == utf8[0] && 0x00 == (utf8[1] & 0x30)) ||
+        (0xf8 == utf8[0] && 0x00 == (utf8[1] & 0x38)) ||
+        (0xfc == utf8[0] && 0x00 == (utf8[1] & 0x3c))) {
+        return 0;
+    }
+
+    utf32 = 0;
+
+    if (0xc0 == (utf8[0] & 0xe0))
+        utf32 = utf8[0] & 0x1f;
+    else if (0xe0 == (utf8[0] & 0xf0))
+        utf32 = utf8[0] & 0x0f;
+    else if (0xf0 == (utf8[0] & 0xf8))
+        utf32 = utf8[0] & 0x07;
+    else if (0xf8 == (utf8[0] & 0xfc))
+        utf32 = utf8[0] & 0x03;
+    else if (0xfc == (utf8[0] & 0xfe))
+        utf32 = utf8[0] & 0x01;
+
+    for (i = 1; i < mb_len; i++) {
+        utf32 <<= 6;
+        utf32 += utf8[i] & 0x3f;
+    }
+
+    /* according to the Unicode standard the high and low
+     * surrogate halves used by UTF-16 (U+D800 through U+DFFF)
+     * and values above U+10FFFF are not legal
+     */
+    if (utf32 > 0x10ffff || 0xd800 == (utf32 & 0xf800))
+        return 0;
+
+    return mb_len;
+}
+
+static int
+str_is_utf8_scalar(const char *text, size_t n)
+{
+    size_t len;
+
+    while (0 < n) {
+        if (0 == (len = str_utf8_char_len(text, n)))
             return FAIL;
 
-        /* multibyte sequence */
+        text += len;
+        n -= len;
+    }
 
-        utf8 = (const unsigned char *)text;
+    return SUCCEED;
+}
 
-        if (0xc0 == (*text & 0xe0))     /* 2-bytes multibyte sequence */
-            expecting_bytes = 1;
-        else if (0xe0 == (*text & 0xf0))    /* 3-bytes multibyte sequence */
-            expecting_bytes = 2;
-        else if (0xf0 == (*text & 0xf8))    /* 4-bytes multibyte sequence */
-            expecting_bytes = 3;
-        else if (0xf8 == (*text & 0xfc))    /* 5-bytes multibyte sequence */
-            expecting_bytes = 4;
-        else if (0xfc == (*text & 0xfe))    /* 6-bytes multibyte sequence */
-            expecting_bytes = 5;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STR_UTF8_SIMD
 
-        mb_len = expecting_bytes + 1;
-        text++;
+/**
+ * SSE2 version, skips 16 byte runs of ASCII and validates everything else
+ * one character at a time
+ */
+__attribute__((target("sse2")))
+static int
+str_is_utf8_sse2(const char *text, size_t n)
+{
+    const char *end = text + n;
+    size_t len;
 
-        for (; 0 != expecting_bytes; expecting_bytes--) {
-            /* not a continuation byte */
-            if (0x80 != (*text++ & 0xc0))
-                return FAIL;
+    while (text < end) {
+        if (16 <= end - text &&
+            0 == _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)text))) {
+            text += 16;
+            continue;
         }
 
-        /* overlong sequence */
-        if (0xc0 == (utf8[0] & 0xfe) ||
-            (0xe0 == utf8[0] && 0x00 == (utf8[1] & 0x20)) ||
-            (0xf0 == utf8[0] && 0x00 == (utf8[1] & 0x30)) ||
-            (0xf8 == utf8[0] && 0x00 == (utf8[1] & 0x38)) ||
-            (0xfc == utf8[0] && 0x00 == (utf8[1] & 0x3c))) {
+        if (0 == (len = str_utf8_char_len(text, end - text)))
             return FAIL;
+
+        text += len;
+    }
+
+    return SUCCEED;
+}
+
+/*
+ * AVX2 version of the lookup algorithm by Keiser and Lemire: every byte is
+ * classified by three table lookups on its own high nibble and on both
+ * nibbles of the previous byte, any error class present in all three marks
+ * an invalid pair.  Third and fourth bytes of longer sequences are checked
+ * separately.
+ */
+#define U8_TOO_SHORT        (1 << 0)    /* 11______ 0_______ */
+                                        /* 11______ 11______ */
+#define U8_TOO_LONG         (1 << 1)    /* 0_______ 10______ */
+#define U8_OVERLONG_3       (1 << 2)    /* 11100000 100_____ */
+#define U8_TOO_LARGE        (1 << 3)    /* 11110100 1001____ */
+                                        /* 11110100 101_____ */
+                                        /* 11110101 1001____ and above */
+#define U8_SURROGATE        (1 << 4)    /* 11101101 101_____ */
+#define U8_OVERLONG_2       (1 << 5)    /* 1100000_ 10______ */
+#define U8_TOO_LARGE_1000   (1 << 6)    /* 11110101 1000____ and above */
+#define U8_OVERLONG_4       (1 << 6)    /* 11110000 1000____ */
+#define U8_TWO_CONTS        (1 << 7)    /* 10______ 10______ */
+#define U8_CARRY            (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+#define U8_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)           \
+    _mm256_setr_epi8((char)(a), (char)(b), (char)(c), (char)(d),           \
+                     (char)(e), (char)(f), (char)(g), (char)(h),           \
+                     (char)(i), (char)(j), (char)(k), (char)(l),           \
+                     (char)(m), (char)(n), (char)(o), (char)(p),           \
+                     (char)(a), (char)(b), (char)(c), (char)(d),           \
+                     (char)(e), (char)(f), (char)(g), (char)(h),           \
+                     (char)(i), (char)(j), (char)(k), (char)(l),           \
+                     (char)(m), (char)(n), (char)(o), (char)(p))
+
+/* previous input shifted in by n bytes */
+#define U8_PREV(in, prev, n)                                               \
+    _mm256_alignr_epi8(in, _mm256_permute2x128_si256(prev, in, 0x21), 16 - n)
+
+__attribute__((target("avx2")))
+static __m256i
+str_utf8_check_avx2(__m256i in, __m256i prev)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i byte_1_high_table = U8_TABLE(
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+        U8_TOO_SHORT | U8_OVERLONG_2,
+        U8_TOO_SHORT,
+        U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+        U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4);
+    const __m256i byte_1_low_table = U8_TABLE(
+        U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+        U8_CARRY | U8_OVERLONG_2,
+        U8_CARRY,
+        U8_CARRY,
+        U8_CARRY | U8_TOO_LARGE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000);
+    const __m256i byte_2_high_table = U8_TABLE(
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 |
+        U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 |
+        U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE |
+        U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE |
+        U8_TOO_LARGE,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT);
+    __m256i prev1, prev2, prev3, special, must23, quirk;
+
+    prev1 = U8_PREV(in, prev, 1);
+    prev2 = U8_PREV(in, prev, 2);
+    prev3 = U8_PREV(in, prev, 3);
+
+    special = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(byte_1_high_table,
+                _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+            _mm256_shuffle_epi8(byte_1_low_table,
+                _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(byte_2_high_table,
+            _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble)));
+
+    /* bytes following a 3 or 4 byte lead by two or three positions must be
+       continuation bytes, which is exactly when TWO_CONTS is expected */
+    must23 = _mm256_and_si256(
+        _mm256_or_si256(
+            _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80))),
+            _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80)))),
+        _mm256_set1_epi8((char)0x80));
+
+    /* str_utf8_char_len() rejects every code point matching the surrogate
+       mask 0xf800, in 4 byte sequences those are the ones with second byte
+       x0d and the third byte 101_____ */
+    quirk = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_max_epu8(prev2, _mm256_set1_epi8((char)0xf0)),
+                              prev2),
+            _mm256_cmpeq_epi8(_mm256_and_si256(prev1, nibble),
+                              _mm256_set1_epi8(0x0d))),
+        _mm256_cmpeq_epi8(_mm256_and_si256(in, _mm256_set1_epi8((char)0xe0)),
+                          _mm256_set1_epi8((char)0xa0)));
+
+    return _mm256_or_si256(_mm256_xor_si256(must23, special), quirk);
+}
+
+__attribute__((target("avx2")))
+static int
+str_is_utf8_avx2(const char *text, size_t n)
+{
+    /* a block ending with any of these bytes has an unfinished sequence */
+    const __m256i max_value = _mm256_setr_epi8(
+        (char)0xff, (char)0xff, (char)0xff, (char)0xff,
+        (char)0xff, (char)0xff, (char)0xff, (char)0xff,
+        (char)0xff, (char)0xff, (char)0xff, (char)0xff,
+        (char)0xff, (char)0xff, (char)0xff, (char)0xff,
+        (char)0xff, (char)0xff, (char)0xff, (char)0xff,
+        (char)0xff, (char)0xff, (char)0xff, (char)0xff,
+        (char)0xff, (char)0xff, (char)0xff, (char)0xff,
+        (char)0xff, (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+    __m256i in, prev = _mm256_setzero_si256(), error = _mm256_setzero_si256(),
+        incomplete = _mm256_setzero_si256();
+    char tail[32];
+    size_t i;
+
+    for (i = 0; i < n; i += 32) {
+        if (32 <= n - i) {
+            in = _mm256_loadu_si256((const __m256i *)(text + i));
+        } else {
+            /* zero padding makes an unfinished sequence a TOO_SHORT error */
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, text + i, n - i);
+            in = _mm256_loadu_si256((const __m256i *)tail);
         }
 
-        utf32 = 0;
-
-        if (0xc0 == (utf8[0] & 0xe0))
-            utf32 = utf8[0] & 0x1f;
-        else if (0xe0 == (utf8[0] & 0xf0))
-            utf32 = utf8[0] & 0x0f;
-        else if (0xf0 == (utf8[0] & 0xf8))
-            utf32 = utf8[0] & 0x07;
-        else if (0xf8 == (utf8[0] & 0xfc))
-            utf32 = utf8[0] & 0x03;
-        else if (0xfc == (utf8[0] & 0xfe))
-            utf32 = utf8[0] & 0x01;
-
-        for (i = 1; i < mb_len; i++) {
-            utf32 <<= 6;
-            utf32 += utf8[i] & 0x3f;
+        if (0 == _mm256_movemask_epi8(in)) {
+            /* ASCII can only be wrong if the previous block was unfinished */
+            error = _mm256_or_si256(error, incomplete);
+            incomplete = _mm256_setzero_si256();
+        } else {
+            error = _mm256_or_si256(error, str_utf8_check_avx2(in, prev));
+            incomplete = _mm256_subs_epu8(in, max_value);
         }
 
-        /* according to the Unicode standard the high and low
-         * surrogate halves used by UTF-16 (U+D800 through U+DFFF)
-         * and values above U+10FFFF are not legal
-         */
-        if (utf32 > 0x10ffff || 0xd800 == (utf32 & 0xf800))
-            return FAIL;
+        prev = in;
     }
 
-    return SUCCEED;
+    error = _mm256_or_si256(error, incomplete);
+
+    return 0 != _mm256_testz_si256(error, error) ? SUCCEED : FAIL;
+}
+
+static int (*str_is_utf8_impl)(const char *, size_t);
+
+/**
+ * Pick UTF-8 validator for the CPU we are running on
+ */
+static int (*str_is_utf8_select(void))(const char *, size_t)
+{
+    __builtin_cpu_init();
+
+    if (0 != __builtin_cpu_supports("avx2"))
+        return str_is_utf8_avx2;
+
+    if (0 != __builtin_cpu_supports("sse2"))
+        return str_is_utf8_sse2;
+
+    return str_is_utf8_scalar;
+}
+#endif
+
+/**
+ * Check UTF-8 sequences
+ *
+ * @param
+ *   text - [IN] pointer to the string
+ *
+ * @return
+ *   SUCCEED if string is valid or FAIL otherwise
+ */
+int str_is_utf8(const char *text)
+{
+    return str_is_utf8_n(text, strlen(text));
+}
+
+/**
+ * Check UTF-8 sequences of a string that is not null terminated
+ *
+ * @param text
+ *   [IN] pointer to the string
+ * @param n
+ *   [IN] string length
+ *
+ * @return
+ *   SUCCEED if string is valid or FAIL otherwise
+ *
+ * @comments
+ *   SSE2 or AVX2 code is used when the CPU supports it, short strings are
+ *   always checked by the scalar code
+ */
+int str_is_utf8_n(const char *text, size_t n)
+{
+#ifdef STR_UTF8_SIMD
+    int (*impl)(const char *, size_t);
+
+    if (32 <= n) {
+        if (NULL == (impl = __atomic_load_n(&str_is_utf8_impl,
+                                            __ATOMIC_RELAXED))) {
+            impl = str_is_utf8_select();
+            __atomic_store_n(&str_is_utf8_impl, impl, __ATOMIC_RELAXED);
+        }
+
+        return impl(text, n);
+    }
+#endif
+    return str_is_utf8_scalar(text, n);
 }
 
 /**
@@ -270,49 +713,176 @@ int str_is_utf8(const char *text)
  *           range
  *
  */
-int is_uint_n_range(const char *str, size_t n, void *value, size_t size,
-                    uint64_t min, uint64_t max)
+#define STR_SWAR_ZEROS      __UINT64_C(0x3030303030303030)
+
+static const uint64_t   str_pow10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+};
+
+/**
+ * Load 8 characters so that the first one is in the lowest byte
+ */
+static uint64_t
+str_swar_load(const char *str)
+{
+    uint64_t    x;
+
+    memcpy(&x, str, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = __builtin_bswap64(x);
+#endif
+    return x;
+}
+
+/**
+ * See whether all 8 characters are decimal digits, digits are 0x30-0x39 so
+ * their high nibbles are 3 and adding 6 leaves the high nibble alone
+ */
+static int
+str_swar_digits(uint64_t x)
+{
+    const uint64_t  high = __UINT64_C(0xF0F0F0F0F0F0F0F0);
+
+    return ((x & high) | (((x + __UINT64_C(0x0606060606060606)) & high) >> 4)) ==
+           __UINT64_C(0x3333333333333333);
+}
+
+/**
+ * Convert 8 digits at once: pairs of digits, then quadruples, then both
+ * halves are combined with multiplications that do not carry into each other
+ */
+static uint64_t
+str_swar_value(uint64_t x)
 {
-    const uint64_t  max_uint64 = ~(uint64_t)__UINT64_C(0);
-    uint64_t value_uint64 = 0, c;
-    unsigned short value_offset;
-    int len = 0;
+    const uint64_t  mask = __UINT64_C(0x000000FF000000FF);
+
+    x -= STR_SWAR_ZEROS;
+    x = x * 10 + (x >> 8);
 
-    if ('\0' == *str || 0 == n || sizeof(uint64_t) < size
-        || (0 == size && NULL != value)) {
+    return (((x & mask) * __UINT64_C(0x000F424000000064)) +
+            (((x >> 16) & mask) * __UINT64_C(0x0000271000000001))) >> 32;
+}
+
+/**
+ * Convert digits to 64bit unsigned integer 8 at a time
+ *
+ * @param str
+ *   [IN] digits, n bytes must be readable
+ * @param n
+ *   [IN] number of bytes, the conversion stops early at a null character
+ * @param value
+ *   [OUT] converted value
+ *
+ * @return
+ *   SUCCEED - str starts with a digit and has only digits up to n bytes or
+ *             a null character, the value fits into 64 bits
+ *   FAIL - otherwise
+ */
+static int
+str_uint64_n(const char *str, size_t n, uint64_t *value)
+{
+    uint64_t    v = 0, x;
+    size_t      i = 0, rest;
+    char        tail[8];
+    unsigned    c;
 
+    if (0 == n)
         return FAIL;
+
+    for (; i + 8 <= n; i += 8) {
+        x = str_swar_load(str + i);
+
+        if (0 == str_swar_digits(x))
+            goto scalar;
+
+        if (__builtin_mul_overflow(v, str_pow10[8], &v) ||
+            __builtin_add_overflow(v, str_swar_value(x), &v))
+            return FAIL;
     }
 
-    while ('\0' != *str && 0 < n--) {
-        if (0 == isdigit(*str))
-            return FAIL;    /* not a digit */
+    if (i < n) {
+        /* leading zeros do not change the value of the last digits */
+        rest = n - i;
+        memset(tail, '0', sizeof(tail));
+        memcpy(tail + sizeof(tail) - rest, str + i, rest);
+        x = str_swar_load(tail);
 
-        c = (uint64_t)(unsigned char)(*str - '0');
+        if (0 == str_swar_digits(x))
+            goto scalar;
 
-        if (20 <= ++len && (max_uint64 - c) / 10 < value_uint64)
-            return FAIL;    /* maximum value exceeded */
+        if (__builtin_mul_overflow(v, str_pow10[rest], &v) ||
+            __builtin_add_overflow(v, str_swar_value(x), &v))
+            return FAIL;
+    }
 
-        value_uint64 = value_uint64 * 10 + c;
+    *value = v;
+
+    return SUCCEED;
+scalar:
+    /* the block with a character that is not a digit */
+    for (; i < n; i++) {
+        if (9 < (c = (unsigned char)str[i] - (unsigned)'0')) {
+            if ('\0' != str[i] || 0 == i)
+                return FAIL;
+            break;
+        }
 
-        str++;
+        if (__builtin_mul_overflow(v, 10, &v) ||
+            __builtin_add_overflow(v, c, &v))
+            return FAIL;
     }
 
-    if (min > value_uint64 || value_uint64 > max)
+    *value = v;
+
+    return SUCCEED;
+}
+
+int is_uint_n_range(const char *str, size_t n, void *value, size_t size,
+                    uint64_t min, uint64_t max)
+{
+    uint64_t    value_uint64;
+    uint32_t    value_uint32;
+    uint16_t    value_uint16;
+    uint8_t     value_uint8;
+
+    if (sizeof(uint64_t) < size || (0 == size && NULL != value))
         return FAIL;
 
-    if (NULL != value) {
-        /* On little endian architecture the output value will be stored
-           starting from the first bytes of 'value' buffer while on big endian
-           architecture it will be stored starting from the last bytes. We handle
-           it by storing the offset in the most significant byte of short value
-           and then use the first byte as source offset.  */
+    /* n may only be an upper bound, do not read past the end of str */
+    if (SUCCEED != str_uint64_n(str, strnlen(str, n), &value_uint64))
+        return FAIL;
 
-        value_offset = (unsigned short)((sizeof(uint64_t) - size) << 8);
+    if (min > value_uint64 || value_uint64 > max)
+        return FAIL;
 
-        memcpy(value,
-               (unsigned char *)&value_uint64 + *((unsigned char *)&value_offset),
+    if (NULL == value)
+        return SUCCEED;
+
+    /* keep the least significant bytes like a cast to a smaller type does */
+    switch (size) {
+    case sizeof(uint64_t):
+        memcpy(value, &value_uint64, size);
+        break;
+    case sizeof(uint32_t):
+        value_uint32 = (uint32_t)value_uint64;
+        memcpy(value, &value_uint32, size);
+        break;
+    case sizeof(uint16_t):
+        value_uint16 = (uint16_t)value_uint64;
+        memcpy(value, &value_uint16, size);
+        break;
+    case sizeof(uint8_t):
+        value_uint8 = (uint8_t)value_uint64;
+        memcpy(value, &value_uint8, size);
+        break;
+    default:
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        memcpy(value, (unsigned char *)&value_uint64 + sizeof(uint64_t) - size,
                size);
+#else
+        memcpy(value, &value_uint64, size);
+#endif
+        break;
     }
 
     return SUCCEED;
@@ -330,9 +900,6 @@ int is_uint_n_range(const char *str, size_t n, void *value, size_t size,
 #define SEC_PER_MONTH      (30 * SEC_PER_DAY)
 #define SEC_PER_YEAR       (365 * SEC_PER_DAY)
 
-#define is_uint64_n(str, n, value)                                      \
-    is_uint_n_range(str, n, value, 8, 0x0, __UINT64_C(0xFFFFFFFFFFFFFFFF))
-
 static uint64_t
 suffix2factor(char c)
 {
@@ -376,13 +943,36 @@ suffix2factor(char c)
  *   the function automatically processes suffixes K, M, G, T
  */
 int str2uint64(const char *str, const char *suffixes, uint64_t *value)
+{
+    return str2uint64_n(str, strlen(str), suffixes, value);
+}
+
+/**
+ * Convert string that is not null terminated to 64bit unsigned integer
+ *
+ * @param str
+ *   [IN] string to convert
+ * @param sz
+ *   [IN] string length
+ * @param suffixes
+ *   [IN] accepted suffixes
+ * @param value
+ *   [OUT] a pointer to converted value
+ *
+ * @return
+ *   SUCCEED - the string is unsigned integer
+ *   FAIL - otherwise
+ */
+int str2uint64_n(const char *str, size_t sz, const char *suffixes,
+                 uint64_t *value)
 {
     uint64_t factor = 1;
     const char *p;
-    size_t sz;
     int ret;
 
-    sz = strlen(str);
+    if (0 == sz)
+        return FAIL;
+
     p = str + sz - 1;
 
     if (NULL != strchr(suffixes, *p)) {
@@ -390,7 +980,7 @@ int str2uint64(const char *str, const char *suffixes, uint64_t *value)
         sz--;
     }
 
-    if (SUCCEED == (ret = is_uint64_n(str, sz, value)))
+    if (SUCCEED == (ret = str_uint64_n(str, sz, value)))
         *value *= factor;
 
     return ret;
@@ -459,39 +1049,105 @@ str_trim_str_list(char *list, char delimiter)
     *out = '\0';
 }
 
+/*
+ * Dynamic string arrays are handed out as a plain NULL terminated char **,
+ * the bookkeeping lives in a header right in front of the first slot.
+ */
+struct str_strarr {
+    size_t          count;
+    size_t          capacity;   /* slots, not counting the terminating NULL */
+    struct arena   *strings;    /* copies made by str_strarr_add() */
+    char           *slots[];
+};
+
+#define STR_STRARR_MIN      4
+#define STR_STRARR_HDR(arr)                                             \
+    ((struct str_strarr *)(void *)((char *)(arr) -                      \
+                                   offsetof(struct str_strarr, slots)))
+
 int
 str_strarr_add(char ***arr, const char *entry)
 {
-    int i;
-
-    for (i = 0; NULL != (*arr)[i]; i++)
-        ;
+    return str_strarr_add_n(arr, entry, strlen(entry));
+}
 
-    *arr = realloc(*arr, sizeof(char **) * (i + 2));
+int
+str_strarr_add_n(char ***arr, const char *entry, size_t n)
+{
+    struct str_strarr *hdr = STR_STRARR_HDR(*arr);
+    char *copy;
 
-    if (NULL == *arr) {
+    if (NULL == hdr->strings && NULL == (hdr->strings = arena_create()))
         return FAIL;
-    }
 
-    (*arr)[i] = str_strdup(entry);
-    if (NULL == (*arr)[i]) {
+    if (NULL == (copy = arena_strndup(hdr->strings, entry, n)))
         return FAIL;
+
+    return str_strarr_append(arr, copy);
+}
+
+int
+str_strarr_append(char ***arr, char *entry)
+{
+    struct str_strarr *hdr = STR_STRARR_HDR(*arr);
+    size_t capacity;
+
+    if (hdr->count == hdr->capacity) {
+        capacity = STR_STRARR_MIN > hdr->capacity ?
+            STR_STRARR_MIN : hdr->capacity * 2;
+
+        hdr = realloc(hdr, sizeof(*hdr) + (capacity + 1) * sizeof(char *));
+        if (NULL == hdr) {
+            return FAIL;
+        }
+
+        hdr->capacity = capacity;
+        *arr = hdr->slots;
     }
 
-    (*arr)[++i] = NULL;
+    hdr->slots[hdr->count++] = entry;
+    hdr->slots[hdr->count] = NULL;
 
     return SUCCEED;
 }
 
+size_t
+str_strarr_count(char **arr)
+{
+    return STR_STRARR_HDR(arr)->count;
+}
+
 int
 str_strarr_init(char ***arr)
 {
-    *arr = malloc(sizeof(char **));
-    if (NULL == *arr) {
+    struct str_strarr *hdr;
+
+    hdr = malloc(sizeof(*hdr) + sizeof(char *));
+    if (NULL == hdr) {
+        *arr = NULL;
         return FAIL;
     }
 
-    **arr = NULL;
+    hdr->count = 0;
+    hdr->capacity = 0;
+    hdr->strings = NULL;
+    hdr->slots[0] = NULL;
+
+    *arr = hdr->slots;
 
     return SUCCEED;
 }
+
+void
+str_strarr_free(char **arr)
+{
+    struct str_strarr *hdr;
+
+    if (NULL == arr)
+        return;
+
+    hdr = STR_STRARR_HDR(arr);
+
+    arena_destroy(hdr->strings);
+    free(hdr);
+}
@@ -9,6 +9,10 @@
 #include <stdarg.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define SUCCEED             0
 #define FAIL               -1
 
@@ -20,6 +24,19 @@
 char *
 str_strdup(const char *str);
 
+/**
+ * Copy at most n bytes of a string and null terminate the copy, use free() to
+ * free it.
+ */
+char *
+str_strndup(const char *str, size_t n);
+
+/**
+ * FNV-1a hash of first n bytes of a string, used to index parameter names
+ */
+uint32_t
+str_hash_n(const char *str, size_t n);
+
 /**
  * Strip characters from the end of a string
  *
@@ -59,11 +76,96 @@ str_ltrim(char *str, const char *charlist);
 void
 str_lrtrim(char *str, const char *charlist);
 
+/* strings up to this size including the null character need no allocation */
+#define STR_BUF_INLINE      256
+
+/**
+ * Growable string, appending is amortized O(1) and short strings stay in the
+ * inline buffer; data is always null terminated
+ *
+ * @comments
+ *   data may point into the structure itself, so it must not be copied
+ */
+struct str_buf {
+    char   *data;
+    size_t  len;
+    size_t  alloc;                      /* size of data */
+    char    inline_data[STR_BUF_INLINE];
+};
+
+/**
+ * Initialize an empty string builder, use str_buf_free() to free it.
+ */
+void
+str_buf_init(struct str_buf *sb);
+
+/**
+ * Make room for appending n more bytes without reallocation
+ *
+ * @return
+ *   SUCCEED if succeed
+ *   FAIL if out of memory, the string is left as it is
+ */
+int
+str_buf_reserve(struct str_buf *sb, size_t n);
+
+/**
+ * Append first n bytes of a string
+ *
+ * @return
+ *   SUCCEED if succeed
+ *   FAIL if out of memory, the string is left as it is
+ */
+int
+str_buf_append_n(struct str_buf *sb, const char *str, size_t n);
+
+/**
+ * Append a string
+ *
+ * @return
+ *   SUCCEED if succeed
+ *   FAIL if out of memory, the string is left as it is
+ */
+int
+str_buf_append(struct str_buf *sb, const char *str);
+
+/**
+ * Append formatted output
+ *
+ * @return
+ *   SUCCEED if succeed
+ *   FAIL if out of memory or on output error, the string is left as it is
+ */
+int
+str_buf_vprintf(struct str_buf *sb, const char *f, va_list args);
+
+int
+str_buf_printf(struct str_buf *sb, const char *f, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Cut the string to its first len bytes, memory is kept for reuse
+ */
+void
+str_buf_truncate(struct str_buf *sb, size_t len);
+
+/**
+ * Empty the string, memory is kept for reuse
+ */
+void
+str_buf_reset(struct str_buf *sb);
+
+/**
+ * Release memory of the string and make it empty
+ */
+void
+str_buf_free(struct str_buf *sb);
+
 /**
  * Dynamical formatted output conversion
  *
  * @return
- *   formatted string, a pointer to allocated memory
+ *   formatted string, a pointer to allocated memory, NULL if out of memory
  */
 char *
 str_dvsprintf(char *dest, const char *f, va_list args);
@@ -88,6 +190,32 @@ str_dsprintf(char *dest, const char *f, ...);
  */
 int str_is_utf8(const char *text);
 
+/**
+ * Check UTF-8 sequences of a string that is not null terminated
+ *
+ * @param text
+ *   [IN] pointer to the string
+ * @param n
+ *   [IN] string length
+ *
+ * @return
+ *   SUCCEED if string is valid or FAIL otherwise
+ */
+int str_is_utf8_n(const char *text, size_t n);
+
+/**
+ * Validate a single UTF-8 character
+ *
+ * @param text
+ *   [IN] pointer to the first byte of the character
+ * @param n
+ *   [IN] number of bytes available, at least 1
+ *
+ * @return
+ *   length of the character or 0 if it is not valid
+ */
+size_t str_utf8_char_len(const char *text, size_t n);
+
 /**
  * Check if the string is unsigned integer within the specified range and
  *          optionally store it into value parameter
@@ -131,6 +259,25 @@ int is_uint_n_range(const char *str, size_t n, void *value, size_t size,
  */
 int str2uint64(const char *str, const char *suffixes, uint64_t *value);
 
+/**
+ * Convert string that is not null terminated to 64bit unsigned integer
+ *
+ * @param str
+ *   [IN] string to convert
+ * @param sz
+ *   [IN] string length
+ * @param suffixes
+ *   [IN] accepted suffixes
+ * @param value
+ *   [OUT] a pointer to converted value
+ *
+ * @return
+ *   SUCCEED - the string is unsigned integer
+ *   FAIL - otherwise
+ */
+int str2uint64_n(const char *str, size_t sz, const char *suffixes,
+                 uint64_t *value);
+
 /**
  * Convert string to double
  *
@@ -156,8 +303,20 @@ double  str2double(const char *str);
 void
 str_trim_str_list(char *list, char delimiter);
 
+/*
+ * Layout of dynamic string arrays.  Up to version 1 an array was a plain
+ * malloc()ed NULL terminated char ** with strdup()ed entries that callers
+ * could free() or realloc() themselves.  Since version 2 the array handed out
+ * points past a hidden header and the entries live in storage owned by it:
+ * create arrays only with str_strarr_init(), grow them only with the
+ * str_strarr_*() functions and release them only with str_strarr_free().
+ */
+#define STR_STRARR_VERSION  2
+
 /**
- * Add a string to dynamic string array
+ * Add a copy of a string to dynamic string array, copies are stored one
+ * after another in blocks owned by the array and the array grows
+ * geometrically, so adding is amortized O(1)
  *
  * @param
  *   arr - a pointer to array of strings
@@ -171,6 +330,50 @@ str_trim_str_list(char *list, char delimiter);
 int
 str_strarr_add(char ***arr, const char *entry);
 
+/**
+ * Add first n bytes of a string to dynamic string array
+ *
+ * @param
+ *   arr - a pointer to array of strings
+ * @param
+ *   entry - string to add, does not need to be null terminated
+ * @param
+ *   n - number of bytes to add
+ *
+ * @return
+ *   SUCCEED if succeed
+ *   FAIL if fail
+ */
+int
+str_strarr_add_n(char ***arr, const char *entry, size_t n);
+
+/**
+ * Append a string to dynamic string array without copying it
+ *
+ * @param
+ *   arr - a pointer to array of strings
+ * @param
+ *   entry - string to append, the caller keeps managing its memory
+ *
+ * @return
+ *   SUCCEED if succeed
+ *   FAIL if fail
+ */
+int
+str_strarr_append(char ***arr, char *entry);
+
+/**
+ * Get number of strings in dynamic string array
+ *
+ * @param
+ *   arr - array of strings
+ *
+ * @return
+ *   number of strings, not counting the terminating NULL
+ */
+size_t
+str_strarr_count(char **arr);
+
 /**
  * Initialize dynamic string array
  *
@@ -180,8 +383,30 @@ str_strarr_add(char ***arr, const char *entry);
  * @return
  *   SUCCEED if succeed
  *   FAIL if fail
+ *
+ * @comments
+ *   the array reads as a usual NULL terminated char **, but it must only be
+ *   grown by str_strarr_add(), str_strarr_add_n() or str_strarr_append() and
+ *   released by str_strarr_free(); passing it to free() or realloc(), or
+ *   passing an array not made by this function to the str_strarr_*()
+ *   functions, is undefined behaviour, see STR_STRARR_VERSION
  */
 int
 str_strarr_init(char ***arr);
 
+/**
+ * Free dynamic string array and the copies made by str_strarr_add(),
+ * strings added by str_strarr_append() are left to their owner; this is the
+ * only way to release an array made by str_strarr_init()
+ *
+ * @param
+ *   arr - array of strings, can be NULL
+ */
+void
+str_strarr_free(char **arr);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* STR */
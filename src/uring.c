@@ -0,0 +1,193 @@
+/*
+ * Copyleft
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "str.h"
+#include "cfg.h"
+#include "uring.h"
+
+static int
+uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+int
+cfg_uring_init(struct cfg_uring *ring, unsigned entries)
+{
+    struct io_uring_params  p;
+    char                   *sq, *cq;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&p, 0, sizeof(p));
+
+    if (0 > (ring->fd = uring_setup(entries, &p)))
+        return FAIL;
+
+    /* open, statx and read requests came with the same kernel as this */
+    if (0 == (p.features & IORING_FEAT_RW_CUR_POS))
+        goto fail;
+
+    ring->entries = p.sq_entries;
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = p.cq_off.cqes +
+                         p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (0 != (p.features & IORING_FEAT_SINGLE_MMAP)) {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+            ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = 0;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    if (MAP_FAILED == ring->sq_ring)
+        goto fail;
+
+    if (0 == ring->cq_ring_size) {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd,
+                             IORING_OFF_CQ_RING);
+        if (MAP_FAILED == ring->cq_ring)
+            goto fail;
+    }
+
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == ring->sqes)
+        goto fail;
+
+    sq = ring->sq_ring;
+    ring->sq_head = (unsigned *)(void *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(void *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(void *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(void *)(sq + p.sq_off.array);
+    ring->sq_local = ring->submitted = *ring->sq_tail;
+
+    cq = ring->cq_ring;
+    ring->cq_head = (unsigned *)(void *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(void *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(void *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(void *)(cq + p.cq_off.cqes);
+
+    return SUCCEED;
+fail:
+    cfg_uring_destroy(ring);
+
+    return FAIL;
+}
+
+struct io_uring_sqe *
+cfg_uring_sqe(struct cfg_uring *ring)
+{
+    struct io_uring_sqe *sqe;
+    unsigned             head, i;
+
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    if (ring->sq_local - head >= ring->entries)
+        return NULL;
+
+    i = ring->sq_local++ & *ring->sq_mask;
+    ring->sq_array[i] = i;
+
+    sqe = &ring->sqes[i];
+    memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+int
+cfg_uring_submit(struct cfg_uring *ring, unsigned wait)
+{
+    int n;
+
+    __atomic_store_n(ring->sq_tail, ring->sq_local, __ATOMIC_RELEASE);
+
+    do {
+        n = uring_enter(ring->fd, ring->sq_local - ring->submitted, wait,
+                        0 != wait ? IORING_ENTER_GETEVENTS : 0);
+    }
+    while (0 > n && EINTR == errno);
+
+    if (0 > n) {
+        LOG_ERR("cannot submit file requests: %s", strerror(errno));
+        return FAIL;
+    }
+
+    /* entries the kernel did not take are offered again next time */
+    ring->submitted += (unsigned)n;
+
+    return SUCCEED;
+}
+
+int
+cfg_uring_unqueue(struct cfg_uring *ring, uint64_t *user_data)
+{
+    unsigned    i;
+
+    if (ring->sq_local == ring->submitted)
+        return FAIL;
+
+    i = --ring->sq_local & *ring->sq_mask;
+    *user_data = ring->sqes[ring->sq_array[i]].user_data;
+
+    /* the tail was published by the failed submission */
+    __atomic_store_n(ring->sq_tail, ring->sq_local, __ATOMIC_RELEASE);
+
+    return SUCCEED;
+}
+
+int
+cfg_uring_cqe(struct cfg_uring *ring, struct io_uring_cqe *cqe)
+{
+    unsigned    head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return FAIL;
+
+    *cqe = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    return SUCCEED;
+}
+
+void
+cfg_uring_destroy(struct cfg_uring *ring)
+{
+    if (NULL != ring->sqes && MAP_FAILED != (void *)ring->sqes)
+        munmap(ring->sqes, ring->sqes_size);
+
+    if (NULL != ring->cq_ring && MAP_FAILED != ring->cq_ring &&
+        ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+
+    if (NULL != ring->sq_ring && MAP_FAILED != ring->sq_ring)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+
+    if (0 <= ring->fd)
+        close(ring->fd);
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
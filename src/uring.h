@@ -0,0 +1,107 @@
+/*
+ * Copyleft
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <linux/io_uring.h>
+
+/**
+ * io_uring instance used by a single thread, set up with the raw system
+ * calls so that no library is needed
+ */
+struct cfg_uring {
+    int                     fd;
+    unsigned                entries;
+    unsigned               *sq_head;
+    unsigned               *sq_tail;
+    unsigned               *sq_mask;
+    unsigned               *sq_array;
+    unsigned                sq_local;   /* tail including unsubmitted ones */
+    unsigned                submitted;  /* tail the kernel has been told */
+    struct io_uring_sqe    *sqes;
+    unsigned               *cq_head;
+    unsigned               *cq_tail;
+    unsigned               *cq_mask;
+    struct io_uring_cqe    *cqes;
+    void                   *sq_ring;
+    size_t                  sq_ring_size;
+    void                   *cq_ring;    /* same as sq_ring if single mmap */
+    size_t                  cq_ring_size;
+    size_t                  sqes_size;
+};
+
+/**
+ * Set up a ring
+ *
+ * @param entries
+ *   [IN] submission queue size, a power of 2
+ *
+ * @return
+ *   SUCCEED - the ring is ready
+ *   FAIL - io_uring is not available, e.g. an old kernel or a seccomp
+ *   policy, or does not support file open, statx and read requests
+ */
+int
+cfg_uring_init(struct cfg_uring *ring, unsigned entries);
+
+/**
+ * Get an empty submission queue entry to fill in
+ *
+ * @return
+ *   the entry or NULL if the queue is full
+ */
+struct io_uring_sqe *
+cfg_uring_sqe(struct cfg_uring *ring);
+
+/**
+ * Submit the entries filled in so far and wait for completions
+ *
+ * @param wait
+ *   [IN] number of completions to wait for, 0 not to wait
+ *
+ * @return
+ *   SUCCEED - submitted
+ *   FAIL - io_uring_enter() failed
+ */
+int
+cfg_uring_submit(struct cfg_uring *ring, unsigned wait);
+
+/**
+ * Take back the last entry the kernel has not taken, once
+ * cfg_uring_submit() has failed
+ *
+ * @param user_data
+ *   [OUT] user_data of the entry
+ *
+ * @return
+ *   SUCCEED - the entry is removed from the queue
+ *   FAIL - every entry filled in has been submitted
+ */
+int
+cfg_uring_unqueue(struct cfg_uring *ring, uint64_t *user_data);
+
+/**
+ * Take the next completion
+ *
+ * @param cqe
+ *   [OUT] copy of the completion
+ *
+ * @return
+ *   SUCCEED - cqe is filled in
+ *   FAIL - no completion is ready
+ */
+int
+cfg_uring_cqe(struct cfg_uring *ring, struct io_uring_cqe *cqe);
+
+/**
+ * Release the ring, requests still in flight are completed by the kernel
+ */
+void
+cfg_uring_destroy(struct cfg_uring *ring);
+
+#endif /* URING_H */
@@ -0,0 +1,731 @@
+/*
+ * Copyleft
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "str.h"
+#include "cfg.h"
+#include "watch.h"
+
+/* events on a directory that can add, replace or remove a file */
+#define WATCH_DIR_EVENTS    (IN_CREATE | IN_DELETE | IN_MOVED_FROM |        \
+                             IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+/* events on a parsed file itself */
+#define WATCH_FILE_EVENTS   (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |       \
+                             IN_DELETE_SELF | IN_MOVE_SELF)
+
+/* an inotify watch and the names in it that matter */
+struct cfg_watch_entry {
+    int         wd;
+    int         all;        /* any event counts, e.g. a parsed file */
+    char      **names;      /* files of a watched directory */
+    size_t     *dirs;       /* included as these cfg_result_dirs() */
+    size_t      ndirs;
+};
+
+/* inotify instance with the watches of one parse result */
+struct cfg_watch_set {
+    int                     fd;
+    const struct cfg_result *result;    /* tells which names count */
+    struct cfg_watch_entry *entries;
+    size_t                  count;
+    size_t                  alloc;
+};
+
+/* private copy of a variable of the table */
+union cfg_watch_value {
+    int         i;
+    uint64_t    u;
+    char       *s;
+    char      **m;
+};
+
+struct cfg_watch {
+    char               *cfg_file;
+    struct cfg_line    *cfg;
+    struct cfg_line    *priv;       /* cfg parsing into values */
+    union cfg_watch_value *values;
+    union cfg_watch_value *defaults;    /* variables before the first parse */
+    int                 optional;
+    int                 strict;
+    int                 debounce_ms;
+    cfg_watch_cb        cb;
+    void               *arg;
+    struct cfg_watch_set set;
+    struct cfg_result  *applied;    /* the variables point into it */
+    struct cfg_result  *watched;    /* set was built from it */
+    pthread_mutex_t     lock;       /* held while variables are written */
+    int                 stop[2];    /* pipe, written to stop the thread */
+    pthread_t           thread;
+};
+
+static void
+watch_set_free(struct cfg_watch_set *set)
+{
+    size_t i;
+
+    for (i = 0; i < set->count; i++) {
+        str_strarr_free(set->entries[i].names);
+        free(set->entries[i].dirs);
+    }
+
+    free(set->entries);
+
+    if (-1 != set->fd)
+        close(set->fd);
+
+    set->entries = NULL;
+    set->count = set->alloc = 0;
+    set->fd = -1;
+}
+
+/**
+ * Find the entry of a watch descriptor
+ *
+ * @return
+ *   the entry or NULL if the descriptor is not known
+ */
+static struct cfg_watch_entry *
+watch_set_find(struct cfg_watch_set *set, int wd)
+{
+    size_t i;
+
+    for (i = 0; i < set->count; i++) {
+        if (set->entries[i].wd == wd)
+            return &set->entries[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * Add a watch, or extend a watch of the same inode
+ *
+ * @param set
+ *   [IN/OUT] watches
+ * @param path
+ *   [IN] file or directory to watch
+ * @param mask
+ *   [IN] inotify events
+ * @param entry
+ *   [OUT] entry of the watch, NULL if path does not exist
+ *
+ * @return
+ *   SUCCEED - watch was added or path does not exist
+ *   FAIL - out of memory or inotify limits are reached
+ */
+static int
+watch_set_entry(struct cfg_watch_set *set, const char *path, uint32_t mask,
+                struct cfg_watch_entry **entry)
+{
+    struct cfg_watch_entry *e, *tmp;
+    int wd;
+
+    *entry = NULL;
+
+    if (-1 == (wd = inotify_add_watch(set->fd, path, mask | IN_MASK_ADD))) {
+        if (ENOENT == errno || ENOTDIR == errno || EACCES == errno)
+            return SUCCEED;
+
+        LOG_ERR("cannot watch [%s]: %s", path, strerror(errno));
+        return FAIL;
+    }
+
+    if (NULL == (e = watch_set_find(set, wd))) {
+        if (set->count == set->alloc) {
+            set->alloc = 0 == set->alloc ? 16 : set->alloc * 2;
+
+            if (NULL == (tmp = realloc(set->entries,
+                                       set->alloc * sizeof(*tmp)))) {
+                LOG_ERR("cannot allocate watch of [%s]", path);
+                return FAIL;
+            }
+            set->entries = tmp;
+        }
+
+        e = &set->entries[set->count];
+        memset(e, 0, sizeof(*e));
+        e->wd = wd;
+
+        if (SUCCEED != str_strarr_init(&e->names)) {
+            LOG_ERR("cannot allocate watch of [%s]", path);
+            return FAIL;
+        }
+        set->count++;
+    }
+
+    *entry = e;
+
+    return SUCCEED;
+}
+
+/**
+ * Watch a file or directory
+ *
+ * @param name
+ *   [IN] name of a file in the directory to react to, NULL to react to
+ *   any event
+ */
+static int
+watch_set_add(struct cfg_watch_set *set, const char *path, uint32_t mask,
+              const char *name)
+{
+    struct cfg_watch_entry *e;
+
+    if (SUCCEED != watch_set_entry(set, path, mask, &e))
+        return FAIL;
+
+    if (NULL == e)
+        return SUCCEED;
+
+    if (NULL == name)
+        e->all = 1;
+    else if (SUCCEED != str_strarr_add(&e->names, name))
+        return FAIL;
+
+    return SUCCEED;
+}
+
+/**
+ * Watch an included directory for entries its pattern matches
+ *
+ * @param dir
+ *   [IN] index of the directory in cfg_result_dirs()
+ */
+static int
+watch_set_add_dir(struct cfg_watch_set *set, const char *path, size_t dir)
+{
+    struct cfg_watch_entry *e;
+    size_t *tmp;
+
+    /* files already parsed are watched themselves for writes in place */
+    if (SUCCEED != watch_set_entry(set, path, WATCH_DIR_EVENTS |
+                                   IN_CLOSE_WRITE, &e))
+        return FAIL;
+
+    if (NULL == e)
+        return SUCCEED;
+
+    if (NULL == (tmp = realloc(e->dirs, (e->ndirs + 1) * sizeof(*tmp)))) {
+        LOG_ERR("cannot allocate watch of [%s]", path);
+        return FAIL;
+    }
+
+    e->dirs = tmp;
+    e->dirs[e->ndirs++] = dir;
+
+    return SUCCEED;
+}
+
+/**
+ * Watch a parsed file and the name it has in its directory
+ */
+static int
+watch_set_add_file(struct cfg_watch_set *set, const char *file)
+{
+    const char *name;
+    char *dir;
+    int ret;
+
+    if (SUCCEED != watch_set_add(set, file, WATCH_FILE_EVENTS, NULL))
+        return FAIL;
+
+    if (NULL == (name = strrchr(file, PATH_SEPARATOR)))
+        return watch_set_add(set, ".", WATCH_DIR_EVENTS, file);
+
+    if (file == name)
+        dir = str_strdup("/");
+    else
+        dir = str_strndup(file, (size_t)(name - file));
+
+    if (NULL == dir)
+        return FAIL;
+
+    ret = watch_set_add(set, dir, WATCH_DIR_EVENTS, name + 1);
+    free(dir);
+
+    return ret;
+}
+
+/**
+ * Create watches for all files and directories of a parse result
+ *
+ * @return
+ *   SUCCEED - set holds a new inotify instance
+ *   FAIL - error creating watches, set is left empty
+ */
+static int
+watch_set_build(struct cfg_watch_set *set, const struct cfg_result *result)
+{
+    char **p, **dirs;
+
+    memset(set, 0, sizeof(*set));
+
+    if (-1 == (set->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC))) {
+        LOG_ERR("cannot initialize inotify: %s", strerror(errno));
+        return FAIL;
+    }
+
+    for (p = cfg_result_files(result); NULL != *p; p++) {
+        if (SUCCEED != watch_set_add_file(set, *p))
+            goto fail;
+    }
+
+    for (p = dirs = cfg_result_dirs(result); NULL != *p; p++) {
+        if (SUCCEED != watch_set_add_dir(set, *p, (size_t)(p - dirs)))
+            goto fail;
+    }
+
+    set->result = result;
+
+    return SUCCEED;
+fail:
+    watch_set_free(set);
+
+    return FAIL;
+}
+
+/**
+ * Read pending inotify events
+ *
+ * @return
+ *   1 if any event concerns a parsed file, an included directory or an entry
+ *   of it the "Include=..." pattern matches, 0 otherwise
+ */
+static int
+watch_set_read(struct cfg_watch_set *set)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    struct cfg_watch_entry *e;
+    ssize_t n;
+    size_t i;
+    char *p, **name;
+    int changed = 0;
+
+    while (0 < (n = read(set->fd, buf, sizeof(buf))) || (0 > n && EINTR == errno)) {
+        for (p = buf; 0 < n && p < buf + n; p += sizeof(*ev) + ev->len) {
+            ev = (const struct inotify_event *)(void *)p;
+
+            /* lost events, anything may have changed */
+            if (0 != (ev->mask & IN_Q_OVERFLOW)) {
+                changed = 1;
+                continue;
+            }
+
+            if (0 != (ev->mask & IN_IGNORED) ||
+                NULL == (e = watch_set_find(set, ev->wd)))
+                continue;
+
+            if (0 != e->all || 0 == ev->len) {
+                changed = 1;
+                continue;
+            }
+
+            for (name = e->names; NULL != *name; name++) {
+                if (0 == strcmp(*name, ev->name)) {
+                    changed = 1;
+                    break;
+                }
+            }
+
+            /* other files of an included directory are not parsed */
+            for (i = 0; 0 == changed && i < e->ndirs; i++) {
+                if (SUCCEED == cfg_result_dir_match(set->result, e->dirs[i],
+                                                    ev->name))
+                    changed = 1;
+            }
+        }
+    }
+
+    return changed;
+}
+
+static int64_t
+watch_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Release a parse result neither the variables nor the watches refer to
+ */
+static void
+watch_result_release(struct cfg_watch *w, struct cfg_result *result)
+{
+    if (result != w->applied && result != w->watched)
+        cfg_free(result);
+}
+
+/**
+ * Reset the private variables to the defaults before a parse
+ *
+ * @return
+ *   SUCCEED - values hold the defaults, multistrings are new arrays
+ *   FAIL - out of memory
+ */
+static int
+watch_values_reset(struct cfg_watch *w)
+{
+    char **p;
+    int i;
+
+    for (i = 0; NULL != w->cfg[i].parameter; i++) {
+        if (TYPE_MULTISTRING != w->cfg[i].type) {
+            w->values[i] = w->defaults[i];
+            continue;
+        }
+
+        /* entries of the table are only ever added to, start from a copy */
+        if (SUCCEED != str_strarr_init(&w->values[i].m))
+            return FAIL;
+
+        for (p = w->defaults[i].m; NULL != *p; p++) {
+            if (SUCCEED != str_strarr_add(&w->values[i].m, *p))
+                return FAIL;
+        }
+    }
+
+    return SUCCEED;
+}
+
+/**
+ * Free multistrings of the private variables that were not handed over
+ */
+static void
+watch_values_clear(struct cfg_watch *w)
+{
+    int i;
+
+    for (i = 0; NULL != w->cfg[i].parameter; i++) {
+        if (TYPE_MULTISTRING == w->cfg[i].type) {
+            str_strarr_free(w->values[i].m);
+            w->values[i].m = NULL;
+        }
+    }
+}
+
+/**
+ * Copy private variables to the variables of the table, called with lock
+ * held
+ */
+static void
+watch_values_apply(struct cfg_watch *w)
+{
+    char ***m;
+    int i;
+
+    for (i = 0; NULL != w->cfg[i].parameter; i++) {
+        switch (w->cfg[i].type) {
+        case TYPE_INT:
+            *(int *)w->cfg[i].variable = w->values[i].i;
+            break;
+        case TYPE_UINT64:
+            *(uint64_t *)w->cfg[i].variable = w->values[i].u;
+            break;
+        case TYPE_STRING:
+        case TYPE_STRING_LIST:
+            *(char **)w->cfg[i].variable = w->values[i].s;
+            break;
+        case TYPE_MULTISTRING:
+            m = w->cfg[i].variable;
+
+            /* the array of the caller is given back by cfg_watch_stop() */
+            if (*m != w->defaults[i].m)
+                str_strarr_free(*m);
+
+            *m = w->values[i].m;
+            w->values[i].m = NULL;
+            break;
+        }
+    }
+}
+
+/**
+ * Parse configuration file, rebuild watches and pass the result on
+ *
+ * The file is parsed into private variables, they are copied to the
+ * variables of the table only when the parse succeeded, under the lock
+ * readers take with cfg_watch_lock().
+ *
+ * @return
+ *   1 if something changed while parsing, 0 otherwise
+ */
+static int
+watch_parse(struct cfg_watch *w)
+{
+    struct cfg_watch_set set;
+    struct cfg_result *result = NULL, *old;
+    int ret, changed = 0;
+
+    if (SUCCEED != watch_values_reset(w)) {
+        LOG_ERR("cannot allocate variables of [%s]", w->cfg_file);
+        ret = FAIL;
+    }
+    else {
+        ret = parse_cfg_file_ex(w->cfg_file, w->priv, w->optional, w->strict,
+                                &result);
+    }
+
+    /* keep the old watches when the new ones cannot be created */
+    if (NULL != result && SUCCEED == watch_set_build(&set, result)) {
+        /* events of the old instance arrived while parsing */
+        if (-1 != w->set.fd)
+            changed = watch_set_read(&w->set);
+
+        watch_set_free(&w->set);
+        w->set = set;
+
+        old = w->watched;
+        w->watched = result;
+        watch_result_release(w, old);
+    }
+
+    pthread_mutex_lock(&w->lock);
+
+    old = NULL;
+
+    if (SUCCEED == ret) {
+        watch_values_apply(w);
+        old = w->applied;
+        w->applied = result;
+    }
+
+    w->cb(ret, result, w->arg);
+
+    pthread_mutex_unlock(&w->lock);
+
+    /* after cb, which may still have used the strings of the old result */
+    if (NULL != old)
+        watch_result_release(w, old);
+
+    watch_values_clear(w);
+    watch_result_release(w, result);
+
+    return changed;
+}
+
+static void *
+watch_thread(void *arg)
+{
+    struct cfg_watch *w = arg;
+    struct pollfd fds[2];
+    int64_t now, first = 0, deadline = 0;
+    int pending = 0, timeout, n;
+
+    fds[1].fd = w->stop[0];
+    fds[1].events = POLLIN;
+
+    while (1) {
+        fds[0].fd = w->set.fd;
+        fds[0].events = POLLIN;
+
+        timeout = -1;
+
+        if (0 != pending) {
+            now = watch_now_ms();
+            timeout = deadline > now ? (int)(deadline - now) : 0;
+        }
+
+        if (-1 == (n = poll(fds, 2, timeout))) {
+            if (EINTR == errno)
+                continue;
+
+            LOG_ERR("cannot wait for config changes: %s", strerror(errno));
+            break;
+        }
+
+        if (0 != fds[1].revents)
+            break;
+
+        if (0 != (fds[0].revents & POLLIN) && 0 != watch_set_read(&w->set)) {
+            now = watch_now_ms();
+
+            if (0 == pending) {
+                pending = 1;
+                first = now;
+            }
+
+            deadline = now + w->debounce_ms;
+
+            if (deadline > first + (int64_t)w->debounce_ms * CFG_WATCH_MAX_DEFER)
+                deadline = first + (int64_t)w->debounce_ms * CFG_WATCH_MAX_DEFER;
+        }
+
+        if (0 == pending || watch_now_ms() < deadline)
+            continue;
+
+        pending = 0;
+
+        if (0 != watch_parse(w)) {
+            pending = 1;
+            first = watch_now_ms();
+            deadline = first + w->debounce_ms;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Free everything of a watcher, the variables of the table are given their
+ * values from before cfg_watch_start() back
+ */
+static void
+watch_free(struct cfg_watch *w)
+{
+    int i;
+
+    /* applying the defaults frees the multistrings of the last parse */
+    pthread_mutex_lock(&w->lock);
+
+    for (i = 0; NULL != w->cfg[i].parameter; i++)
+        w->values[i] = w->defaults[i];
+
+    watch_values_apply(w);
+
+    pthread_mutex_unlock(&w->lock);
+
+    watch_set_free(&w->set);
+
+    if (w->watched != w->applied)
+        cfg_free(w->watched);
+    cfg_free(w->applied);
+
+    pthread_mutex_destroy(&w->lock);
+    close(w->stop[0]);
+    close(w->stop[1]);
+    free(w->defaults);
+    free(w->values);
+    free(w->priv);
+    free(w->cfg_file);
+    free(w);
+}
+
+int cfg_watch_start(struct cfg_watch **watch, const char *cfg_file,
+                    struct cfg_line *cfg, int optional, int strict,
+                    int debounce_ms, cfg_watch_cb cb, void *arg)
+{
+    struct cfg_watch *w;
+    size_t n;
+    int i;
+
+    for (n = 0; NULL != cfg[n].parameter; n++)
+        ;
+
+    if (NULL == (w = calloc(1, sizeof(*w))) ||
+        NULL == (w->cfg_file = str_strdup(cfg_file)) ||
+        NULL == (w->priv = malloc((n + 1) * sizeof(*w->priv))) ||
+        NULL == (w->values = calloc(n + 1, sizeof(*w->values))) ||
+        NULL == (w->defaults = calloc(n + 1, sizeof(*w->defaults)))) {
+        LOG_ERR("cannot allocate watcher of [%s]", cfg_file);
+        if (NULL != w) {
+            free(w->values);
+            free(w->priv);
+            free(w->cfg_file);
+        }
+        free(w);
+        return FAIL;
+    }
+
+    w->cfg = cfg;
+    w->optional = optional;
+    w->strict = strict;
+    w->debounce_ms = 0 < debounce_ms ? debounce_ms : CFG_WATCH_DEBOUNCE_MS;
+    w->cb = cb;
+    w->arg = arg;
+    w->set.fd = -1;
+
+    /* every parse starts from the values the variables have now */
+    memcpy(w->priv, cfg, (n + 1) * sizeof(*cfg));
+
+    for (i = 0; NULL != cfg[i].parameter; i++) {
+        switch (cfg[i].type) {
+        case TYPE_INT:
+            w->defaults[i].i = *(int *)cfg[i].variable;
+            w->priv[i].variable = &w->values[i].i;
+            break;
+        case TYPE_UINT64:
+            w->defaults[i].u = *(uint64_t *)cfg[i].variable;
+            w->priv[i].variable = &w->values[i].u;
+            break;
+        case TYPE_STRING:
+        case TYPE_STRING_LIST:
+            w->defaults[i].s = *(char **)cfg[i].variable;
+            w->priv[i].variable = &w->values[i].s;
+            break;
+        case TYPE_MULTISTRING:
+            w->defaults[i].m = *(char ***)cfg[i].variable;
+            w->priv[i].variable = &w->values[i].m;
+            break;
+        }
+    }
+
+    pthread_mutex_init(&w->lock, NULL);
+
+    if (0 != pipe2(w->stop, O_CLOEXEC)) {
+        LOG_ERR("cannot create pipe: %s", strerror(errno));
+        w->stop[0] = w->stop[1] = -1;
+        goto fail;
+    }
+
+    /* the first parse is also what tells which files to watch */
+    (void)watch_parse(w);
+
+    if (-1 == w->set.fd) {
+        LOG_ERR("cannot watch config file [%s]", cfg_file);
+        goto fail;
+    }
+
+    if (0 != pthread_create(&w->thread, NULL, watch_thread, w)) {
+        LOG_ERR("cannot start watcher of [%s]", cfg_file);
+        goto fail;
+    }
+
+    *watch = w;
+
+    return SUCCEED;
+fail:
+    watch_free(w);
+
+    return FAIL;
+}
+
+void cfg_watch_lock(struct cfg_watch *watch)
+{
+    pthread_mutex_lock(&watch->lock);
+}
+
+void cfg_watch_unlock(struct cfg_watch *watch)
+{
+    pthread_mutex_unlock(&watch->lock);
+}
+
+void cfg_watch_stop(struct cfg_watch *watch)
+{
+    if (NULL == watch)
+        return;
+
+    while (-1 == write(watch->stop[1], "", 1) && EINTR == errno)
+        ;
+
+    pthread_join(watch->thread, NULL);
+
+    watch_free(watch);
+}
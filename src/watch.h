@@ -0,0 +1,112 @@
+/*
+ * Copyleft
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "cfg.h"
+
+/* default time to wait for a burst of changes to settle, in milliseconds */
+#define CFG_WATCH_DEBOUNCE_MS   200
+/* a steady stream of changes delays a re-parse by at most this many windows */
+#define CFG_WATCH_MAX_DEFER     10
+
+/* watcher of a configuration file and everything it includes */
+struct cfg_watch;
+
+/**
+ * Callback invoked after every parse done by a watcher, with the lock of
+ * cfg_watch_lock() held
+ *
+ * @param ret
+ *   [IN] SUCCEED or FAIL as returned by parse_cfg_file_ex(), the variables
+ *   of the table hold the new values only on SUCCEED
+ * @param result
+ *   [IN] parse result, owned by the watcher and valid until cb returns,
+ *   NULL if it could not be allocated
+ * @param arg
+ *   [IN] argument given to cfg_watch_start()
+ */
+typedef void (*cfg_watch_cb)(int ret, const struct cfg_result *result,
+                             void *arg);
+
+/**
+ * Parse configuration file and keep parsing it again whenever it or any
+ * file or directory reached through "Include=..." changes
+ *
+ * Changes are picked up with inotify: every parsed file is watched directly
+ * and through its directory, so that atomic rename-over writes and deleted
+ * and re-created files are noticed, and every included directory is watched
+ * for files its "Include=..." pattern matches being added, written or
+ * removed.  Events are coalesced until nothing has changed for debounce_ms,
+ * then the file is parsed again on a background thread and the set of
+ * watches is rebuilt from the new parse result.
+ *
+ * Every parse starts from the values the variables of cfg have when the
+ * watcher is started and goes to private copies of them, which replace the
+ * variables only when the parse succeeds.
+ *
+ * @param watch
+ *   [OUT] the watcher, stop it with cfg_watch_stop()
+ * @param cfg_file
+ *   [IN] full name of config file
+ * @param cfg
+ *   [IN] pointer to configuration parameter structure, it must stay valid
+ *   until the watcher is stopped
+ * @param optional
+ *   [IN] do not treat missing configuration file as error
+ * @param strict
+ *   [IN] treat unknown parameters as error
+ * @param debounce_ms
+ *   [IN] quiet time before parsing again, 0 for CFG_WATCH_DEBOUNCE_MS
+ * @param cb
+ *   [IN] callback invoked with the result of every parse
+ * @param arg
+ *   [IN] argument passed to cb
+ *
+ * @return
+ *   SUCCEED - the watcher is running, the first parse has been done on the
+ *   calling thread and its result passed to cb, even if parsing failed
+ *   FAIL - the watcher could not be started, cb may already have been
+ *   called with the result of the first parse
+ *
+ * @comments
+ *   The variables of cfg are written on the watcher thread, read them from cb
+ *   or between cfg_watch_lock() and cfg_watch_unlock().  String values and
+ *   TYPE_MULTISTRING arrays are owned by the watcher and replaced, not
+ *   appended to, by every successful parse; pointers to them must not be
+ *   kept past cfg_watch_unlock().
+ */
+int cfg_watch_start(struct cfg_watch **watch, const char *cfg_file,
+                    struct cfg_line *cfg, int optional, int strict,
+                    int debounce_ms, cfg_watch_cb cb, void *arg);
+
+/**
+ * Keep the watcher from changing the variables of its table
+ *
+ * @param watch
+ *   [IN] watcher started by cfg_watch_start()
+ */
+void cfg_watch_lock(struct cfg_watch *watch);
+
+/**
+ * Let the watcher change the variables of its table again
+ *
+ * @param watch
+ *   [IN] watcher locked with cfg_watch_lock()
+ */
+void cfg_watch_unlock(struct cfg_watch *watch);
+
+/**
+ * Stop a watcher and wait for a parse in progress to finish
+ *
+ * The variables of the table are given back the values they had before
+ * cfg_watch_start(), strings of the parses are freed.
+ *
+ * @param watch
+ *   [IN] watcher started by cfg_watch_start(), can be NULL
+ */
+void cfg_watch_stop(struct cfg_watch *watch);
+
+#endif /* WATCH_H */
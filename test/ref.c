@@ -0,0 +1,298 @@
+/*
+ * Copyleft
+ */
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "ref.h"
+
+int
+ref_is_utf8(const char *text)
+{
+    size_t               i, mb_len, expecting_bytes = 0;
+    const unsigned char *utf8;
+    unsigned int         utf32;
+
+    while ('\0' != *text) {
+        if (0 == (*text & 0x80)) {
+            text++;
+            continue;
+        }
+
+        if (0x80 == (*text & 0xc0) || 0xfe == (*text & 0xfe))
+            return FAIL;
+
+        utf8 = (const unsigned char *)text;
+
+        if (0xc0 == (*text & 0xe0))
+            expecting_bytes = 1;
+        else if (0xe0 == (*text & 0xf0))
+            expecting_bytes = 2;
+        else if (0xf0 == (*text & 0xf8))
+            expecting_bytes = 3;
+        else if (0xf8 == (*text & 0xfc))
+            expecting_bytes = 4;
+        else if (0xfc == (*text & 0xfe))
+            expecting_bytes = 5;
+
+        mb_len = expecting_bytes + 1;
+        text++;
+
+        for (; 0 != expecting_bytes; expecting_bytes--) {
+            if (0x80 != (*text++ & 0xc0))
+                return FAIL;
+        }
+
+        if (0xc0 == (utf8[0] & 0xfe) ||
+            (0xe0 == utf8[0] && 0x00 == (utf8[1] & 0x20)) ||
+            (0xf0 == utf8[0] && 0x00 == (utf8[1] & 0x30)) ||
+            (0xf8 == utf8[0] && 0x00 == (utf8[1] & 0x38)) ||
+            (0xfc == utf8[0] && 0x00 == (utf8[1] & 0x3c)))
+            return FAIL;
+
+        utf32 = 0;
+
+        if (0xc0 == (utf8[0] & 0xe0))
+            utf32 = utf8[0] & 0x1f;
+        else if (0xe0 == (utf8[0] & 0xf0))
+            utf32 = utf8[0] & 0x0f;
+        else if (0xf0 == (utf8[0] & 0xf8))
+            utf32 = utf8[0] & 0x07;
+        else if (0xf8 == (utf8[0] & 0xfc))
+            utf32 = utf8[0] & 0x03;
+        else if (0xfc == (utf8[0] & 0xfe))
+            utf32 = utf8[0] & 0x01;
+
+        for (i = 1; i < mb_len; i++) {
+            utf32 <<= 6;
+            utf32 += utf8[i] & 0x3f;
+        }
+
+        if (utf32 > 0x10ffff || 0xd800 == (utf32 & 0xf800))
+            return FAIL;
+    }
+
+    return SUCCEED;
+}
+
+int
+ref_match_glob(const char *file, const char *pattern)
+{
+    const char  *f, *g, *p, *q;
+
+    f = file;
+    p = pattern;
+
+    while (1) {
+        /* corner case */
+        if ('\0' == *p)
+            return '\0' == *f ? SUCCEED : FAIL;
+
+        /* find a set of literal characters */
+        while ('*' == *p)
+            p++;
+
+        for (q = p; '\0' != *q && '*' != *q; q++)
+            ;
+
+        /* if literal characters are at the beginning... */
+        if (pattern == p) {
+            if (0 != strncmp(f, p, q - p))
+                return FAIL;
+
+            f += q - p;
+            p = q;
+
+            continue;
+        }
+
+        /* if literal characters are at the end... */
+        if ('\0' == *q) {
+            for (g = f; '\0' != *g; g++)
+                ;
+
+            if (g - f < q - p)
+                return FAIL;
+            return 0 == strcmp(g - (q - p), p) ? SUCCEED : FAIL;
+        }
+
+        /* if literal characters are in the middle... */
+        while (1) {
+            if ('\0' == *f)
+                return FAIL;
+            if (0 == strncmp(f, p, q - p)) {
+                f += q - p;
+                p = q;
+
+                break;
+            }
+
+            f++;
+        }
+    }
+}
+
+int
+ref_is_uint_n_range(const char *str, size_t n, void *value, size_t size,
+                    uint64_t min, uint64_t max)
+{
+    const uint64_t  max_uint64 = ~(uint64_t)__UINT64_C(0);
+    uint64_t value_uint64 = 0, c;
+    unsigned short value_offset;
+    int len = 0;
+
+    if ('\0' == *str || 0 == n || sizeof(uint64_t) < size
+        || (0 == size && NULL != value)) {
+
+        return FAIL;
+    }
+
+    while ('\0' != *str && 0 < n--) {
+        if (0 == isdigit(*str))
+            return FAIL;    /* not a digit */
+
+        c = (uint64_t)(unsigned char)(*str - '0');
+
+        if (20 <= ++len && (max_uint64 - c) / 10 < value_uint64)
+            return FAIL;    /* maximum value exceeded */
+
+        value_uint64 = value_uint64 * 10 + c;
+
+        str++;
+    }
+
+    if (min > value_uint64 || value_uint64 > max)
+        return FAIL;
+
+    if (NULL != value) {
+        /* On little endian architecture the output value will be stored
+           starting from the first bytes of 'value' buffer while on big endian
+           architecture it will be stored starting from the last bytes. We handle
+           it by storing the offset in the most significant byte of short value
+           and then use the first byte as source offset.  */
+
+        value_offset = (unsigned short)((sizeof(uint64_t) - size) << 8);
+
+        memcpy(value,
+               (unsigned char *)&value_uint64 + *((unsigned char *)&value_offset),
+               size);
+    }
+
+    return SUCCEED;
+}
+
+#define STR_KIBIBYTE        1024
+#define STR_MEBIBYTE        1048576
+#define STR_GIBIBYTE        1073741824
+#define STR_TEBIBYTE        __UINT64_C(1099511627776)
+
+#define SEC_PER_MIN         60
+#define SEC_PER_HOUR        3600
+#define SEC_PER_DAY         86400
+#define SEC_PER_WEEK       (7 * SEC_PER_DAY)
+
+#define is_uint64_n(str, n, value)                                      \
+    ref_is_uint_n_range(str, n, value, 8, 0x0, __UINT64_C(0xFFFFFFFFFFFFFFFF))
+
+static uint64_t
+suffix2factor(char c)
+{
+    switch (c)
+    {
+    case 'K':
+        return STR_KIBIBYTE;
+    case 'M':
+        return STR_MEBIBYTE;
+    case 'G':
+        return STR_GIBIBYTE;
+    case 'T':
+        return STR_TEBIBYTE;
+    case 's':
+        return 1;
+    case 'm':
+        return SEC_PER_MIN;
+    case 'h':
+        return SEC_PER_HOUR;
+    case 'd':
+        return SEC_PER_DAY;
+    case 'w':
+        return SEC_PER_WEEK;
+    default:
+        return 1;
+    }
+}
+
+int
+ref_str2uint64(const char *str, const char *suffixes, uint64_t *value)
+{
+    uint64_t factor = 1;
+    const char *p;
+    size_t sz;
+    int ret;
+
+    sz = strlen(str);
+    p = str + sz - 1;
+
+    if (NULL != strchr(suffixes, *p)) {
+        factor = suffix2factor(*p);
+        sz--;
+    }
+
+    if (SUCCEED == (ret = is_uint64_n(str, sz, value)))
+        *value *= factor;
+
+    return ret;
+}
+
+static char *
+ref_dvsprintf(char *dest, const char *f, va_list args)
+{
+    char *string = NULL;
+    int n, size = MAX_STRING_LEN >> 1;
+
+    va_list curr;
+
+    while (1) {
+        string = malloc(size);
+
+        va_copy(curr, args);
+        n = vsnprintf(string, size, f, curr);
+        va_end(curr);
+
+        if (0 <= n && n < size)
+            break;
+
+        /* result was truncated */
+        if (-1 == n)
+            size = size * 3 / 2 + 1;    /* the length is unknown */
+        else
+            size = n + 1;   /* n bytes + trailing '\0' */
+
+        free(string);
+    }
+
+    free(dest);
+
+    return string;
+}
+
+char *
+ref_dsprintf(char *dest, const char *f, ...)
+{
+    char    *string;
+    va_list args;
+
+    va_start(args, f);
+
+    string = ref_dvsprintf(dest, f, args);
+
+    va_end(args);
+
+    return string;
+}
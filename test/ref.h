@@ -0,0 +1,67 @@
+/*
+ * Copyleft
+ */
+
+#ifndef REF_H
+#define REF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Reference implementations the tests compare with, the code these
+ * routines had before they were rewritten
+ */
+
+/**
+ * str_is_utf8() before it was vectorized
+ *
+ * @return
+ *   SUCCEED if string is valid or FAIL otherwise
+ */
+int
+ref_is_utf8(const char *text);
+
+/**
+ * match_glob() of the "Include=..." parser, "*" was the only wildcard
+ *
+ * @return
+ *   SUCCEED - file matches a pattern
+ *   FAIL - otherwise
+ */
+int
+ref_match_glob(const char *file, const char *pattern);
+
+/**
+ * is_uint_n_range() before digits were converted 8 at a time
+ *
+ * @return
+ *   SUCCEED - the string is unsigned integer in range, stored into value
+ *   FAIL - otherwise
+ */
+int
+ref_is_uint_n_range(const char *str, size_t n, void *value, size_t size,
+                    uint64_t min, uint64_t max);
+
+/**
+ * str2uint64() before digits were converted 8 at a time, str must not be
+ * empty
+ *
+ * @return
+ *   SUCCEED - the string is unsigned integer with an optional suffix
+ *   FAIL - otherwise
+ */
+int
+ref_str2uint64(const char *str, const char *suffixes, uint64_t *value);
+
+/**
+ * str_dsprintf() before strings were formatted on the stack first
+ *
+ * @return
+ *   formatted string, a pointer to allocated memory
+ */
+char *
+ref_dsprintf(char *dest, const char *f, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#endif /* REF_H */
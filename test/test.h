@@ -0,0 +1,49 @@
+/*
+ * Copyleft
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Tests are plain programs run by ctest.  A failed check is reported with
+ * its location and counted, main() returns TEST_RESULT so that ctest sees
+ * the failure.
+ */
+static int test_failures;
+
+#define TEST_CHECK(cond, ...)                                               \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: %s failed: ", __FILE__, __LINE__,       \
+                    #cond);                                                 \
+            fprintf(stderr, __VA_ARGS__);                                   \
+            fputc('\n', stderr);                                            \
+            test_failures++;                                                \
+        }                                                                   \
+    }                                                                       \
+    while (0)
+
+/* stop a randomized test after this many failures, one is usually enough */
+#define TEST_MAX_FAILURES   10
+
+#define TEST_RESULT         (0 == test_failures ? 0 : 1)
+
+/**
+ * Random numbers of a fixed sequence, xorshift64*, so that a failure can be
+ * reproduced from the seed
+ */
+static inline uint64_t
+test_rand(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 2685821657736338717u;
+}
+
+#endif /* TEST_H */
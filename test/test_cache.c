@@ -0,0 +1,351 @@
+/*
+ * Copyleft
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "str.h"
+#include "cfg.h"
+#include "cache.h"
+#include "result.h"
+#include "test.h"
+
+#define CACHE_PATH_SIZE     256
+
+/* the outcome of a parse through the cache */
+#define PARSE_HIT           0
+#define PARSE_MISS          1
+#define PARSE_FAIL          2
+
+static char root[] = "/tmp/cconf_cache.XXXXXX";
+static char main_file[CACHE_PATH_SIZE], dir[CACHE_PATH_SIZE];
+static char image[CACHE_PATH_SIZE];
+
+/* sources are dated back past CACHE_RACY_SEC, each time a bit later */
+static time_t when;
+
+/* variables, set to values no file uses before every parse */
+static int       v_int;
+static uint64_t  v_uint;
+static char     *v_str;
+static char    **v_multi;
+
+static struct cfg_line cfg[] = {
+    {"Int", &v_int, TYPE_INT, PARM_OPT, 0, 1000},
+    {"Uint", &v_uint, TYPE_UINT64, PARM_OPT, 0, 0},
+    {"Str", &v_str, TYPE_STRING, PARM_OPT, 0, 0},
+    {"Multi", &v_multi, TYPE_MULTISTRING, PARM_OPT, 0, 0},
+    {NULL, NULL, 0, 0, 0, 0}
+};
+
+static void
+path_of(char *buf, const char *name)
+{
+    snprintf(buf, CACHE_PATH_SIZE, "%s/%s", root, name);
+}
+
+static void
+write_file(const char *name, const char *text)
+{
+    char    path[CACHE_PATH_SIZE];
+    FILE   *f;
+
+    path_of(path, name);
+
+    if (NULL == (f = fopen(path, "w"))) {
+        perror(path);
+        exit(1);
+    }
+
+    fputs(text, f);
+    fclose(f);
+}
+
+/* the main file, including every *.conf in the directory */
+static void
+write_main(const char *name, int i, const char *u)
+{
+    char    text[CACHE_PATH_SIZE * 2];
+
+    snprintf(text, sizeof(text), "Int=%d\nUint=%s\nStr=a\nInclude=%s/*.conf\n",
+             i, u, dir);
+    write_file(name, text);
+}
+
+/* date a file or directory and everything in it back, like bench.c does */
+static void
+age_entry(const char *path, time_t t)
+{
+    struct timespec times[2];
+    char            sub[CACHE_PATH_SIZE];
+    struct dirent  *d;
+    DIR            *dh;
+
+    if (NULL != (dh = opendir(path))) {
+        while (NULL != (d = readdir(dh))) {
+            if (0 == strcmp(d->d_name, ".") || 0 == strcmp(d->d_name, ".."))
+                continue;
+
+            if (sizeof(sub) > (size_t)snprintf(sub, sizeof(sub), "%s/%s", path,
+                                               d->d_name))
+                age_entry(sub, t);
+        }
+
+        closedir(dh);
+    }
+
+    times[0].tv_sec = times[1].tv_sec = t;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    utimensat(AT_FDCWD, path, times, 0);
+}
+
+/* the tree as if it had not changed for a while, but not as it was before */
+static void
+age_tree(void)
+{
+    age_entry(main_file, when);
+    age_entry(dir, when);
+    when += 10;
+}
+
+/**
+ * Parse through the cache and describe the values, e.g. "7 10240 a x,y"
+ * for Int, Uint, Str and the entries of Multi
+ *
+ * @return
+ *   PARSE_HIT, PARSE_MISS or PARSE_FAIL
+ */
+static int
+parse(struct cfg_line *table, int strict, char *out, size_t size)
+{
+    struct cfg_result  *result = NULL;
+    size_t              n = 0;
+    int                 ret, i;
+
+    v_int = 9;
+    v_uint = 9;
+    v_str = NULL;
+    if (SUCCEED != str_strarr_init(&v_multi))
+        exit(1);
+
+    if (SUCCEED != parse_cfg_file_cached(main_file, image, table,
+                                         CFG_FILE_REQUIRED, strict, &result))
+        ret = PARSE_FAIL;
+    else
+        ret = NULL != result->image ? PARSE_HIT : PARSE_MISS;
+
+    n += snprintf(out + n, size - n, "%d %llu %s ", v_int,
+                  (unsigned long long)v_uint, NULL != v_str ? v_str : "-");
+
+    for (i = 0; NULL != v_multi[i]; i++)
+        n += snprintf(out + n, size - n, "%s%s", 0 != i ? "," : "",
+                      v_multi[i]);
+
+    str_strarr_free(v_multi);
+    cfg_free(result);
+
+    return ret;
+}
+
+static const char *names[] = {"hit", "miss", "fail"};
+
+static void
+check_parse(int line, struct cfg_line *table, int strict, int expected,
+            const char *values)
+{
+    char    out[CACHE_PATH_SIZE];
+    int     ret;
+
+    ret = parse(table, strict, out, sizeof(out));
+
+    TEST_CHECK(ret == expected, "line %d: %s instead of %s", line, names[ret],
+               names[expected]);
+    TEST_CHECK(NULL == values || 0 == strcmp(out, values),
+               "line %d: [%s] instead of [%s]", line, out, values);
+}
+
+#define CHECK_PARSE(expected, values)                                       \
+    check_parse(__LINE__, cfg, CFG_STRICT, expected, values)
+
+/* replace the image with its first size bytes, or flip the byte at offset */
+static void
+damage_image(off_t size, off_t offset)
+{
+    char    c;
+    int     fd;
+
+    if (-1 == (fd = open(image, O_RDWR))) {
+        perror(image);
+        exit(1);
+    }
+
+    if (0 <= size && 0 != ftruncate(fd, size))
+        perror(image);
+
+    if (0 <= offset && 1 == pread(fd, &c, 1, offset)) {
+        c ^= 0x20;
+        if (1 != pwrite(fd, &c, 1, offset))
+            perror(image);
+    }
+
+    close(fd);
+}
+
+static off_t
+image_size(void)
+{
+    struct stat sb;
+
+    return 0 == stat(image, &sb) ? sb.st_size : 0;
+}
+
+/* files and directory entries of the tree, edited, added and removed */
+static void
+check_sources(void)
+{
+    char    path[CACHE_PATH_SIZE];
+
+    CHECK_PARSE(PARSE_MISS, "7 10240 a x,y");
+    CHECK_PARSE(PARSE_HIT, "7 10240 a x,y");
+
+    write_file("conf.d/1.conf", "Str=b\nMulti=x\n");
+    age_tree();
+    CHECK_PARSE(PARSE_MISS, "7 10240 b x,y");
+    CHECK_PARSE(PARSE_HIT, "7 10240 b x,y");
+
+    write_file("conf.d/3.conf", "Multi=z\nInt=8\n");
+    age_tree();
+    CHECK_PARSE(PARSE_MISS, "8 10240 b x,y,z");
+    CHECK_PARSE(PARSE_HIT, "8 10240 b x,y,z");
+
+    path_of(path, "conf.d/2.conf");
+    unlink(path);
+    age_tree();
+    CHECK_PARSE(PARSE_MISS, "8 10240 b x,z");
+    CHECK_PARSE(PARSE_HIT, "8 10240 b x,z");
+
+    /* a file not matching the pattern changes the directory only */
+    write_file("conf.d/notes.txt", "Int=1\n");
+    age_tree();
+    CHECK_PARSE(PARSE_MISS, "8 10240 b x,z");
+    CHECK_PARSE(PARSE_HIT, "8 10240 b x,z");
+
+    /* the same size and time, but another file */
+    write_main("main.conf.new", 7, "20K");
+    path_of(path, "main.conf.new");
+    age_entry(path, when - 10);
+    rename(path, main_file);
+    CHECK_PARSE(PARSE_MISS, "8 20480 b x,z");
+    CHECK_PARSE(PARSE_HIT, "8 20480 b x,z");
+}
+
+/* a source modified within CACHE_RACY_SEC of the parse is not cached */
+static void
+check_racy(void)
+{
+    write_file("conf.d/1.conf", "Str=c\nMulti=x\n");
+    age_entry(dir, when);
+    when += 10;
+
+    /* the main file was just written */
+    write_main("main.conf", 5, "10K");
+
+    CHECK_PARSE(PARSE_MISS, "8 10240 c x,z");
+    CHECK_PARSE(PARSE_MISS, "8 10240 c x,z");
+
+    age_tree();
+    CHECK_PARSE(PARSE_MISS, "8 10240 c x,z");
+    CHECK_PARSE(PARSE_HIT, "8 10240 c x,z");
+}
+
+/* images that cannot be used fall back to a full parse and are replaced */
+static void
+check_images(void)
+{
+    struct cfg_line other[sizeof(cfg) / sizeof(cfg[0]) + 1];
+    off_t           size = image_size();
+    int             x = 0;
+
+    TEST_CHECK(0 != size, "no image");
+
+    /* the string pool, the records and the version in the header */
+    damage_image(-1, size - 2);
+    CHECK_PARSE(PARSE_MISS, "8 10240 c x,z");
+    CHECK_PARSE(PARSE_HIT, "8 10240 c x,z");
+
+    damage_image(-1, 72);
+    CHECK_PARSE(PARSE_MISS, "8 10240 c x,z");
+    CHECK_PARSE(PARSE_HIT, "8 10240 c x,z");
+
+    damage_image(-1, 12);
+    CHECK_PARSE(PARSE_MISS, "8 10240 c x,z");
+    CHECK_PARSE(PARSE_HIT, "8 10240 c x,z");
+
+    damage_image(size / 2, -1);
+    CHECK_PARSE(PARSE_MISS, "8 10240 c x,z");
+    CHECK_PARSE(PARSE_HIT, "8 10240 c x,z");
+
+    damage_image(10, -1);
+    CHECK_PARSE(PARSE_MISS, "8 10240 c x,z");
+    CHECK_PARSE(PARSE_HIT, "8 10240 c x,z");
+
+    damage_image(0, -1);
+    CHECK_PARSE(PARSE_MISS, "8 10240 c x,z");
+    CHECK_PARSE(PARSE_HIT, "8 10240 c x,z");
+
+    /* other options and another table are another schema */
+    check_parse(__LINE__, cfg, CFG_NOT_STRICT, PARSE_MISS, "8 10240 c x,z");
+    check_parse(__LINE__, cfg, CFG_NOT_STRICT, PARSE_HIT, "8 10240 c x,z");
+    CHECK_PARSE(PARSE_MISS, "8 10240 c x,z");
+
+    memcpy(other, cfg, sizeof(cfg));
+    other[4] = (struct cfg_line){"Unused", &x, TYPE_INT, PARM_OPT, 0, 0};
+    other[5] = cfg[4];
+    check_parse(__LINE__, other, CFG_STRICT, PARSE_MISS, "8 10240 c x,z");
+    check_parse(__LINE__, other, CFG_STRICT, PARSE_HIT, "8 10240 c x,z");
+
+    /* the old values are out of range now */
+    other[0].max = 7;
+    check_parse(__LINE__, other, CFG_STRICT, PARSE_FAIL, NULL);
+}
+
+int main(void)
+{
+    char    cmd[CACHE_PATH_SIZE + 16];
+
+    if (NULL == mkdtemp(root)) {
+        perror(root);
+        return 1;
+    }
+
+    path_of(main_file, "main.conf");
+    path_of(dir, "conf.d");
+    path_of(image, "cache.img");
+    mkdir(dir, 0700);
+
+    write_main("main.conf", 7, "10K");
+    write_file("conf.d/1.conf", "Multi=x\n");
+    write_file("conf.d/2.conf", "Multi=y\n");
+
+    when = time(NULL) - 1000;
+    age_tree();
+
+    check_sources();
+    check_racy();
+    check_images();
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (0 != system(cmd))
+        perror(cmd);
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,386 @@
+/*
+ * Copyleft
+ */
+
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "pattern.h"
+#include "ref.h"
+#include "test.h"
+
+#define PATTERN_RUNS        10000
+#define PATTERN_NAMES       16
+#define PATTERN_MAX_PIECES  8
+#define PATTERN_MAX_DEPTH   4
+#define PATTERN_BUF_SIZE    1024
+
+/*
+ * Pieces of components, every kind of class; a "[" left open is not
+ * specified by POSIX and fnmatch() takes it either way, see check_rules()
+ */
+static const char *pieces[] = {
+    "a", "b", "ab", ".", "-", "]", "*", "*", "?", "[ab]", "[!a]", "[^.]",
+    "[]a]", "[a-c]", "[!]]", "[-a]", "[[ab]", "conf"
+};
+
+/* characters names are made of */
+static const char name_chars[] = "abc.-][";
+
+static void
+random_component(uint64_t *seed, char *buf, const char **set, size_t n)
+{
+    const char  *piece;
+    size_t       len = 0, count;
+
+    count = (size_t)(test_rand(seed) % PATTERN_MAX_PIECES) + 1;
+
+    while (0 < count--) {
+        piece = set[test_rand(seed) % n];
+
+        memcpy(buf + len, piece, strlen(piece));
+        len += strlen(piece);
+    }
+
+    buf[len] = '\0';
+}
+
+static void
+random_name(uint64_t *seed, char *buf)
+{
+    size_t  len, i;
+
+    len = (size_t)(test_rand(seed) % 8) + 1;
+
+    for (i = 0; i < len; i++)
+        buf[i] = name_chars[test_rand(seed) % (sizeof(name_chars) - 1)];
+
+    buf[len] = '\0';
+}
+
+/* a name that often matches, the component with wildcards filled in */
+static void
+matching_name(uint64_t *seed, const char *component, char *buf)
+{
+    const char  *p, *q;
+    size_t       len = 0;
+
+    for (p = component; '\0' != *p; p++) {
+        switch (*p) {
+        case '*':
+            while (0 != test_rand(seed) % 3)
+                buf[len++] = name_chars[test_rand(seed) % 3];
+            break;
+        case '?':
+            buf[len++] = name_chars[test_rand(seed) % 3];
+            break;
+        case '[':
+            buf[len++] = 'a';
+            /* past the class, "]" right after the bracket is in it */
+            if ('\0' != p[1] && NULL != (q = strchr(p + 2, ']')))
+                p = q;
+            break;
+        default:
+            buf[len++] = *p;
+        }
+    }
+
+    if (0 == len)
+        buf[len++] = 'a';
+
+    buf[len] = '\0';
+}
+
+static int
+match_one(const char *component, const char *name)
+{
+    struct cfg_pattern  *p;
+    int                  ret;
+
+    if (NULL == (p = cfg_pattern_compile(component)))
+        return -1;
+
+    ret = cfg_pattern_match_file(p, cfg_pattern_start(p), name);
+    cfg_pattern_free(p);
+
+    return ret;
+}
+
+/* single components of "*", "?" and classes compared with fnmatch() */
+static void
+check_components(void)
+{
+    char        component[PATTERN_BUF_SIZE], name[PATTERN_BUF_SIZE];
+    uint64_t    seed = 0x676c6f62u;
+    int         run, i, ref;
+
+    for (run = 0; run < PATTERN_RUNS && TEST_MAX_FAILURES > test_failures;
+         run++) {
+        random_component(&seed, component, pieces,
+                         sizeof(pieces) / sizeof(pieces[0]));
+
+        for (i = 0; i < PATTERN_NAMES; i++) {
+            if (0 == i % 2)
+                random_name(&seed, name);
+            else
+                matching_name(&seed, component, name);
+
+            ref = 0 == fnmatch(component, name, FNM_NOESCAPE) ? SUCCEED : FAIL;
+
+            TEST_CHECK(match_one(component, name) == ref,
+                       "[%s] on [%s] instead of %d", component, name, ref);
+        }
+    }
+}
+
+/* patterns with "*" only, which the parser took before, as it took them */
+static void
+check_stars(void)
+{
+    static const char   *stars[] = {"a", "b", "ab", ".", "conf", "*", "*"};
+    char                 component[PATTERN_BUF_SIZE], name[PATTERN_BUF_SIZE];
+    uint64_t             seed = 0x73746172u;
+    int                  run, i, ref;
+
+    for (run = 0; run < PATTERN_RUNS && TEST_MAX_FAILURES > test_failures;
+         run++) {
+        random_component(&seed, component, stars,
+                         sizeof(stars) / sizeof(stars[0]));
+
+        for (i = 0; i < PATTERN_NAMES; i++) {
+            if (0 == i % 2)
+                random_name(&seed, name);
+            else
+                matching_name(&seed, component, name);
+
+            ref = ref_match_glob(name, component);
+
+            TEST_CHECK(match_one(component, name) == ref,
+                       "[%s] on [%s] instead of %d", component, name, ref);
+        }
+    }
+}
+
+/**
+ * Reference for paths: "**" matches zero or more directories, the other
+ * components one name each with fnmatch()
+ */
+static int
+ref_match_path(char **components, int ncomponents, char **names, int nnames)
+{
+    int i;
+
+    if (0 == ncomponents)
+        return 0 == nnames ? SUCCEED : FAIL;
+
+    if (0 == strcmp(components[0], "**")) {
+        /* only directories, the file is matched by a later component */
+        for (i = 0; i < nnames; i++) {
+            if (SUCCEED == ref_match_path(components + 1, ncomponents - 1,
+                                          names + i, nnames - i))
+                return SUCCEED;
+        }
+
+        return FAIL;
+    }
+
+    if (0 == nnames || 0 != fnmatch(components[0], names[0], FNM_NOESCAPE))
+        return FAIL;
+
+    return ref_match_path(components + 1, ncomponents - 1, names + 1,
+                          nnames - 1);
+}
+
+/**
+ * Walk a path through a compiled pattern the way included directories are
+ * scanned
+ */
+static int
+match_path(const struct cfg_pattern *p, char **names, int nnames)
+{
+    cfg_pattern_set set;
+    int             i;
+
+    set = cfg_pattern_start(p);
+
+    for (i = 0; i + 1 < nnames; i++) {
+        if (0 == (set = cfg_pattern_match_dir(p, set, names[i], 0)))
+            return FAIL;
+    }
+
+    return cfg_pattern_match_file(p, set, names[nnames - 1]);
+}
+
+static void
+check_paths(void)
+{
+    static const char   *dirs[] = {"a", "b", "*", "?", "[ab]", "**", "**"};
+    static char          components[PATTERN_MAX_DEPTH + 1][PATTERN_BUF_SIZE];
+    static char          names[PATTERN_MAX_DEPTH * 2][PATTERN_BUF_SIZE];
+    char                *c[PATTERN_MAX_DEPTH + 1], *n[PATTERN_MAX_DEPTH * 2];
+    char                 pattern[PATTERN_BUF_SIZE];
+    struct cfg_pattern  *p;
+    uint64_t             seed = 0x70617468u;
+    size_t               len;
+    int                  run, i, j, ncomponents, nnames, ref;
+
+    for (run = 0; run < PATTERN_RUNS && TEST_MAX_FAILURES > test_failures;
+         run++) {
+        ncomponents = (int)(test_rand(&seed) % PATTERN_MAX_DEPTH) + 1;
+
+        for (i = 0, len = 0; i < ncomponents; i++) {
+            if (i + 1 < ncomponents)
+                strcpy(components[i], dirs[test_rand(&seed) % 7]);
+            else
+                random_component(&seed, components[i], pieces,
+                                 sizeof(pieces) / sizeof(pieces[0]));
+
+            /* "**" matches directories, never the file */
+            if (i + 1 == ncomponents && 0 == strcmp(components[i], "**"))
+                strcpy(components[i], "*");
+
+            c[i] = components[i];
+            len += (size_t)sprintf(pattern + len, "%s%s", 0 != i ? "/" : "",
+                                   c[i]);
+        }
+
+        if (NULL == (p = cfg_pattern_compile(pattern))) {
+            TEST_CHECK(NULL != p, "cannot compile [%s]", pattern);
+            continue;
+        }
+
+        for (j = 0; j < PATTERN_NAMES; j++) {
+            nnames = (int)(test_rand(&seed) % (PATTERN_MAX_DEPTH * 2)) + 1;
+
+            for (i = 0; i < nnames; i++) {
+                if (0 != test_rand(&seed) % 4 && i < ncomponents &&
+                    0 != strcmp(c[i], "**"))
+                    matching_name(&seed, c[i], names[i]);
+                else
+                    random_name(&seed, names[i]);
+
+                n[i] = names[i];
+            }
+
+            ref = ref_match_path(c, ncomponents, n, nnames);
+
+            TEST_CHECK(match_path(p, n, nnames) == ref,
+                       "[%s] on %d names, [%s]... instead of %d", pattern,
+                       nnames, n[0], ref);
+        }
+
+        cfg_pattern_free(p);
+    }
+}
+
+/* rules fnmatch() does not settle */
+static const struct {
+    const char *component;
+    const char *name;
+    int         ret;
+}
+rules[] = {
+    {"[", "[", SUCCEED},
+    {"a[b", "a[b", SUCCEED},
+    {"a[b", "ab", FAIL},
+    {"[*-", "[x-", SUCCEED},
+    {"*[", "x[", SUCCEED},
+    {"[?", "[x", SUCCEED},
+    {"[]", "[]", SUCCEED},
+    {"[!]", "[!]", SUCCEED},
+    {"[.a]", ".", SUCCEED},
+    {"a\\*", "a\\b", SUCCEED},      /* no escaping */
+    {"a\\*", "a*", FAIL},
+};
+
+static void
+check_rules(void)
+{
+    size_t  i;
+
+    for (i = 0; i < sizeof(rules) / sizeof(rules[0]); i++) {
+        TEST_CHECK(match_one(rules[i].component, rules[i].name) ==
+                   rules[i].ret, "[%s] on [%s] instead of %d",
+                   rules[i].component, rules[i].name, rules[i].ret);
+    }
+}
+
+/* components and patterns too long for the automata and the sets */
+static void
+check_long(void)
+{
+    static char     component[PATTERN_BUF_SIZE], name[PATTERN_BUF_SIZE];
+    static char     pattern[PATTERN_BUF_SIZE * 4];
+    static char     names[CFG_PATTERN_MAX_COMPONENTS + 8][4];
+    char           *n[CFG_PATTERN_MAX_COMPONENTS + 8];
+    struct cfg_pattern *p;
+    size_t          len;
+    int             i, count;
+
+    /* 100 characters, with and without "?" to the automaton limit */
+    memset(name, 'a', 100);
+    name[100] = '\0';
+
+    memcpy(component, name, 101);
+    TEST_CHECK(SUCCEED == match_one(component, name), "literal");
+
+    component[99] = '*';
+    component[0] = '?';
+    TEST_CHECK(SUCCEED == match_one(component, name), "wildcards");
+
+    name[50] = 'b';
+    TEST_CHECK(FAIL == match_one(component, name), "mismatch in the middle");
+
+    component[50] = '[';
+    memcpy(component + 51, "!a]", 3);
+    name[51] = name[52] = 'a';
+    /* fnmatch() agrees on the class */
+    TEST_CHECK(match_one(component, name) ==
+               (0 == fnmatch(component, name, FNM_NOESCAPE) ? SUCCEED : FAIL),
+               "class");
+
+    /* more components than a set has bits, with and without "**" */
+    for (count = CFG_PATTERN_MAX_COMPONENTS - 1;
+         count <= CFG_PATTERN_MAX_COMPONENTS + 3; count++) {
+        for (i = 0, len = 0; i < count; i++) {
+            len += (size_t)sprintf(pattern + len, "%s%s", 0 != i ? "/" : "",
+                                   0 == i % 3 ? "d?" : "d*");
+            sprintf(names[i], "d%d", i % 10);
+            n[i] = names[i];
+        }
+
+        if (NULL == (p = cfg_pattern_compile(pattern))) {
+            TEST_CHECK(NULL != p, "cannot compile %d components", count);
+            continue;
+        }
+
+        TEST_CHECK(SUCCEED == match_path(p, n, count), "%d components",
+                   count);
+        TEST_CHECK(FAIL == match_path(p, n, count - 1),
+                   "%d components, path one short", count);
+
+        names[count / 2][0] = 'x';
+        TEST_CHECK(FAIL == match_path(p, n, count),
+                   "%d components, mismatch", count);
+
+        cfg_pattern_free(p);
+    }
+
+    strcat(pattern, "/**/x");
+    p = cfg_pattern_compile(pattern);
+    TEST_CHECK(NULL == p, "\"**\" beyond the sets is compiled");
+    cfg_pattern_free(p);
+}
+
+int main(void)
+{
+    check_components();
+    check_stars();
+    check_rules();
+    check_paths();
+    check_long();
+
+    return TEST_RESULT;
+}
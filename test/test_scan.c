@@ -0,0 +1,306 @@
+/*
+ * Copyleft
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "scan.h"
+#include "ref.h"
+#include "test.h"
+
+/* random files compared with the line based parser */
+#define SCAN_RUNS           20000
+#define SCAN_MAX_LINES      8
+#define SCAN_MAX_PIECES     12
+#define SCAN_BUF_SIZE       4096
+
+/*
+ * Reference: the fgets() based loop of __parse_cfg_file() the scanner
+ * replaced, lines are trimmed, comments and blank lines skipped, the whole
+ * line validated and then split at the first '='.
+ */
+#define REF_LTRIM_CHARS     "\t "
+#define REF_RTRIM_CHARS     REF_LTRIM_CHARS "\r\n"
+
+static void
+ref_rtrim(char *str, const char *charlist)
+{
+    char    *p;
+
+    if ('\0' == *str)
+        return;
+
+    for (p = str + strlen(str) - 1; p >= str && NULL != strchr(charlist, *p);
+         p--)
+        *p = '\0';
+}
+
+static void
+ref_ltrim(char *str, const char *charlist)
+{
+    char    *p;
+
+    for (p = str; '\0' != *p && NULL != strchr(charlist, *p); p++)
+        ;
+
+    memmove(str, p, strlen(p) + 1);
+}
+
+struct ref_scanner {
+    const char *p;
+    const char *end;
+    int         lineno;
+    char        line[SCAN_BUF_SIZE];
+};
+
+/**
+ * Get the next line the reference parser would act on, in the terms of
+ * cfg_scan_next()
+ */
+static int
+ref_scan_next(struct ref_scanner *s, const char **key, const char **value)
+{
+    const char  *nl;
+    char        *sep;
+    size_t       len;
+
+    while (s->p < s->end) {
+        if (NULL == (nl = memchr(s->p, '\n', s->end - s->p)))
+            nl = s->end;
+
+        len = nl - s->p;
+        memcpy(s->line, s->p, len);
+        s->line[len] = '\0';
+        s->p = nl < s->end ? nl + 1 : s->end;
+        s->lineno++;
+
+        ref_ltrim(s->line, REF_LTRIM_CHARS);
+        ref_rtrim(s->line, REF_RTRIM_CHARS);
+
+        if ('#' == *s->line || '\0' == *s->line)
+            continue;
+
+        if (SUCCEED != ref_is_utf8(s->line))
+            return SCAN_NON_UTF8;
+
+        if (NULL == (sep = strchr(s->line, '=')))
+            return SCAN_NO_VALUE;
+
+        *sep++ = '\0';
+        ref_rtrim(s->line, REF_RTRIM_CHARS);
+        ref_ltrim(sep, REF_LTRIM_CHARS);
+
+        *key = s->line;
+        *value = sep;
+
+        return SCAN_TOKEN;
+    }
+
+    return SCAN_EOF;
+}
+
+/*
+ * Pieces random lines are made of, no '[' at the start of a line and no
+ * backslash so that sections and continuations, which the reference does
+ * not know, never show up
+ */
+static const char *pieces[] = {
+    "a", "Key", "x1", "=", "==", " ", "\t", "  \t", "#", "\r", "v",
+    "vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv", "\xc3\xa9", "\xe2\x82\xac",
+    "\xf0\x9f\x98\x80", "\xc3", "\xff", "\xed\xa0\x80", "\xc0\xaf",
+    "\xe0\x80\xaf", "\xf4\x90\x80\x80", "\x80", "]", "[s]"
+};
+
+static size_t
+random_file(uint64_t *seed, char *buf)
+{
+    const char  *piece;
+    size_t       size = 0, len;
+    int          lines, pieces_n, blank, i, j;
+
+    lines = (int)(test_rand(seed) % SCAN_MAX_LINES) + 1;
+
+    for (i = 0; i < lines; i++) {
+        pieces_n = (int)(test_rand(seed) % SCAN_MAX_PIECES);
+
+        for (j = 0, blank = 1; j < pieces_n; j++) {
+            piece = pieces[test_rand(seed) % (sizeof(pieces) /
+                                              sizeof(pieces[0]))];
+
+            /* a '[' first on a line could start a section */
+            if (0 != blank && '[' == *piece)
+                piece = "a";
+
+            if (NULL == strchr(" \t\r", *piece))
+                blank = 0;
+
+            len = strlen(piece);
+            memcpy(buf + size, piece, len);
+            size += len;
+        }
+
+        /* the last line does not always end with a line break */
+        if (i + 1 < lines || 0 != test_rand(seed) % 4) {
+            if (0 == test_rand(seed) % 4)
+                buf[size++] = '\r';
+            buf[size++] = '\n';
+        }
+    }
+
+    return size;
+}
+
+static void
+check_random_files(void)
+{
+    static char         buf[SCAN_BUF_SIZE], value[SCAN_BUF_SIZE];
+    struct ref_scanner  ref;
+    struct cfg_scanner  s;
+    struct cfg_token    tok;
+    const char         *key = NULL, *val = NULL;
+    uint64_t            seed = 0x5eed5ca11u;
+    size_t              size;
+    int                 run, rc, ref_rc;
+
+    for (run = 0; run < SCAN_RUNS && TEST_MAX_FAILURES > test_failures;
+         run++) {
+        size = random_file(&seed, buf);
+
+        ref.p = buf;
+        ref.end = buf + size;
+        ref.lineno = 0;
+        cfg_scan_init(&s, buf, size);
+
+        do {
+            ref_rc = ref_scan_next(&ref, &key, &val);
+            rc = cfg_scan_next(&s, &tok);
+
+            TEST_CHECK(rc == ref_rc, "run %d: %d instead of %d", run, rc,
+                       ref_rc);
+            if (rc != ref_rc)
+                break;
+
+            if (SCAN_EOF == rc)
+                break;
+
+            TEST_CHECK(tok.lineno == ref.lineno, "run %d: line %d instead of %d",
+                       run, tok.lineno, ref.lineno);
+
+            if (SCAN_TOKEN != rc) {
+                TEST_CHECK(tok.line_len == strlen(ref.line) &&
+                           0 == memcmp(tok.line, ref.line, tok.line_len),
+                           "run %d: line [%.*s] instead of [%s]", run,
+                           (int)tok.line_len, tok.line, ref.line);
+                break;
+            }
+
+            cfg_scan_value(&tok, value);
+
+            TEST_CHECK(tok.key_len == strlen(key) &&
+                       0 == memcmp(tok.key, key, tok.key_len),
+                       "run %d: key [%.*s] instead of [%s]", run,
+                       (int)tok.key_len, tok.key, key);
+            TEST_CHECK(0 == strcmp(value, val),
+                       "run %d: value [%s] instead of [%s]", run, value, val);
+        }
+        while (1);
+    }
+}
+
+/**
+ * Describe what the scanner finds in a file, e.g. "a=1@1 [s]@2 !value@3"
+ */
+static void
+describe(const char *file, char *out, size_t size)
+{
+    static char         value[SCAN_BUF_SIZE];
+    struct cfg_scanner  s;
+    struct cfg_token    tok;
+    size_t              n = 0;
+    int                 rc;
+
+    out[0] = '\0';
+    cfg_scan_init(&s, file, strlen(file));
+
+    while (SCAN_EOF != (rc = cfg_scan_next(&s, &tok))) {
+        switch (rc) {
+        case SCAN_TOKEN:
+            cfg_scan_value(&tok, value);
+            n += snprintf(out + n, size - n, "%s%.*s=%s@%d", 0 != n ? " " : "",
+                          (int)tok.key_len, tok.key, value, tok.lineno);
+            continue;
+        case SCAN_SECTION:
+            n += snprintf(out + n, size - n, "%s[%.*s]@%d", 0 != n ? " " : "",
+                          (int)tok.key_len, tok.key, tok.lineno);
+            continue;
+        case SCAN_NON_UTF8:
+            n += snprintf(out + n, size - n, "%s!utf8@%d", 0 != n ? " " : "",
+                          tok.lineno);
+            return;
+        default:
+            n += snprintf(out + n, size - n, "%s!value@%d", 0 != n ? " " : "",
+                          tok.lineno);
+            return;
+        }
+    }
+}
+
+/* continuation lines and sections, which the reference parser lacks */
+static const struct {
+    const char *file;
+    const char *tokens;
+}
+cases[] = {
+    {"a=1\\\n2", "a=12@1"},
+    {"a=1 \\\n   2\nb=3", "a=1 2@1 b=3@3"},
+    {"a=1\\\r\n\t2 \r\n", "a=12@1"},
+    {"a=1\\\n\\\n3", "a=13@1"},
+    {"a=x\\\n# not a comment\nb=1", "a=x# not a comment@1 b=1@3"},
+    {"a=x\\\n\nb=1", "a=x@1 b=1@3"},
+    {"a=x\\", "a=x\\@1"},              /* nothing to continue with */
+    {"a=x\\ \nb=1", "a=x\\@1 b=1@2"},
+    {"a=\\\nb", "a=b@1"},
+    {"S=C:\\path\\\nInt=7", "S=C:\\pathInt=7@1"},  /* a lone one continues */
+    {"S=C:\\path\\\\\nInt=7", "S=C:\\path\\@1 Int=7@2"},
+    {"S=a\\\\\r\nInt=5", "S=a\\@1 Int=5@2"},
+    {"a=\\\\\\\nb", "a=\\b@1"},
+    {"a=\\\\\\\\\\\n b\\\\\\\n", "a=\\\\b\\@1"},
+    {"S=abc\\\\", "S=abc\\@1"},
+    {"S=abc\\\\\\", "S=abc\\\\@1"},
+    {"a=1\\\n\xff", "!utf8@1"},
+    {"a=1\\\n2\nb", "a=12@1 !value@3"},
+    {"[s]\na=1", "[s]@1 a=1@2"},
+    {"  [ s.t ]  \r\n", "[s.t]@1"},
+    {"[s]\n[]\na=1", "[s]@1 []@2 a=1@3"},
+    {"[ ]", "[]@1"},
+    {"[s", "!value@1"},
+    {"s]", "!value@1"},
+    {"[", "!value@1"},
+    {"[s]=1", "[s]=1@1"},
+    {"[\xc3\xa9]", "[\xc3\xa9]@1"},
+    {"[\xff]", "!utf8@1"},
+    {"# [s]\na=1", "a=1@2"},
+};
+
+static void
+check_rules(void)
+{
+    char    out[SCAN_BUF_SIZE];
+    size_t  i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        describe(cases[i].file, out, sizeof(out));
+        TEST_CHECK(0 == strcmp(out, cases[i].tokens),
+                   "case %zu: [%s] instead of [%s]", i, out, cases[i].tokens);
+    }
+}
+
+int main(void)
+{
+    check_random_files();
+    check_rules();
+
+    return TEST_RESULT;
+}
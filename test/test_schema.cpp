@@ -0,0 +1,145 @@
+/*
+ * Copyleft
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+#include "cfg.hpp"
+#include "test.h"
+
+struct server {
+    int                 port = 0;
+    std::string_view    host = "localhost";
+    std::string_view    user;
+    cconf::string_list  tags;
+    cconf::multistring  alias;
+};
+
+static constexpr auto schema = cconf::make_schema(
+    cconf::param("Port", &server::port, PARM_MAND, 1, 65535),
+    cconf::param("Host", &server::host),
+    cconf::param("User", &server::user),
+    cconf::param("Tags", &server::tags),
+    cconf::param("Alias", &server::alias));
+
+static_assert(1 == schema.find("Host"), "parameter is declared");
+static_assert(-1 == schema.find("Hostname"), "parameter is not declared");
+
+static void
+write_file(const char *path, const char *text)
+{
+    FILE    *f;
+
+    if (nullptr == (f = fopen(path, "w"))) {
+        perror(path);
+        exit(1);
+    }
+
+    fputs(text, f);
+    fclose(f);
+}
+
+static std::string
+join(const cconf::multistring &m)
+{
+    std::string s;
+
+    for (std::string_view v : m)
+        s.append(v).append(";");
+
+    return s;
+}
+
+/*
+ * Parsing again into the same object and result, values of the first parse
+ * must not be left pointing into its freed result
+ */
+static void
+check_reparse(const char *path)
+{
+    server          s;
+    cconf::result   res;
+
+    write_file(path, "Port=80\nHost=example.org\nUser=www\nTags=a, b\n"
+                     "Alias=x\nAlias=y\n");
+
+    TEST_CHECK(SUCCEED == schema.parse(path, s, res), "first parse");
+    TEST_CHECK(80 == s.port, "port %d", s.port);
+    TEST_CHECK("example.org" == s.host, "host %.*s", (int)s.host.size(),
+               s.host.data());
+    TEST_CHECK("a,b" == s.tags.str(), "tags %.*s", (int)s.tags.str().size(),
+               s.tags.str().data());
+    TEST_CHECK("x;y;" == join(s.alias), "alias %s", join(s.alias).c_str());
+
+    write_file(path, "Port=81\nUser=nobody\nAlias=z\n");
+
+    TEST_CHECK(SUCCEED == schema.parse(path, s, res), "second parse");
+    TEST_CHECK(81 == s.port, "port %d", s.port);
+    TEST_CHECK(s.host.empty(), "host %.*s left from the first parse",
+               (int)s.host.size(), s.host.data());
+    TEST_CHECK("nobody" == s.user, "user %.*s", (int)s.user.size(),
+               s.user.data());
+    TEST_CHECK(s.tags.empty(), "tags left from the first parse");
+    TEST_CHECK("z;" == join(s.alias), "alias %s", join(s.alias).c_str());
+
+    /* a failed parse replaces the result all the same */
+    write_file(path, "Port=0\n");
+
+    TEST_CHECK(FAIL == schema.parse(path, s, res), "out of range");
+    TEST_CHECK(s.user.empty(), "user left from the second parse");
+    TEST_CHECK(s.alias.empty(), "alias left from the second parse");
+}
+
+/*
+ * Members the file does not set keep their defaults, also when the same
+ * file is parsed again into the same result
+ */
+static void
+check_defaults(const char *path)
+{
+    server          s;
+    cconf::result   res;
+    int             i;
+
+    write_file(path, "Port=443\nUser=www\n");
+
+    for (i = 0; i < 2; i++) {
+        TEST_CHECK(SUCCEED == schema.parse(path, s, res), "parse %d", i);
+        TEST_CHECK("localhost" == s.host, "parse %d: host %.*s", i,
+                   (int)s.host.size(), s.host.data());
+        TEST_CHECK("www" == s.user, "parse %d: user %.*s", i,
+                   (int)s.user.size(), s.user.data());
+        TEST_CHECK(s.alias.empty(), "parse %d: alias", i);
+    }
+
+    /* a default is still kept once another member has been cleared */
+    write_file(path, "Port=443\n");
+
+    TEST_CHECK(SUCCEED == schema.parse(path, s, res), "third parse");
+    TEST_CHECK("localhost" == s.host, "host %.*s", (int)s.host.size(),
+               s.host.data());
+    TEST_CHECK(s.user.empty(), "user left from the second parse");
+}
+
+int main()
+{
+    char    path[] = "/tmp/cconf_schema.XXXXXX";
+    int     fd;
+
+    if (-1 == (fd = mkstemp(path))) {
+        perror(path);
+        return 1;
+    }
+    close(fd);
+
+    check_reparse(path);
+    check_defaults(path);
+
+    unlink(path);
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyleft
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "ref.h"
+#include "test.h"
+
+#define STRBUF_RUNS         2000
+#define STRBUF_OPS          64
+#define STRBUF_DSPRINTF_RUNS 20000
+/* the model is reset before it grows past this */
+#define STRBUF_MODEL_MAX    16384
+#define STRBUF_PIECE_MAX    (STR_BUF_INLINE * 2)
+
+/* plain string the builder is compared with */
+struct model {
+    char    data[STRBUF_MODEL_MAX + STRBUF_PIECE_MAX * 2];
+    size_t  len;
+};
+
+static char text[STRBUF_PIECE_MAX + 1];
+
+/**
+ * Pick a length, often one that ends right at, before or past the end of
+ * the memory the builder has now
+ */
+static size_t
+random_len(uint64_t *seed, const struct str_buf *sb)
+{
+    size_t  room = sb->alloc - sb->len;
+
+    if (0 == test_rand(seed) % 2 && room < STRBUF_PIECE_MAX)
+        return room - 1 + (size_t)(test_rand(seed) % 3) - (0 != room - 1);
+
+    return (size_t)(test_rand(seed) % STRBUF_PIECE_MAX);
+}
+
+static int
+check_same(const struct str_buf *sb, const struct model *m, int run, int op)
+{
+    TEST_CHECK(sb->len == m->len, "run %d op %d: %zu bytes instead of %zu", run,
+               op, sb->len, m->len);
+    TEST_CHECK(sb->len != m->len || 0 == memcmp(sb->data, m->data, m->len),
+               "run %d op %d: contents differ", run, op);
+    TEST_CHECK('\0' == sb->data[sb->len], "run %d op %d: not terminated", run,
+               op);
+    TEST_CHECK(sb->alloc > sb->len, "run %d op %d: %zu bytes in %zu", run, op,
+               sb->len, sb->alloc);
+    TEST_CHECK((sb->data == sb->inline_data) ==
+               (STR_BUF_INLINE == sb->alloc), "run %d op %d: %zu bytes %s",
+               run, op, sb->alloc, sb->data == sb->inline_data ? "inline" :
+               "allocated");
+
+    return 0 == test_failures;
+}
+
+static void
+check_builder(void)
+{
+    static struct model m;
+    struct str_buf      sb;
+    uint64_t            seed = 0x73747262u;
+    size_t              n, room;
+    int                 run, op, num;
+
+    for (n = 0; n < STRBUF_PIECE_MAX; n++)
+        text[n] = (char)('a' + n % 26);
+
+    for (run = 0; run < STRBUF_RUNS && 0 == test_failures; run++) {
+        str_buf_init(&sb);
+        m.len = 0;
+
+        for (op = 0; op < STRBUF_OPS; op++) {
+            if (STRBUF_MODEL_MAX < m.len) {
+                str_buf_reset(&sb);
+                m.len = 0;
+            }
+
+            switch (test_rand(&seed) % 7) {
+            case 0:
+                n = random_len(&seed, &sb);
+                text[n] = '\0';
+                TEST_CHECK(SUCCEED == str_buf_append(&sb, text), "append");
+                text[n] = (char)('a' + n % 26);
+                memcpy(m.data + m.len, text, n);
+                m.len += n;
+                break;
+            case 1:
+                /* the bytes after the first n are not appended */
+                n = random_len(&seed, &sb);
+                TEST_CHECK(SUCCEED == str_buf_append_n(&sb, text + 1, n),
+                           "append_n");
+                memcpy(m.data + m.len, text + 1, n);
+                m.len += n;
+                break;
+            case 2:
+                n = random_len(&seed, &sb);
+                n = 8 < n ? n - 8 : 0;
+                num = (int)(test_rand(&seed) % 100000000);
+                TEST_CHECK(SUCCEED == str_buf_printf(&sb, "%.*s%08d",
+                                                     (int)n, text, num),
+                           "printf");
+                m.len += (size_t)sprintf(m.data + m.len, "%.*s%08d", (int)n,
+                                         text, num);
+                break;
+            case 3:
+                /* output that fits without growing */
+                TEST_CHECK(SUCCEED == str_buf_printf(&sb, "/%s", ""),
+                           "printf empty");
+                m.data[m.len++] = '/';
+                break;
+            case 4:
+                n = (size_t)(test_rand(&seed) % (m.len + 8));
+                str_buf_truncate(&sb, n);
+                if (n < m.len)
+                    m.len = n;
+                break;
+            case 5:
+                n = random_len(&seed, &sb);
+                TEST_CHECK(SUCCEED == str_buf_reserve(&sb, n), "reserve");
+                room = sb.alloc - sb.len;
+                TEST_CHECK(room > n, "run %d op %d: room for %zu after "
+                           "reserving %zu", run, op, room - 1, n);
+                break;
+            default:
+                if (0 == test_rand(&seed) % 4) {
+                    str_buf_free(&sb);
+                    m.len = 0;
+                    TEST_CHECK(sb.data == sb.inline_data, "free");
+                }
+                else {
+                    str_buf_reset(&sb);
+                    m.len = 0;
+                }
+                break;
+            }
+
+            if (0 == check_same(&sb, &m, run, op))
+                break;
+        }
+
+        str_buf_free(&sb);
+    }
+}
+
+/* formatted strings around the size of the stack buffer */
+static void
+check_dsprintf(void)
+{
+    static char big[MAX_STRING_LEN * 2];
+    uint64_t    seed = 0x64737072u;
+    char       *s, *ref, *dest;
+    size_t      n;
+    int         run;
+
+    memset(big, 'x', sizeof(big) - 1);
+
+    for (run = 0; run < STRBUF_DSPRINTF_RUNS && 0 == test_failures; run++) {
+        n = (size_t)(test_rand(&seed) % 2 ? (MAX_STRING_LEN >> 1) - 4 +
+                     test_rand(&seed) % 8 : test_rand(&seed) %
+                     (sizeof(big) - 1));
+
+        /* the old string is released */
+        dest = 0 == run % 2 ? NULL : str_dsprintf(NULL, "%d", run);
+
+        s = str_dsprintf(dest, "%.*s:%d", (int)n, big, run);
+        ref = ref_dsprintf(NULL, "%.*s:%d", (int)n, big, run);
+
+        TEST_CHECK(NULL != s && 0 == strcmp(s, ref), "%zu bytes", n);
+
+        free(s);
+        free(ref);
+    }
+}
+
+int main(void)
+{
+    check_builder();
+    check_dsprintf();
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyleft
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "ref.h"
+#include "test.h"
+
+#define UINT_RUNS           200000
+/* past 20 digits and across three 8 byte blocks */
+#define UINT_MAX_DIGITS     26
+#define UINT_BUF_SIZE       64
+
+/* characters that are not digits, including the neighbours of '0' and '9' */
+static const char others[] = " /:a-+.\xb0\xff";
+
+/* values at the 64 bit limit and around multiples of 8 digits */
+static const char *edges[] = {
+    "18446744073709551615", "18446744073709551616", "18446744073709551625",
+    "18446744073709551699", "19999999999999999999", "99999999999999999999",
+    "00000000018446744073709551615", "00000000018446744073709551616",
+    "1844674407370955161", "12345678", "123456789", "99999999", "100000000",
+    "0", "00000000", "0000000000000000", "1", "9"
+};
+
+static const size_t sizes[] = {1, 2, 4, 8};
+
+/* digits with at times one other character somewhere and a suffix */
+static size_t
+random_number(uint64_t *seed, char *buf)
+{
+    size_t  len, i;
+
+    if (0 == test_rand(seed) % 8) {
+        strcpy(buf, edges[test_rand(seed) % (sizeof(edges) /
+                                             sizeof(edges[0]))]);
+        len = strlen(buf);
+    }
+    else {
+        len = (size_t)(test_rand(seed) % (UINT_MAX_DIGITS + 1));
+
+        for (i = 0; i < len; i++) {
+            /* runs of zeros and nines reach the carries and the limit */
+            switch (test_rand(seed) % 4) {
+            case 0:
+                buf[i] = '0';
+                break;
+            case 1:
+                buf[i] = '9';
+                break;
+            default:
+                buf[i] = (char)('0' + test_rand(seed) % 10);
+            }
+        }
+    }
+
+    if (0 != len && 0 == test_rand(seed) % 4)
+        buf[test_rand(seed) % len] = others[test_rand(seed) %
+                                            (sizeof(others) - 1)];
+
+    if (0 == test_rand(seed) % 3)
+        buf[len++] = "KMGTsmhdwx"[test_rand(seed) % 10];
+
+    buf[len] = '\0';
+
+    return len;
+}
+
+static void
+check_str2uint64(void)
+{
+    char        buf[UINT_BUF_SIZE], copy[UINT_BUF_SIZE];
+    uint64_t    seed = 0x75696e74u, value, ref_value;
+    size_t      len;
+    int         run, ret, ref;
+
+    for (run = 0; run < UINT_RUNS && TEST_MAX_FAILURES > test_failures;
+         run++) {
+        len = random_number(&seed, buf);
+
+        /* the reference reads before an empty string */
+        if (0 == len) {
+            TEST_CHECK(FAIL == str2uint64(buf, "KMGTsmhdw", &value),
+                       "empty string");
+            continue;
+        }
+
+        value = ref_value = 0;
+        ref = ref_str2uint64(buf, "KMGTsmhdw", &ref_value);
+        ret = str2uint64(buf, "KMGTsmhdw", &value);
+
+        TEST_CHECK(ret == ref, "[%s]: %d instead of %d", buf, ret, ref);
+        TEST_CHECK(SUCCEED != ret || value == ref_value,
+                   "[%s]: %llu instead of %llu", buf, (unsigned long long)value,
+                   (unsigned long long)ref_value);
+
+        /* the same bytes followed by others that are not part of it */
+        memcpy(copy, buf, len);
+        memcpy(copy + len, "7K9", 4);
+        value = 0;
+        ret = str2uint64_n(copy, len, "KMGTsmhdw", &value);
+
+        TEST_CHECK(ret == ref, "[%s] of [%s]: %d instead of %d", buf, copy, ret,
+                   ref);
+        TEST_CHECK(SUCCEED != ret || value == ref_value,
+                   "[%s] of [%s]: %llu instead of %llu", buf, copy,
+                   (unsigned long long)value, (unsigned long long)ref_value);
+
+        /* suffixes that are not accepted are not digits */
+        value = ref_value = 0;
+        ref = ref_str2uint64(buf, "", &ref_value);
+        ret = str2uint64(buf, "", &value);
+
+        TEST_CHECK(ret == ref && (SUCCEED != ret || value == ref_value),
+                   "[%s] without suffixes: %d instead of %d", buf, ret, ref);
+    }
+}
+
+static void
+check_range(void)
+{
+    char        buf[UINT_BUF_SIZE];
+    uint64_t    seed = 0x72616e67u, min, max, out, ref_out;
+    size_t      len, n, size;
+    int         run, ret, ref;
+
+    for (run = 0; run < UINT_RUNS && TEST_MAX_FAILURES > test_failures;
+         run++) {
+        len = random_number(&seed, buf);
+
+        /* n is an upper bound at times, the string ends before it */
+        n = (size_t)(test_rand(&seed) % (len + 3));
+        size = sizes[test_rand(&seed) % (sizeof(sizes) / sizeof(sizes[0]))];
+
+        min = 0 == test_rand(&seed) % 2 ? 0 : test_rand(&seed) % 100000;
+        max = 0 == test_rand(&seed) % 2 ? UINT64_MAX :
+            min + test_rand(&seed) % 100000000;
+
+        out = ref_out = test_rand(&seed);
+
+        ref = ref_is_uint_n_range(buf, n, &ref_out, size, min, max);
+        ret = is_uint_n_range(buf, n, &out, size, min, max);
+
+        TEST_CHECK(ret == ref, "[%s], n %zu, size %zu: %d instead of %d", buf,
+                   n, size, ret, ref);
+        TEST_CHECK(out == ref_out, "[%s], n %zu, size %zu: %llx instead of %llx",
+                   buf, n, size, (unsigned long long)out,
+                   (unsigned long long)ref_out);
+
+        TEST_CHECK(ref_is_uint_n_range(buf, n, NULL, 0, min, max) ==
+                   is_uint_n_range(buf, n, NULL, 0, min, max),
+                   "[%s], n %zu without value", buf, n);
+    }
+
+    /* invalid sizes */
+    TEST_CHECK(FAIL == is_uint_n_range("1", 1, &out, 9, 0, UINT64_MAX),
+               "size 9");
+    TEST_CHECK(FAIL == is_uint_n_range("1", 1, &out, 0, 0, UINT64_MAX),
+               "size 0 with a value");
+}
+
+int main(void)
+{
+    check_str2uint64();
+    check_range();
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyleft
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "ref.h"
+#include "test.h"
+
+#define UTF8_RUNS           100000
+/* long enough for several 32 byte blocks and a tail */
+#define UTF8_MAX_LEN        160
+
+/*
+ * Sequences strings are made of: ASCII, every valid length, and the ways a
+ * sequence can be wrong, overlong, surrogate, above U+10FFFF, 5 and 6 byte
+ * forms, stray continuation and truncated
+ */
+static const char *seqs[] = {
+    "a", "0123456789abcdef", " ", "\x7f", "\xc2\x80", "\xdf\xbf", "\xc3\xa9",
+    "\xe0\xa0\x80", "\xe2\x82\xac", "\xed\x9f\xbf", "\xee\x80\x80",
+    "\xef\xbf\xbf", "\xf0\x90\x80\x80", "\xf0\x9f\x98\x80", "\xf4\x8f\xbf\xbf",
+    "\xc0\x80", "\xc1\xbf", "\xe0\x80\x80", "\xe0\x9f\xbf", "\xf0\x80\x80\x80",
+    "\xf0\x8f\xbf\xbf", "\xed\xa0\x80", "\xed\xbf\xbf", "\xf4\x90\x80\x80",
+    "\xf7\xbf\xbf\xbf", "\xf8\x88\x80\x80\x80", "\xfc\x84\x80\x80\x80\x80",
+    "\xfe", "\xff", "\x80", "\xbf", "\xc3", "\xe2\x82", "\xf0\x9f\x98"
+};
+
+#define SEQS_N      (sizeof(seqs) / sizeof(seqs[0]))
+/* sequences up to here are valid */
+#define SEQS_VALID  15
+
+static size_t
+random_text(uint64_t *seed, char *buf)
+{
+    const char  *seq;
+    size_t       size = 0, len, max;
+    int          invalid;
+
+    max = (size_t)(test_rand(seed) % UTF8_MAX_LEN);
+    invalid = 0 == test_rand(seed) % 2;
+
+    while (1) {
+        /* mostly valid text with at most one error, placed anywhere */
+        if (0 != invalid && 0 == test_rand(seed) % 16) {
+            seq = seqs[SEQS_VALID + test_rand(seed) % (SEQS_N - SEQS_VALID)];
+            invalid = 0;
+        }
+        else
+            seq = seqs[test_rand(seed) % SEQS_VALID];
+
+        if (size + (len = strlen(seq)) > max)
+            break;
+
+        memcpy(buf + size, seq, len);
+        size += len;
+    }
+
+    buf[size] = '\0';
+
+    return size;
+}
+
+static void
+check_random_texts(void)
+{
+    char        buf[UTF8_MAX_LEN + 1];
+    uint64_t    seed = 0x75746638u;
+    size_t      size, off;
+    int         run, ref;
+
+    for (run = 0; run < UTF8_RUNS && TEST_MAX_FAILURES > test_failures;
+         run++) {
+        size = random_text(&seed, buf);
+
+        ref = ref_is_utf8(buf);
+
+        TEST_CHECK(str_is_utf8(buf) == ref, "run %d, %zu bytes", run, size);
+        TEST_CHECK(str_is_utf8_n(buf, size) == ref, "run %d, %zu bytes", run,
+                   size);
+
+        /* unaligned starts */
+        for (off = 1; off < 4 && off <= size; off++) {
+            TEST_CHECK(str_is_utf8_n(buf + off, size - off) ==
+                       ref_is_utf8(buf + off), "run %d, %zu bytes at %zu", run,
+                       size - off, off);
+        }
+    }
+}
+
+/* every single byte after a run of ASCII, at each offset of two blocks */
+static void
+check_bytes(void)
+{
+    char    buf[72];
+    size_t  off;
+    int     c;
+
+    for (off = 0; off < 64; off++) {
+        for (c = 1; c < 256; c++) {
+            memset(buf, 'a', sizeof(buf) - 1);
+            buf[sizeof(buf) - 1] = '\0';
+            buf[off] = (char)c;
+
+            TEST_CHECK(str_is_utf8(buf) == ref_is_utf8(buf),
+                       "byte 0x%02x at %zu", c, off);
+        }
+    }
+}
+
+int main(void)
+{
+    check_random_texts();
+    check_bytes();
+
+    return TEST_RESULT;
+}